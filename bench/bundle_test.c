@@ -0,0 +1,243 @@
+/* Host test of the website bundle reader
+
+     bundle_test <image> <site dir> <site name>
+
+   Opens an image made by tools/bundle_pack.py from <site dir> with
+   asset_bundle_open(), looks up every file of the site with asset_bundle_find()
+   and compares the identity blob with the file on disk. Then checks that damaged
+   copies of the image are refused: a bad magic, an entry table cut short by the
+   image end, and entries pointing past the end of the partition. Prints one line
+   per failed check and exits with the number of failures.
+*/
+#include <dirent.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "esp_err.h"
+#include "asset_bundle.h"
+
+#define TEST_PATH_MAX (512)
+
+static int s_failures;
+
+#define CHECK(cond, ...)                                         \
+    do                                                           \
+    {                                                            \
+        if (!(cond))                                             \
+        {                                                        \
+            fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__);                        \
+            fprintf(stderr, "\n");                               \
+            s_failures++;                                        \
+        }                                                        \
+    } while (0)
+
+static uint8_t *read_file(const char *path, size_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+    {
+        return NULL;
+    }
+    struct stat st;
+    uint8_t *data = NULL;
+    if (fstat(fileno(f), &st) == 0 && (data = malloc(st.st_size ? st.st_size : 1)) != NULL &&
+        fread(data, 1, st.st_size, f) != (size_t)st.st_size)
+    {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    *size = st.st_size;
+    return data;
+}
+
+/* Every regular file under dir that bundle_pack.py stores must be found with its contents */
+static int check_site_dir(const asset_bundle_t *bundle, const char *root, const char *rel, const char *site)
+{
+    char dir_path[TEST_PATH_MAX];
+    snprintf(dir_path, sizeof(dir_path), "%s%s", root, rel);
+    DIR *dir = opendir(dir_path);
+    if (!dir)
+    {
+        CHECK(false, "can't open %s", dir_path);
+        return 0;
+    }
+    int files = 0;
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL)
+    {
+        const char *name = de->d_name;
+        size_t len = strlen(name);
+        if (name[0] == '.' || strcmp(name, "asset-manifest.txt") == 0 ||
+            (len > 3 && (strcmp(name + len - 3, ".gz") == 0 || strcmp(name + len - 3, ".br") == 0)))
+        {
+            continue;
+        }
+        char child[TEST_PATH_MAX];
+        char full[TEST_PATH_MAX];
+        snprintf(child, sizeof(child), "%s/%s", rel, name);
+        snprintf(full, sizeof(full), "%s%s", root, child);
+        struct stat st;
+        if (stat(full, &st) != 0)
+        {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode))
+        {
+            files += check_site_dir(bundle, root, child, site);
+            continue;
+        }
+
+        char uri[TEST_PATH_MAX + 32];
+        snprintf(uri, sizeof(uri), "/%.30s%s", site, child);
+        const bundle_entry_t *entry = asset_bundle_find(bundle, uri, strlen(uri));
+        CHECK(entry, "%s not found", uri);
+        if (entry)
+        {
+            size_t size;
+            uint8_t *data = read_file(full, &size);
+            CHECK(data && entry->size[BUNDLE_BLOB_IDENTITY] == size &&
+                      memcmp(asset_bundle_blob(bundle, entry, BUNDLE_BLOB_IDENTITY), data, size) == 0,
+                  "%s: contents differ from %s", uri, full);
+            free(data);
+        }
+        files++;
+    }
+    closedir(dir);
+    return files;
+}
+
+static void check_lookups(const asset_bundle_t *bundle, const char *root, const char *site)
+{
+    int files = check_site_dir(bundle, root, "", site);
+    CHECK(files > 0 && (uint32_t)files == bundle->header->entry_count, "%d files on disk, %" PRIu32 " in the bundle", files,
+          bundle->header->entry_count);
+
+    /* Entries are sorted, so the first and last one exercise both ends of the search */
+    for (uint32_t i = 0; i < bundle->header->entry_count; i += bundle->header->entry_count - 1)
+    {
+        const bundle_entry_t *entry = &bundle->entries[i];
+        const char *path = asset_bundle_path(bundle, entry);
+        CHECK(asset_bundle_find(bundle, path, entry->path_len) == entry, "entry %" PRIu32 " not found by its path", i);
+        /* A prefix or an extension of a stored path is another file */
+        CHECK(!asset_bundle_find(bundle, path, entry->path_len - 1), "prefix of %s found", path);
+        char longer[TEST_PATH_MAX];
+        snprintf(longer, sizeof(longer), "%sx", path);
+        CHECK(!asset_bundle_find(bundle, longer, strlen(longer)), "%s found", longer);
+        if (bundle->header->entry_count == 1)
+        {
+            break;
+        }
+    }
+    CHECK(!asset_bundle_find(bundle, "/", 1), "/ found");
+    CHECK(!asset_bundle_find(bundle, "/nosuchsite/index.html", 22), "/nosuchsite/index.html found");
+}
+
+/* Damage a copy of the image and expect asset_bundle_open() to refuse it */
+static void check_refused(const uint8_t *image, size_t size, const char *what, esp_err_t expected,
+                          void (*damage)(uint8_t *copy, size_t *size))
+{
+    uint8_t *copy = malloc(size);
+    memcpy(copy, image, size);
+    size_t copy_size = size;
+    damage(copy, &copy_size);
+
+    asset_bundle_t bundle = {0};
+    esp_err_t ret = asset_bundle_open(&bundle, copy, copy_size);
+    CHECK(ret == expected, "%s: got %s, expected %s", what, esp_err_to_name(ret), esp_err_to_name(expected));
+    CHECK(!bundle.header, "%s: bundle filled in", what);
+    free(copy);
+}
+
+static void bad_magic(uint8_t *copy, size_t *size)
+{
+    ((bundle_header_t *)copy)->magic ^= 0xff;
+}
+
+static void short_header(uint8_t *copy, size_t *size)
+{
+    *size = sizeof(bundle_header_t) - 1;
+}
+
+/* The partition ends inside the entry table */
+static void truncated_table(uint8_t *copy, size_t *size)
+{
+    bundle_header_t *header = (bundle_header_t *)copy;
+    *size = header->index_offset + header->entry_count * sizeof(bundle_entry_t) - 1;
+}
+
+/* The header claims more entries than the image holds */
+static void table_past_end(uint8_t *copy, size_t *size)
+{
+    bundle_header_t *header = (bundle_header_t *)copy;
+    header->entry_count = (header->image_size - header->index_offset) / sizeof(bundle_entry_t) + 1;
+}
+
+static bundle_entry_t *last_entry(uint8_t *copy)
+{
+    bundle_header_t *header = (bundle_header_t *)copy;
+    return (bundle_entry_t *)(copy + header->index_offset) + header->entry_count - 1;
+}
+
+static void blob_past_end(uint8_t *copy, size_t *size)
+{
+    bundle_entry_t *entry = last_entry(copy);
+    entry->size[BUNDLE_BLOB_IDENTITY] = ((bundle_header_t *)copy)->image_size - entry->offset[BUNDLE_BLOB_IDENTITY] + 1;
+}
+
+static void blob_offset_overflow(uint8_t *copy, size_t *size)
+{
+    bundle_entry_t *entry = last_entry(copy);
+    entry->offset[BUNDLE_BLOB_GZIP] = UINT32_MAX;
+    entry->size[BUNDLE_BLOB_GZIP] = 16;
+}
+
+static void path_past_end(uint8_t *copy, size_t *size)
+{
+    last_entry(copy)->path_offset = ((bundle_header_t *)copy)->image_size;
+}
+
+static void image_size_past_end(uint8_t *copy, size_t *size)
+{
+    ((bundle_header_t *)copy)->image_size = *size + 4;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 4)
+    {
+        fprintf(stderr, "usage: %s <image> <site dir> <site name>\n", argv[0]);
+        return 2;
+    }
+    size_t size;
+    uint8_t *image = read_file(argv[1], &size);
+    if (!image)
+    {
+        fprintf(stderr, "can't read %s\n", argv[1]);
+        return 2;
+    }
+
+    asset_bundle_t bundle = {0};
+    esp_err_t ret = asset_bundle_open(&bundle, image, size);
+    CHECK(ret == ESP_OK, "valid image refused: %s", esp_err_to_name(ret));
+    if (ret == ESP_OK)
+    {
+        check_lookups(&bundle, argv[2], argv[3]);
+    }
+
+    check_refused(image, size, "bad magic", ESP_ERR_NOT_FOUND, bad_magic);
+    check_refused(image, size, "short header", ESP_ERR_NOT_FOUND, short_header);
+    check_refused(image, size, "truncated table", ESP_ERR_INVALID_SIZE, truncated_table);
+    check_refused(image, size, "table past the end", ESP_ERR_INVALID_SIZE, table_past_end);
+    check_refused(image, size, "blob past the end", ESP_ERR_INVALID_SIZE, blob_past_end);
+    check_refused(image, size, "blob offset overflow", ESP_ERR_INVALID_SIZE, blob_offset_overflow);
+    check_refused(image, size, "path past the end", ESP_ERR_INVALID_SIZE, path_past_end);
+    check_refused(image, size, "image larger than the partition", ESP_ERR_INVALID_SIZE, image_size_past_end);
+
+    free(image);
+    printf("bundle_test: %d failures\n", s_failures);
+    return s_failures;
+}
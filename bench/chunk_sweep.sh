@@ -0,0 +1,35 @@
+#!/bin/sh
+#
+# Compare read-ahead chunk sizes and depths on the "large" scenario
+#
+#   bench/chunk_sweep.sh [rest_bench options...]
+#
+# Builds the benchmark once per CONFIG_EXAMPLE_READAHEAD_CHUNKS/_CHUNK_SIZE pair
+# (chunks=1 is the old read-then-send loop) and prints a JSON array with one
+# rest_bench result per build. The SD bus and Wi-Fi rates default to 1200 and
+# 1500 KiB/s, roughly a 4-bit SD card at 20 MHz through FATFS and an ESP32 SoftAP
+# link; the ideal is then the 1200 KiB/s of the slower one instead of ~670 KiB/s
+# for reads and sends taking turns. Options after the script name override them.
+
+set -e
+
+BENCH_DIR=$(cd "$(dirname "$0")" && pwd)
+ROOT=$(cd "$BENCH_DIR/.." && pwd)
+BUILD_DIR=${BENCH_BUILD_DIR:-$ROOT/_bench_build}
+CHUNKS=${CHUNKS:-"1 2 3"}
+CHUNK_SIZES=${CHUNK_SIZES:-"1024 2048 4096 8192 16384"}
+
+sep='['
+for chunks in $CHUNKS; do
+    for size in $CHUNK_SIZES; do
+        dir="$BUILD_DIR/chunks-$chunks-$size"
+        cmake -S "$BENCH_DIR" -B "$dir" -DCMAKE_BUILD_TYPE=RelWithDebInfo \
+              "-DBENCH_SDKCONFIG=CONFIG_EXAMPLE_READAHEAD_CHUNKS=$chunks;CONFIG_EXAMPLE_READAHEAD_CHUNK_SIZE=$size" >&2
+        cmake --build "$dir" -j"$(nproc)" >&2
+        printf '%s\n' "$sep"
+        "$dir/rest_bench" --label "chunks=$chunks size=$size" --scenarios large --concurrency 1 \
+                          --duration 3 --sd-kbps 1200 --net-kbps 1500 --nodelay "$@"
+        sep=','
+    done
+done
+printf ']\n'
@@ -0,0 +1,760 @@
+/* Subset of cJSON for host builds without ESP-IDF
+
+   Same data model, allocation hooks and output format as cJSON 1.7 for the calls
+   main/ makes, so allocation counts and printed documents stay comparable.
+*/
+#include <ctype.h>
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "cJSON.h"
+
+typedef struct
+{
+    char *buf;
+    size_t len;
+    size_t size;
+    int failed;
+} print_buf_t;
+
+typedef struct
+{
+    const char *p;
+    const char *end;
+} parse_buf_t;
+
+static void *(*s_malloc)(size_t) = malloc;
+static void (*s_free)(void *) = free;
+
+void cJSON_InitHooks(cJSON_Hooks *hooks)
+{
+    s_malloc = hooks && hooks->malloc_fn ? hooks->malloc_fn : malloc;
+    s_free = hooks && hooks->free_fn ? hooks->free_fn : free;
+}
+
+void *cJSON_malloc(size_t size)
+{
+    return s_malloc(size);
+}
+
+void cJSON_free(void *object)
+{
+    s_free(object);
+}
+
+static cJSON *item_new(int type)
+{
+    cJSON *item = s_malloc(sizeof(cJSON));
+    if (item)
+    {
+        memset(item, 0, sizeof(cJSON));
+        item->type = type;
+    }
+    return item;
+}
+
+static char *str_dup(const char *s, size_t len)
+{
+    char *copy = s_malloc(len + 1);
+    if (copy)
+    {
+        memcpy(copy, s, len);
+        copy[len] = '\0';
+    }
+    return copy;
+}
+
+void cJSON_Delete(cJSON *item)
+{
+    while (item)
+    {
+        cJSON *next = item->next;
+        cJSON_Delete(item->child);
+        if (item->valuestring)
+        {
+            s_free(item->valuestring);
+        }
+        if (item->string)
+        {
+            s_free(item->string);
+        }
+        s_free(item);
+        item = next;
+    }
+}
+
+/* ---- Parsing ---- */
+
+static void skip_ws(parse_buf_t *in)
+{
+    while (in->p < in->end && (unsigned char)*in->p <= ' ')
+    {
+        in->p++;
+    }
+}
+
+static int parse_hex4(const char *p, unsigned *out)
+{
+    *out = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        char c = p[i];
+        *out <<= 4;
+        if (c >= '0' && c <= '9')
+        {
+            *out |= c - '0';
+        }
+        else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+        {
+            *out |= (c | 0x20) - 'a' + 10;
+        }
+        else
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static char *parse_string_raw(parse_buf_t *in)
+{
+    const char *start = ++in->p;
+    while (in->p < in->end && *in->p != '"')
+    {
+        in->p += *in->p == '\\' ? 2 : 1;
+    }
+    if (in->p >= in->end)
+    {
+        return NULL;
+    }
+    /* Escapes only shrink, \uXXXX becomes at most 4 bytes of UTF-8 for 6 of input */
+    char *out = s_malloc(in->p - start + 1);
+    char *o = out;
+    if (!out)
+    {
+        return NULL;
+    }
+    for (const char *p = start; p < in->p; p++)
+    {
+        if (*p != '\\')
+        {
+            *o++ = *p;
+            continue;
+        }
+        switch (*++p)
+        {
+        case 'b':
+            *o++ = '\b';
+            break;
+        case 'f':
+            *o++ = '\f';
+            break;
+        case 'n':
+            *o++ = '\n';
+            break;
+        case 'r':
+            *o++ = '\r';
+            break;
+        case 't':
+            *o++ = '\t';
+            break;
+        case 'u':
+        {
+            unsigned cp;
+            if (in->p - p < 5 || !parse_hex4(p + 1, &cp))
+            {
+                s_free(out);
+                return NULL;
+            }
+            p += 4;
+            if (cp < 0x80)
+            {
+                *o++ = cp;
+            }
+            else if (cp < 0x800)
+            {
+                *o++ = 0xc0 | (cp >> 6);
+                *o++ = 0x80 | (cp & 0x3f);
+            }
+            else
+            {
+                *o++ = 0xe0 | (cp >> 12);
+                *o++ = 0x80 | ((cp >> 6) & 0x3f);
+                *o++ = 0x80 | (cp & 0x3f);
+            }
+            break;
+        }
+        default:
+            *o++ = *p;
+        }
+    }
+    *o = '\0';
+    in->p++;
+    return out;
+}
+
+static cJSON *parse_value(parse_buf_t *in, int depth);
+
+static cJSON *parse_container(parse_buf_t *in, int depth, int type, char close)
+{
+    cJSON *item = item_new(type);
+    cJSON *tail = NULL;
+    if (!item)
+    {
+        return NULL;
+    }
+    in->p++;
+    skip_ws(in);
+    if (in->p < in->end && *in->p == close)
+    {
+        in->p++;
+        return item;
+    }
+    for (;;)
+    {
+        char *key = NULL;
+        skip_ws(in);
+        if (type == cJSON_Object)
+        {
+            if (in->p >= in->end || *in->p != '"' || !(key = parse_string_raw(in)))
+            {
+                goto fail;
+            }
+            skip_ws(in);
+            if (in->p >= in->end || *in->p != ':')
+            {
+                s_free(key);
+                goto fail;
+            }
+            in->p++;
+        }
+        cJSON *child = parse_value(in, depth + 1);
+        if (!child)
+        {
+            if (key)
+            {
+                s_free(key);
+            }
+            goto fail;
+        }
+        child->string = key;
+        if (tail)
+        {
+            tail->next = child;
+            child->prev = tail;
+        }
+        else
+        {
+            item->child = child;
+        }
+        tail = child;
+        item->child->prev = tail;
+        skip_ws(in);
+        if (in->p < in->end && *in->p == ',')
+        {
+            in->p++;
+            continue;
+        }
+        if (in->p < in->end && *in->p == close)
+        {
+            in->p++;
+            return item;
+        }
+        goto fail;
+    }
+fail:
+    cJSON_Delete(item);
+    return NULL;
+}
+
+static cJSON *parse_value(parse_buf_t *in, int depth)
+{
+    skip_ws(in);
+    if (in->p >= in->end || depth > 1000)
+    {
+        return NULL;
+    }
+    size_t left = in->end - in->p;
+    cJSON *item = NULL;
+    switch (*in->p)
+    {
+    case '{':
+        return parse_container(in, depth, cJSON_Object, '}');
+    case '[':
+        return parse_container(in, depth, cJSON_Array, ']');
+    case '"':
+        if ((item = item_new(cJSON_String)) && !(item->valuestring = parse_string_raw(in)))
+        {
+            cJSON_Delete(item);
+            item = NULL;
+        }
+        return item;
+    case 'n':
+        if (left >= 4 && !strncmp(in->p, "null", 4) && (item = item_new(cJSON_NULL)))
+        {
+            in->p += 4;
+        }
+        return item;
+    case 't':
+        if (left >= 4 && !strncmp(in->p, "true", 4) && (item = item_new(cJSON_True)))
+        {
+            item->valueint = 1;
+            in->p += 4;
+        }
+        return item;
+    case 'f':
+        if (left >= 5 && !strncmp(in->p, "false", 5) && (item = item_new(cJSON_False)))
+        {
+            in->p += 5;
+        }
+        return item;
+    default:
+    {
+        char num[64];
+        size_t len = 0;
+        while (len < left && len < sizeof(num) - 1 && in->p[len] && strchr("+-0123456789.eE", in->p[len]))
+        {
+            num[len] = in->p[len];
+            len++;
+        }
+        num[len] = '\0';
+        char *num_end;
+        double value = strtod(num, &num_end);
+        if (!len || num_end == num || !(item = item_new(cJSON_Number)))
+        {
+            return NULL;
+        }
+        in->p += num_end - num;
+        item->valuedouble = value;
+        item->valueint = value >= INT32_MAX ? INT32_MAX : value <= (double)INT32_MIN ? INT32_MIN : (int)value;
+        return item;
+    }
+    }
+}
+
+cJSON *cJSON_ParseWithLength(const char *value, size_t buffer_length)
+{
+    if (!value)
+    {
+        return NULL;
+    }
+    parse_buf_t in = {.p = value, .end = value + buffer_length};
+    cJSON *item = parse_value(&in, 0);
+    skip_ws(&in);
+    if (item && in.p < in.end && *in.p)
+    {
+        cJSON_Delete(item);
+        return NULL;
+    }
+    return item;
+}
+
+cJSON *cJSON_Parse(const char *value)
+{
+    return value ? cJSON_ParseWithLength(value, strlen(value) + 1) : NULL;
+}
+
+/* ---- Printing ---- */
+
+static char *print_reserve(print_buf_t *out, size_t needed)
+{
+    if (out->failed)
+    {
+        return NULL;
+    }
+    if (out->len + needed + 1 > out->size)
+    {
+        size_t size = (out->len + needed + 1) * 2;
+        char *buf = s_malloc(size);
+        if (!buf)
+        {
+            out->failed = 1;
+            return NULL;
+        }
+        memcpy(buf, out->buf, out->len);
+        s_free(out->buf);
+        out->buf = buf;
+        out->size = size;
+    }
+    return out->buf + out->len;
+}
+
+static void print_raw(print_buf_t *out, const char *s, size_t len)
+{
+    char *p = print_reserve(out, len);
+    if (p)
+    {
+        memcpy(p, s, len);
+        out->len += len;
+    }
+}
+
+static void print_string(print_buf_t *out, const char *s)
+{
+    print_raw(out, "\"", 1);
+    for (; s && *s; s++)
+    {
+        unsigned char c = *s;
+        char esc[8];
+        switch (c)
+        {
+        case '"':
+            print_raw(out, "\\\"", 2);
+            break;
+        case '\\':
+            print_raw(out, "\\\\", 2);
+            break;
+        case '\b':
+            print_raw(out, "\\b", 2);
+            break;
+        case '\f':
+            print_raw(out, "\\f", 2);
+            break;
+        case '\n':
+            print_raw(out, "\\n", 2);
+            break;
+        case '\r':
+            print_raw(out, "\\r", 2);
+            break;
+        case '\t':
+            print_raw(out, "\\t", 2);
+            break;
+        default:
+            if (c < 32)
+            {
+                snprintf(esc, sizeof(esc), "\\u%04x", c);
+                print_raw(out, esc, 6);
+            }
+            else
+            {
+                print_raw(out, (const char *)&c, 1);
+            }
+        }
+    }
+    print_raw(out, "\"", 1);
+}
+
+static void print_number(print_buf_t *out, double d)
+{
+    char num[32];
+    int len;
+    if (isnan(d) || isinf(d))
+    {
+        len = snprintf(num, sizeof(num), "null");
+    }
+    else if (d == (double)(int)d)
+    {
+        len = snprintf(num, sizeof(num), "%d", (int)d);
+    }
+    else
+    {
+        len = snprintf(num, sizeof(num), "%1.15g", d);
+        if (strtod(num, NULL) != d)
+        {
+            len = snprintf(num, sizeof(num), "%1.17g", d);
+        }
+    }
+    print_raw(out, num, len);
+}
+
+static void print_indent(print_buf_t *out, int depth)
+{
+    for (int i = 0; i < depth; i++)
+    {
+        print_raw(out, "\t", 1);
+    }
+}
+
+static void print_value(print_buf_t *out, const cJSON *item, int depth, int format)
+{
+    switch (item->type & 0xff)
+    {
+    case cJSON_NULL:
+        print_raw(out, "null", 4);
+        break;
+    case cJSON_False:
+        print_raw(out, "false", 5);
+        break;
+    case cJSON_True:
+        print_raw(out, "true", 4);
+        break;
+    case cJSON_Number:
+        print_number(out, item->valuedouble);
+        break;
+    case cJSON_String:
+        print_string(out, item->valuestring);
+        break;
+    case cJSON_Array:
+        print_raw(out, "[", 1);
+        for (const cJSON *child = item->child; child; child = child->next)
+        {
+            print_value(out, child, depth + 1, format);
+            if (child->next)
+            {
+                print_raw(out, format ? ", " : ",", format ? 2 : 1);
+            }
+        }
+        print_raw(out, "]", 1);
+        break;
+    case cJSON_Object:
+        print_raw(out, format ? "{\n" : "{", format ? 2 : 1);
+        for (const cJSON *child = item->child; child; child = child->next)
+        {
+            if (format)
+            {
+                print_indent(out, depth + 1);
+            }
+            print_string(out, child->string);
+            print_raw(out, format ? ":\t" : ":", format ? 2 : 1);
+            print_value(out, child, depth + 1, format);
+            if (child->next)
+            {
+                print_raw(out, ",", 1);
+            }
+            if (format)
+            {
+                print_raw(out, "\n", 1);
+            }
+        }
+        if (format)
+        {
+            print_indent(out, depth);
+        }
+        print_raw(out, "}", 1);
+        break;
+    default:
+        out->failed = 1;
+    }
+}
+
+static char *print(const cJSON *item, int format)
+{
+    print_buf_t out = {0};
+    if (!item)
+    {
+        return NULL;
+    }
+    print_value(&out, item, 0, format);
+    if (out.failed || !print_reserve(&out, 0))
+    {
+        if (out.buf)
+        {
+            s_free(out.buf);
+        }
+        return NULL;
+    }
+    out.buf[out.len] = '\0';
+    return out.buf;
+}
+
+char *cJSON_Print(const cJSON *item)
+{
+    return print(item, 1);
+}
+
+char *cJSON_PrintUnformatted(const cJSON *item)
+{
+    return print(item, 0);
+}
+
+/* ---- Access ---- */
+
+int cJSON_GetArraySize(const cJSON *array)
+{
+    int size = 0;
+    for (const cJSON *child = array ? array->child : NULL; child; child = child->next)
+    {
+        size++;
+    }
+    return size;
+}
+
+cJSON *cJSON_GetArrayItem(const cJSON *array, int index)
+{
+    cJSON *child = array ? array->child : NULL;
+    while (child && index-- > 0)
+    {
+        child = child->next;
+    }
+    return child;
+}
+
+static cJSON *get_object_item(const cJSON *object, const char *name, int case_sensitive)
+{
+    if (!object || !name)
+    {
+        return NULL;
+    }
+    for (cJSON *child = object->child; child; child = child->next)
+    {
+        if (child->string && (case_sensitive ? !strcmp(child->string, name) : !strcasecmp(child->string, name)))
+        {
+            return child;
+        }
+    }
+    return NULL;
+}
+
+cJSON *cJSON_GetObjectItem(const cJSON *object, const char *string)
+{
+    return get_object_item(object, string, 0);
+}
+
+cJSON *cJSON_GetObjectItemCaseSensitive(const cJSON *object, const char *string)
+{
+    return get_object_item(object, string, 1);
+}
+
+cJSON_bool cJSON_IsNumber(const cJSON *item)
+{
+    return item && (item->type & 0xff) == cJSON_Number;
+}
+
+cJSON_bool cJSON_IsString(const cJSON *item)
+{
+    return item && (item->type & 0xff) == cJSON_String;
+}
+
+cJSON_bool cJSON_IsBool(const cJSON *item)
+{
+    return item && (item->type & (cJSON_True | cJSON_False));
+}
+
+cJSON_bool cJSON_IsArray(const cJSON *item)
+{
+    return item && (item->type & 0xff) == cJSON_Array;
+}
+
+cJSON_bool cJSON_IsObject(const cJSON *item)
+{
+    return item && (item->type & 0xff) == cJSON_Object;
+}
+
+/* ---- Construction ---- */
+
+cJSON *cJSON_CreateNull(void)
+{
+    return item_new(cJSON_NULL);
+}
+
+cJSON *cJSON_CreateBool(cJSON_bool boolean)
+{
+    return item_new(boolean ? cJSON_True : cJSON_False);
+}
+
+cJSON *cJSON_CreateNumber(double num)
+{
+    cJSON *item = item_new(cJSON_Number);
+    if (item)
+    {
+        item->valuedouble = num;
+        item->valueint = num >= INT32_MAX ? INT32_MAX : num <= (double)INT32_MIN ? INT32_MIN : (int)num;
+    }
+    return item;
+}
+
+cJSON *cJSON_CreateString(const char *string)
+{
+    cJSON *item = item_new(cJSON_String);
+    if (item && !(item->valuestring = str_dup(string, strlen(string))))
+    {
+        cJSON_Delete(item);
+        return NULL;
+    }
+    return item;
+}
+
+cJSON *cJSON_CreateArray(void)
+{
+    return item_new(cJSON_Array);
+}
+
+cJSON *cJSON_CreateObject(void)
+{
+    return item_new(cJSON_Object);
+}
+
+cJSON_bool cJSON_AddItemToArray(cJSON *array, cJSON *item)
+{
+    if (!array || !item || array == item)
+    {
+        return 0;
+    }
+    if (!array->child)
+    {
+        array->child = item;
+        item->prev = item;
+        item->next = NULL;
+    }
+    else
+    {
+        cJSON *tail = array->child->prev;
+        tail->next = item;
+        item->prev = tail;
+        array->child->prev = item;
+    }
+    return 1;
+}
+
+cJSON_bool cJSON_AddItemToObject(cJSON *object, const char *string, cJSON *item)
+{
+    if (!object || !string || !item)
+    {
+        return 0;
+    }
+    char *key = str_dup(string, strlen(string));
+    if (!key)
+    {
+        return 0;
+    }
+    if (item->string)
+    {
+        s_free(item->string);
+    }
+    item->string = key;
+    return cJSON_AddItemToArray(object, item);
+}
+
+static cJSON *add_to_object(cJSON *object, const char *name, cJSON *item)
+{
+    if (cJSON_AddItemToObject(object, name, item))
+    {
+        return item;
+    }
+    cJSON_Delete(item);
+    return NULL;
+}
+
+cJSON *cJSON_AddNullToObject(cJSON *object, const char *name)
+{
+    return add_to_object(object, name, cJSON_CreateNull());
+}
+
+cJSON *cJSON_AddBoolToObject(cJSON *object, const char *name, cJSON_bool boolean)
+{
+    return add_to_object(object, name, cJSON_CreateBool(boolean));
+}
+
+cJSON *cJSON_AddNumberToObject(cJSON *object, const char *name, double number)
+{
+    return add_to_object(object, name, cJSON_CreateNumber(number));
+}
+
+cJSON *cJSON_AddStringToObject(cJSON *object, const char *name, const char *string)
+{
+    return add_to_object(object, name, cJSON_CreateString(string));
+}
+
+cJSON *cJSON_AddObjectToObject(cJSON *object, const char *name)
+{
+    return add_to_object(object, name, cJSON_CreateObject());
+}
+
+cJSON *cJSON_AddArrayToObject(cJSON *object, const char *name)
+{
+    return add_to_object(object, name, cJSON_CreateArray());
+}
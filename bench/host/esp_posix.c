@@ -0,0 +1,889 @@
+/* Host stand-ins for the ESP-IDF system services used by main/
+
+   Logging, esp_timer (one-shot timers on a thread each), chip info, heap
+   accounting, an in-memory NVS, an empty partition table, a synchronous event
+   loop, a Wi-Fi driver without radio whose scans report a fixed set of synthetic
+   networks, and rate limited links standing in for the SD bus and the Wi-Fi air
+   time. The heap numbers count what the firmware code allocates (see
+   bench_heap_track), so /metrics and the bench report show the footprint of the
+   server rather than of the host C library.
+*/
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_wifi.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "esp_partition.h"
+#include "bench_host.h"
+
+/* Free DRAM of an ESP32 after the Wi-Fi stack started, for the heap_caps numbers */
+#define BENCH_HEAP_SIZE (180 * 1024)
+#define BENCH_EVENT_HANDLERS_MAX (16)
+#define BENCH_SCAN_NETWORKS_MAX (64)
+
+typedef struct nvs_entry
+{
+    char ns[16];
+    char key[16];
+    void *data;
+    size_t len;
+    struct nvs_entry *next;
+} nvs_entry_t;
+
+typedef struct
+{
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void *arg;
+} event_handler_t;
+
+struct esp_netif_obj
+{
+    esp_netif_ip_info_t ip_info;
+};
+
+esp_event_base_t WIFI_EVENT = "WIFI_EVENT";
+esp_event_base_t IP_EVENT = "IP_EVENT";
+
+static esp_log_level_t s_log_level = ESP_LOG_WARN;
+static int64_t s_start_us;
+static bench_heap_stats_t *s_heap;
+
+static pthread_mutex_t s_nvs_lock = PTHREAD_MUTEX_INITIALIZER;
+static nvs_entry_t *s_nvs;
+static char s_nvs_namespaces[8][16];
+
+static pthread_mutex_t s_event_lock = PTHREAD_MUTEX_INITIALIZER;
+static event_handler_t s_event_handlers[BENCH_EVENT_HANDLERS_MAX];
+
+static wifi_mode_t s_wifi_mode;
+static wifi_config_t s_wifi_sta_config;
+static wifi_config_t s_wifi_ap_config;
+static wifi_ps_type_t s_wifi_ps = WIFI_PS_MIN_MODEM;
+static unsigned s_scan_networks = 24;
+static unsigned s_scan_count;
+
+__attribute__((constructor)) static void esp_posix_init(void)
+{
+    static const char levels[] = "NEWIDV";
+    const char *env = getenv("BENCH_LOG_LEVEL");
+    const char *level = env ? strchr(levels, env[0]) : NULL;
+    if (level && *level)
+    {
+        s_log_level = (esp_log_level_t)(level - levels);
+    }
+    s_start_us = 0;
+    s_start_us = esp_timer_get_time();
+}
+
+/* ---- Errors and logging ---- */
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code)
+    {
+    case ESP_OK:
+        return "ESP_OK";
+    case ESP_FAIL:
+        return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+        return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+        return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:
+        return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:
+        return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:
+        return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:
+        return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_NVS_NOT_FOUND:
+        return "ESP_ERR_NVS_NOT_FOUND";
+    default:
+        return "UNKNOWN ERROR";
+    }
+}
+
+bool esp_log_enabled(esp_log_level_t level)
+{
+    return level <= s_log_level;
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+/* ---- System ---- */
+
+int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 - s_start_us;
+}
+
+struct esp_timer
+{
+    esp_timer_cb_t callback;
+    void *arg;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int64_t deadline_us; /* 0: not armed */
+};
+
+static void *timer_thread(void *arg)
+{
+    struct esp_timer *timer = arg;
+    pthread_mutex_lock(&timer->lock);
+    for (;;)
+    {
+        if (!timer->deadline_us)
+        {
+            pthread_cond_wait(&timer->cond, &timer->lock);
+            continue;
+        }
+        int64_t at = timer->deadline_us + s_start_us;
+        struct timespec ts = {.tv_sec = at / 1000000, .tv_nsec = at % 1000000 * 1000};
+        if (pthread_cond_timedwait(&timer->cond, &timer->lock, &ts) == ETIMEDOUT && timer->deadline_us &&
+            esp_timer_get_time() >= timer->deadline_us)
+        {
+            timer->deadline_us = 0;
+            pthread_mutex_unlock(&timer->lock);
+            timer->callback(timer->arg);
+            pthread_mutex_lock(&timer->lock);
+        }
+    }
+    return NULL;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle)
+{
+    struct esp_timer *timer = calloc(1, sizeof(struct esp_timer));
+    pthread_condattr_t attr;
+    pthread_t thread;
+    if (!timer)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    timer->callback = create_args->callback;
+    timer->arg = create_args->arg;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&timer->lock, NULL);
+    pthread_cond_init(&timer->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    if (pthread_create(&thread, NULL, timer_thread, timer) != 0)
+    {
+        free(timer);
+        return ESP_ERR_NO_MEM;
+    }
+    pthread_detach(thread);
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    esp_err_t err = ESP_OK;
+    pthread_mutex_lock(&timer->lock);
+    if (timer->deadline_us)
+    {
+        err = ESP_ERR_INVALID_STATE;
+    }
+    else
+    {
+        timer->deadline_us = esp_timer_get_time() + timeout_us;
+        pthread_cond_signal(&timer->cond);
+    }
+    pthread_mutex_unlock(&timer->lock);
+    return err;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    esp_err_t err = ESP_OK;
+    pthread_mutex_lock(&timer->lock);
+    if (!timer->deadline_us)
+    {
+        err = ESP_ERR_INVALID_STATE;
+    }
+    timer->deadline_us = 0;
+    pthread_cond_signal(&timer->cond);
+    pthread_mutex_unlock(&timer->lock);
+    return err;
+}
+
+void esp_chip_info(esp_chip_info_t *out_info)
+{
+    memset(out_info, 0, sizeof(*out_info));
+    out_info->model = CHIP_ESP32;
+    out_info->cores = 2;
+    out_info->revision = 1;
+}
+
+uint32_t esp_random(void)
+{
+    return (uint32_t)random();
+}
+
+void esp_restart(void)
+{
+    exit(0);
+}
+
+size_t strlcpy(char *dst, const char *src, size_t size)
+{
+    size_t len = strlen(src);
+    if (size)
+    {
+        size_t copy = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, copy);
+        dst[copy] = '\0';
+    }
+    return len;
+}
+
+size_t strlcat(char *dst, const char *src, size_t size)
+{
+    size_t len = strnlen(dst, size);
+    if (len == size)
+    {
+        return size + strlen(src);
+    }
+    return len + strlcpy(dst + len, src, size - len);
+}
+
+/* ---- Heap ----
+ * Linked with -Wl,--wrap for malloc, calloc, realloc, free and strdup */
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+void bench_heap_track(bench_heap_stats_t *stats)
+{
+    s_heap = stats;
+}
+
+static void heap_account(void *ptr, int64_t delta)
+{
+    bench_heap_stats_t *heap = s_heap;
+    if (!heap || (!ptr && delta > 0))
+    {
+        return;
+    }
+    int64_t in_use = __atomic_add_fetch(&heap->in_use, delta, __ATOMIC_RELAXED);
+    int64_t peak = __atomic_load_n(&heap->peak, __ATOMIC_RELAXED);
+    while (in_use > peak &&
+           !__atomic_compare_exchange_n(&heap->peak, &peak, in_use, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+    }
+    if (delta > 0)
+    {
+        __atomic_add_fetch(&heap->allocs, 1, __ATOMIC_RELAXED);
+    }
+}
+
+void *__wrap_malloc(size_t size)
+{
+    void *ptr = __real_malloc(size);
+    heap_account(ptr, ptr ? (int64_t)malloc_usable_size(ptr) : 0);
+    return ptr;
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    void *ptr = __real_calloc(n, size);
+    heap_account(ptr, ptr ? (int64_t)malloc_usable_size(ptr) : 0);
+    return ptr;
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    int64_t old_size = ptr ? (int64_t)malloc_usable_size(ptr) : 0;
+    void *new_ptr = __real_realloc(ptr, size);
+    if (new_ptr || !size)
+    {
+        heap_account(ptr, -old_size);
+        heap_account(new_ptr, new_ptr ? (int64_t)malloc_usable_size(new_ptr) : 0);
+    }
+    return new_ptr;
+}
+
+void __wrap_free(void *ptr)
+{
+    if (ptr)
+    {
+        heap_account(ptr, -(int64_t)malloc_usable_size(ptr));
+        __real_free(ptr);
+    }
+}
+
+char *__wrap_strdup(const char *s)
+{
+    size_t len = strlen(s) + 1;
+    char *copy = __wrap_malloc(len);
+    if (copy)
+    {
+        memcpy(copy, s, len);
+    }
+    return copy;
+}
+
+void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+    return malloc(size);
+}
+
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps)
+{
+    return calloc(n, size);
+}
+
+void *heap_caps_realloc(void *ptr, size_t size, uint32_t caps)
+{
+    return realloc(ptr, size);
+}
+
+void heap_caps_free(void *ptr)
+{
+    free(ptr);
+}
+
+static size_t heap_left(int64_t used)
+{
+    return used < BENCH_HEAP_SIZE ? (size_t)(BENCH_HEAP_SIZE - used) : 0;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps)
+{
+    return heap_left(s_heap ? __atomic_load_n(&s_heap->in_use, __ATOMIC_RELAXED) : 0);
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps)
+{
+    return heap_left(s_heap ? __atomic_load_n(&s_heap->peak, __ATOMIC_RELAXED) : 0);
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    return heap_caps_get_free_size(caps);
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    return heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+}
+
+uint32_t esp_get_minimum_free_heap_size(void)
+{
+    return heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT);
+}
+
+/* ---- NVS ---- */
+
+esp_err_t nvs_flash_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    pthread_mutex_lock(&s_nvs_lock);
+    while (s_nvs)
+    {
+        nvs_entry_t *next = s_nvs->next;
+        free(s_nvs->data);
+        free(s_nvs);
+        s_nvs = next;
+    }
+    pthread_mutex_unlock(&s_nvs_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    size_t count = sizeof(s_nvs_namespaces) / sizeof(s_nvs_namespaces[0]);
+    esp_err_t ret = ESP_ERR_NVS_NOT_FOUND;
+
+    pthread_mutex_lock(&s_nvs_lock);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!s_nvs_namespaces[i][0] && open_mode == NVS_READWRITE)
+        {
+            strlcpy(s_nvs_namespaces[i], name, sizeof(s_nvs_namespaces[i]));
+        }
+        if (!strcmp(s_nvs_namespaces[i], name))
+        {
+            *out_handle = i + 1;
+            ret = ESP_OK;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_nvs_lock);
+    return ret;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    return ESP_OK;
+}
+
+/* Called with s_nvs_lock held */
+static nvs_entry_t **nvs_find(nvs_handle_t handle, const char *key)
+{
+    const char *ns = s_nvs_namespaces[handle - 1];
+    nvs_entry_t **entry = &s_nvs;
+    while (*entry && (strcmp((*entry)->ns, ns) || strcmp((*entry)->key, key)))
+    {
+        entry = &(*entry)->next;
+    }
+    return entry;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    void *data = malloc(length ? length : 1);
+    if (!data)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(data, value, length);
+
+    pthread_mutex_lock(&s_nvs_lock);
+    nvs_entry_t **slot = nvs_find(handle, key);
+    nvs_entry_t *entry = *slot;
+    if (!entry && (entry = calloc(1, sizeof(nvs_entry_t))))
+    {
+        strlcpy(entry->ns, s_nvs_namespaces[handle - 1], sizeof(entry->ns));
+        strlcpy(entry->key, key, sizeof(entry->key));
+        *slot = entry;
+    }
+    if (entry)
+    {
+        free(entry->data);
+        entry->data = data;
+        entry->len = length;
+    }
+    pthread_mutex_unlock(&s_nvs_lock);
+    if (!entry)
+    {
+        free(data);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    esp_err_t ret = ESP_OK;
+
+    pthread_mutex_lock(&s_nvs_lock);
+    nvs_entry_t *entry = *nvs_find(handle, key);
+    if (!entry)
+    {
+        ret = ESP_ERR_NVS_NOT_FOUND;
+    }
+    else if (!out_value)
+    {
+        *length = entry->len;
+    }
+    else if (*length < entry->len)
+    {
+        ret = ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    else
+    {
+        memcpy(out_value, entry->data, entry->len);
+        *length = entry->len;
+    }
+    pthread_mutex_unlock(&s_nvs_lock);
+    return ret;
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value)
+{
+    return nvs_set_blob(handle, key, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out_value, size_t *length)
+{
+    return nvs_get_blob(handle, key, out_value, length);
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    pthread_mutex_lock(&s_nvs_lock);
+    nvs_entry_t **slot = nvs_find(handle, key);
+    nvs_entry_t *entry = *slot;
+    if (entry)
+    {
+        *slot = entry->next;
+        free(entry->data);
+        free(entry);
+    }
+    pthread_mutex_unlock(&s_nvs_lock);
+    return entry ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+/* ---- Event loop ---- */
+
+esp_err_t esp_event_loop_create_default(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t event_base, int32_t event_id,
+                                     esp_event_handler_t event_handler, void *event_handler_arg)
+{
+    esp_err_t ret = ESP_ERR_NO_MEM;
+    pthread_mutex_lock(&s_event_lock);
+    for (int i = 0; i < BENCH_EVENT_HANDLERS_MAX; i++)
+    {
+        if (!s_event_handlers[i].handler)
+        {
+            s_event_handlers[i] = (event_handler_t){event_base, event_id, event_handler, event_handler_arg};
+            ret = ESP_OK;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_event_lock);
+    return ret;
+}
+
+esp_err_t esp_event_handler_unregister(esp_event_base_t event_base, int32_t event_id,
+                                       esp_event_handler_t event_handler)
+{
+    pthread_mutex_lock(&s_event_lock);
+    for (int i = 0; i < BENCH_EVENT_HANDLERS_MAX; i++)
+    {
+        event_handler_t *h = &s_event_handlers[i];
+        if (h->handler == event_handler && h->base == event_base && h->id == event_id)
+        {
+            memset(h, 0, sizeof(*h));
+        }
+    }
+    pthread_mutex_unlock(&s_event_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_instance_register(esp_event_base_t event_base, int32_t event_id,
+                                              esp_event_handler_t event_handler, void *event_handler_arg,
+                                              esp_event_handler_instance_t *instance)
+{
+    if (instance)
+    {
+        *instance = (esp_event_handler_instance_t)event_handler;
+    }
+    return esp_event_handler_register(event_base, event_id, event_handler, event_handler_arg);
+}
+
+esp_err_t esp_event_handler_instance_unregister(esp_event_base_t event_base, int32_t event_id,
+                                                esp_event_handler_instance_t instance)
+{
+    return esp_event_handler_unregister(event_base, event_id, (esp_event_handler_t)instance);
+}
+
+esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id, void *event_data,
+                         size_t event_data_size, TickType_t ticks_to_wait)
+{
+    event_handler_t handlers[BENCH_EVENT_HANDLERS_MAX];
+
+    pthread_mutex_lock(&s_event_lock);
+    memcpy(handlers, s_event_handlers, sizeof(handlers));
+    pthread_mutex_unlock(&s_event_lock);
+    for (int i = 0; i < BENCH_EVENT_HANDLERS_MAX; i++)
+    {
+        event_handler_t *h = &handlers[i];
+        if (h->handler && h->base == event_base && (h->id == ESP_EVENT_ANY_ID || h->id == event_id))
+        {
+            h->handler(h->arg, event_base, event_id, event_data);
+        }
+    }
+    return ESP_OK;
+}
+
+/* ---- Partitions ---- */
+
+/* The bench serves the website from a directory, it has no partition table */
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label)
+{
+    return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t *partition, size_t offset, size_t size,
+                             spi_flash_mmap_memory_t memory, const void **out_ptr,
+                             spi_flash_mmap_handle_t *out_handle)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+void spi_flash_munmap(spi_flash_mmap_handle_t handle)
+{
+}
+
+/* ---- Netif ---- */
+
+esp_err_t esp_netif_init(void)
+{
+    return ESP_OK;
+}
+
+esp_netif_t *esp_netif_create_default_wifi_ap(void)
+{
+    return calloc(1, sizeof(esp_netif_t));
+}
+
+esp_netif_t *esp_netif_create_default_wifi_sta(void)
+{
+    return calloc(1, sizeof(esp_netif_t));
+}
+
+void esp_netif_destroy(esp_netif_t *esp_netif)
+{
+    free(esp_netif);
+}
+
+esp_err_t esp_netif_dhcps_start(esp_netif_t *esp_netif)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_dhcps_stop(esp_netif_t *esp_netif)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_set_ip_info(esp_netif_t *esp_netif, const esp_netif_ip_info_t *ip_info)
+{
+    if (!esp_netif || !ip_info)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_netif->ip_info = *ip_info;
+    return ESP_OK;
+}
+
+/* ---- Links ---- */
+
+static bench_io_stats_t *s_io;
+
+void bench_io_track(bench_io_stats_t *stats)
+{
+    s_io = stats;
+}
+
+static void io_count(bench_link_t link)
+{
+    if (s_io)
+    {
+        __atomic_add_fetch(link == BENCH_LINK_NET ? &s_io->sends : &s_io->reads, 1, __ATOMIC_RELAXED);
+    }
+}
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    const char *env;
+    int64_t bytes_per_s; /* 0 unlimited, -1 not read from the environment yet */
+    int64_t free_at_us;
+} link_state_t;
+
+static link_state_t s_links[BENCH_LINK_MAX] = {
+    [BENCH_LINK_SD] = {PTHREAD_MUTEX_INITIALIZER, "BENCH_SD_KBPS", -1, 0},
+    [BENCH_LINK_NET] = {PTHREAD_MUTEX_INITIALIZER, "BENCH_NET_KBPS", -1, 0},
+};
+
+void bench_link_transfer(bench_link_t link, size_t bytes)
+{
+    link_state_t *state = &s_links[link];
+    io_count(link);
+    pthread_mutex_lock(&state->lock);
+    if (state->bytes_per_s < 0)
+    {
+        const char *env = getenv(state->env);
+        state->bytes_per_s = env ? atoll(env) * 1024 : 0;
+    }
+    if (!state->bytes_per_s || !bytes)
+    {
+        pthread_mutex_unlock(&state->lock);
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    int64_t start = state->free_at_us > now ? state->free_at_us : now;
+    int64_t done = start + (int64_t)bytes * 1000000 / state->bytes_per_s;
+    state->free_at_us = done;
+    pthread_mutex_unlock(&state->lock);
+    if (done > now)
+    {
+        usleep(done - now);
+    }
+}
+
+/* ---- Wi-Fi ---- */
+
+void bench_wifi_set_networks(unsigned count)
+{
+    s_scan_networks = count < BENCH_SCAN_NETWORKS_MAX ? count : BENCH_SCAN_NETWORKS_MAX;
+}
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_deinit(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode)
+{
+    s_wifi_mode = mode;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_mode(wifi_mode_t *mode)
+{
+    *mode = s_wifi_mode;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf)
+{
+    *(interface == WIFI_IF_STA ? &s_wifi_sta_config : &s_wifi_ap_config) = *conf;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t *conf)
+{
+    *conf = interface == WIFI_IF_STA ? s_wifi_sta_config : s_wifi_ap_config;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void)
+{
+    if (s_wifi_mode == WIFI_MODE_AP || s_wifi_mode == WIFI_MODE_APSTA)
+    {
+        esp_event_post(WIFI_EVENT, WIFI_EVENT_AP_START, NULL, 0, portMAX_DELAY);
+    }
+    if (s_wifi_mode == WIFI_MODE_STA || s_wifi_mode == WIFI_MODE_APSTA)
+    {
+        esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_START, NULL, 0, portMAX_DELAY);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_stop(void)
+{
+    return ESP_OK;
+}
+
+/* Associates with whatever the station config names and gets 192.168.1.2 right away */
+esp_err_t esp_wifi_connect(void)
+{
+    wifi_event_sta_connected_t connected = {.channel = 1, .authmode = WIFI_AUTH_WPA2_PSK};
+    size_t len = strnlen((const char *)s_wifi_sta_config.sta.ssid, sizeof(connected.ssid));
+    memcpy(connected.ssid, s_wifi_sta_config.sta.ssid, len);
+    connected.ssid_len = len;
+    esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, &connected, sizeof(connected), portMAX_DELAY);
+
+    ip_event_got_ip_t got_ip = {0};
+    IP4_ADDR(&got_ip.ip_info.ip, 192, 168, 1, 2);
+    esp_event_post(IP_EVENT, IP_EVENT_STA_GOT_IP, &got_ip, sizeof(got_ip), portMAX_DELAY);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_disconnect(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_start(const wifi_scan_config_t *config, bool block)
+{
+    s_scan_count++;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_get_ap_num(uint16_t *number)
+{
+    *number = s_scan_networks;
+    return ESP_OK;
+}
+
+/* Every fourth network repeats the SSID of the one before with another BSSID, one
+ * in ten is hidden; signal levels drift from scan to scan */
+esp_err_t esp_wifi_scan_get_ap_records(uint16_t *number, wifi_ap_record_t *ap_records)
+{
+    uint16_t count = *number < s_scan_networks ? *number : s_scan_networks;
+    for (uint16_t i = 0; i < count; i++)
+    {
+        wifi_ap_record_t *rec = &ap_records[i];
+        memset(rec, 0, sizeof(*rec));
+        if (i % 10 != 9)
+        {
+            snprintf((char *)rec->ssid, sizeof(rec->ssid), "bench-net-%02u", i % 4 == 3 ? i - 1 : i);
+        }
+        uint8_t bssid[6] = {0x24, 0x0a, 0xc4, 0x00, (uint8_t)(i >> 8), (uint8_t)i};
+        memcpy(rec->bssid, bssid, sizeof(rec->bssid));
+        rec->primary = 1 + i % 13;
+        rec->rssi = -40 - (int)((i * 7 + s_scan_count * 3) % 50);
+        rec->authmode = i % 5 ? WIFI_AUTH_WPA2_PSK : WIFI_AUTH_OPEN;
+        rec->pairwise_cipher = WIFI_CIPHER_TYPE_CCMP;
+        rec->group_cipher = WIFI_CIPHER_TYPE_CCMP;
+    }
+    *number = count;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info)
+{
+    memset(ap_info, 0, sizeof(*ap_info));
+    memcpy(ap_info->ssid, s_wifi_sta_config.sta.ssid, sizeof(s_wifi_sta_config.sta.ssid));
+    ap_info->primary = 1;
+    ap_info->rssi = -50;
+    ap_info->authmode = WIFI_AUTH_WPA2_PSK;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type)
+{
+    s_wifi_ps = type;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_ps(wifi_ps_type_t *type)
+{
+    *type = s_wifi_ps;
+    return ESP_OK;
+}
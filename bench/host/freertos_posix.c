@@ -0,0 +1,516 @@
+/* Host stand-in for the FreeRTOS primitives used by main/
+
+   Tasks are detached pthreads, semaphores, queues and event groups are a mutex
+   and a condition variable each. Priorities and stack sizes are accepted and
+   ignored, the host scheduler decides. Core affinity is applied on host CPUs once
+   the bench driver called bench_set_cores().
+*/
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include "freertos/event_groups.h"
+#include "esp_timer.h"
+#include "bench_host.h"
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} waitable_t;
+
+typedef struct
+{
+    waitable_t w;
+    UBaseType_t count;
+    UBaseType_t max;
+} semaphore_t;
+
+typedef struct
+{
+    waitable_t w;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    uint8_t *items;
+} queue_t;
+
+typedef struct
+{
+    waitable_t w;
+    EventBits_t bits;
+} event_group_t;
+
+typedef struct
+{
+    TaskFunction_t fn;
+    void *arg;
+} task_start_t;
+
+static pthread_mutex_t s_critical = PTHREAD_MUTEX_INITIALIZER;
+/* Host CPUs standing in for the cores, 0: affinity ignored */
+static unsigned s_cores;
+
+static void waitable_init(waitable_t *w)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+/* Called with w->lock held; false once the deadline passed */
+static bool waitable_wait(waitable_t *w, const struct timespec *deadline)
+{
+    if (!deadline)
+    {
+        pthread_cond_wait(&w->cond, &w->lock);
+        return true;
+    }
+    return pthread_cond_timedwait(&w->cond, &w->lock, deadline) != ETIMEDOUT;
+}
+
+static const struct timespec *deadline_from_ticks(TickType_t ticks, struct timespec *ts)
+{
+    if (ticks == portMAX_DELAY)
+    {
+        return NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    uint64_t ns = ts->tv_nsec + (uint64_t)ticks * portTICK_PERIOD_MS * 1000000ULL;
+    ts->tv_sec += ns / 1000000000ULL;
+    ts->tv_nsec = ns % 1000000000ULL;
+    return ts;
+}
+
+/* ---- Tasks ---- */
+
+static void *task_trampoline(void *arg)
+{
+    task_start_t start = *(task_start_t *)arg;
+    free(arg);
+    start.fn(start.arg);
+    return NULL;
+}
+
+void bench_set_cores(unsigned cores)
+{
+    cpu_set_t set;
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+
+    s_cores = cores;
+    if (!cores)
+    {
+        return;
+    }
+    CPU_ZERO(&set);
+    for (unsigned i = 0; i < cores; i++)
+    {
+        CPU_SET(i % online, &set);
+    }
+    sched_setaffinity(0, sizeof(set), &set);
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pvTaskCode, const char *pcName, uint32_t usStackDepth,
+                                   void *pvParameters, UBaseType_t uxPriority, TaskHandle_t *pvCreatedTask,
+                                   BaseType_t xCoreID)
+{
+    pthread_t thread;
+    task_start_t *start = malloc(sizeof(task_start_t));
+    if (!start)
+    {
+        return pdFAIL;
+    }
+    start->fn = pvTaskCode;
+    start->arg = pvParameters;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (s_cores && xCoreID != tskNO_AFFINITY)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(xCoreID % s_cores % sysconf(_SC_NPROCESSORS_ONLN), &set);
+        pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+    }
+    int err = pthread_create(&thread, &attr, task_trampoline, start);
+    pthread_attr_destroy(&attr);
+    if (err != 0)
+    {
+        free(start);
+        return pdFAIL;
+    }
+    pthread_setname_np(thread, pcName);
+    pthread_detach(thread);
+    if (pvCreatedTask)
+    {
+        *pvCreatedTask = (TaskHandle_t)thread;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t pvTaskCode, const char *pcName, uint32_t usStackDepth,
+                       void *pvParameters, UBaseType_t uxPriority, TaskHandle_t *pvCreatedTask)
+{
+    return xTaskCreatePinnedToCore(pvTaskCode, pcName, usStackDepth, pvParameters, uxPriority, pvCreatedTask,
+                                   tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete)
+{
+    /* Only self-deletion is used in main/ */
+    if (!xTaskToDelete || xTaskToDelete == xTaskGetCurrentTaskHandle())
+    {
+        pthread_exit(NULL);
+    }
+}
+
+void vTaskDelay(TickType_t xTicksToDelay)
+{
+    uint64_t ms = (uint64_t)xTicksToDelay * portTICK_PERIOD_MS;
+    struct timespec ts = {.tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000L};
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+    {
+    }
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return esp_timer_get_time() / 1000 / portTICK_PERIOD_MS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return (TaskHandle_t)pthread_self();
+}
+
+/* Notification values of the tasks that used one, all behind a single waitable */
+#define TASK_NOTIFY_MAX (16)
+
+static struct
+{
+    TaskHandle_t task;
+    uint32_t value;
+} s_notify[TASK_NOTIFY_MAX];
+static waitable_t s_notify_w;
+static pthread_once_t s_notify_once = PTHREAD_ONCE_INIT;
+
+static void notify_init(void)
+{
+    waitable_init(&s_notify_w);
+}
+
+/* Called with s_notify_w.lock held */
+static uint32_t *notify_value(TaskHandle_t task)
+{
+    for (int i = 0; i < TASK_NOTIFY_MAX; i++)
+    {
+        if (s_notify[i].task == task)
+        {
+            return &s_notify[i].value;
+        }
+    }
+    for (int i = 0; i < TASK_NOTIFY_MAX; i++)
+    {
+        if (!s_notify[i].task)
+        {
+            s_notify[i].task = task;
+            return &s_notify[i].value;
+        }
+    }
+    abort();
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify)
+{
+    pthread_once(&s_notify_once, notify_init);
+    pthread_mutex_lock(&s_notify_w.lock);
+    (*notify_value(xTaskToNotify))++;
+    pthread_cond_broadcast(&s_notify_w.cond);
+    pthread_mutex_unlock(&s_notify_w.lock);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait)
+{
+    struct timespec ts;
+    const struct timespec *deadline = deadline_from_ticks(xTicksToWait, &ts);
+    pthread_once(&s_notify_once, notify_init);
+    pthread_mutex_lock(&s_notify_w.lock);
+    uint32_t *value = notify_value(xTaskGetCurrentTaskHandle());
+    while (!*value && waitable_wait(&s_notify_w, deadline))
+    {
+    }
+    uint32_t taken = *value;
+    if (taken)
+    {
+        *value = xClearCountOnExit ? 0 : taken - 1;
+    }
+    pthread_mutex_unlock(&s_notify_w.lock);
+    return taken;
+}
+
+BaseType_t xPortGetCoreID(void)
+{
+    int cpu = sched_getcpu();
+    return cpu > 0 ? cpu % portNUM_PROCESSORS : 0;
+}
+
+void vPortEnterCritical(portMUX_TYPE *mux)
+{
+    pthread_mutex_lock(&s_critical);
+}
+
+void vPortExitCritical(portMUX_TYPE *mux)
+{
+    pthread_mutex_unlock(&s_critical);
+}
+
+/* ---- Semaphores ---- */
+
+static SemaphoreHandle_t semaphore_create(UBaseType_t max, UBaseType_t initial)
+{
+    semaphore_t *sem = calloc(1, sizeof(semaphore_t));
+    if (sem)
+    {
+        waitable_init(&sem->w);
+        sem->count = initial;
+        sem->max = max;
+    }
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return semaphore_create(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return semaphore_create(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t uxMaxCount, UBaseType_t uxInitialCount)
+{
+    return semaphore_create(uxMaxCount, uxInitialCount);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xBlockTime)
+{
+    semaphore_t *sem = xSemaphore;
+    struct timespec ts;
+    const struct timespec *deadline = deadline_from_ticks(xBlockTime, &ts);
+    BaseType_t ret = pdTRUE;
+
+    pthread_mutex_lock(&sem->w.lock);
+    while (!sem->count)
+    {
+        if (!xBlockTime || !waitable_wait(&sem->w, deadline))
+        {
+            ret = pdFALSE;
+            break;
+        }
+    }
+    if (ret)
+    {
+        sem->count--;
+    }
+    pthread_mutex_unlock(&sem->w.lock);
+    return ret;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t xSemaphore)
+{
+    semaphore_t *sem = xSemaphore;
+    BaseType_t ret = pdFALSE;
+
+    pthread_mutex_lock(&sem->w.lock);
+    if (sem->count < sem->max)
+    {
+        sem->count++;
+        pthread_cond_broadcast(&sem->w.cond);
+        ret = pdTRUE;
+    }
+    pthread_mutex_unlock(&sem->w.lock);
+    return ret;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t xSemaphore)
+{
+    free(xSemaphore);
+}
+
+/* ---- Queues ---- */
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize)
+{
+    queue_t *queue = calloc(1, sizeof(queue_t));
+    if (!queue || !(queue->items = malloc(uxQueueLength * uxItemSize)))
+    {
+        free(queue);
+        return NULL;
+    }
+    waitable_init(&queue->w);
+    queue->length = uxQueueLength;
+    queue->item_size = uxItemSize;
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait)
+{
+    queue_t *queue = xQueue;
+    struct timespec ts;
+    const struct timespec *deadline = deadline_from_ticks(xTicksToWait, &ts);
+    BaseType_t ret = pdTRUE;
+
+    pthread_mutex_lock(&queue->w.lock);
+    while (queue->count == queue->length)
+    {
+        if (!xTicksToWait || !waitable_wait(&queue->w, deadline))
+        {
+            ret = pdFALSE;
+            break;
+        }
+    }
+    if (ret)
+    {
+        UBaseType_t tail = (queue->head + queue->count) % queue->length;
+        memcpy(queue->items + tail * queue->item_size, pvItemToQueue, queue->item_size);
+        queue->count++;
+        pthread_cond_broadcast(&queue->w.cond);
+    }
+    pthread_mutex_unlock(&queue->w.lock);
+    return ret;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void *pvBuffer, TickType_t xTicksToWait)
+{
+    queue_t *queue = xQueue;
+    struct timespec ts;
+    const struct timespec *deadline = deadline_from_ticks(xTicksToWait, &ts);
+    BaseType_t ret = pdTRUE;
+
+    pthread_mutex_lock(&queue->w.lock);
+    while (!queue->count)
+    {
+        if (!xTicksToWait || !waitable_wait(&queue->w, deadline))
+        {
+            ret = pdFALSE;
+            break;
+        }
+    }
+    if (ret)
+    {
+        memcpy(pvBuffer, queue->items + queue->head * queue->item_size, queue->item_size);
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        pthread_cond_broadcast(&queue->w.cond);
+    }
+    pthread_mutex_unlock(&queue->w.lock);
+    return ret;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t xQueue)
+{
+    queue_t *queue = xQueue;
+    pthread_mutex_lock(&queue->w.lock);
+    UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->w.lock);
+    return count;
+}
+
+void vQueueDelete(QueueHandle_t xQueue)
+{
+    queue_t *queue = xQueue;
+    if (queue)
+    {
+        free(queue->items);
+        free(queue);
+    }
+}
+
+/* ---- Event groups ---- */
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    event_group_t *group = calloc(1, sizeof(event_group_t));
+    if (group)
+    {
+        waitable_init(&group->w);
+    }
+    return group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t xEventGroup, EventBits_t uxBitsToSet)
+{
+    event_group_t *group = xEventGroup;
+    pthread_mutex_lock(&group->w.lock);
+    group->bits |= uxBitsToSet;
+    EventBits_t bits = group->bits;
+    pthread_cond_broadcast(&group->w.cond);
+    pthread_mutex_unlock(&group->w.lock);
+    return bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t xEventGroup, EventBits_t uxBitsToClear)
+{
+    event_group_t *group = xEventGroup;
+    pthread_mutex_lock(&group->w.lock);
+    EventBits_t bits = group->bits;
+    group->bits &= ~uxBitsToClear;
+    pthread_mutex_unlock(&group->w.lock);
+    return bits;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t xEventGroup)
+{
+    event_group_t *group = xEventGroup;
+    pthread_mutex_lock(&group->w.lock);
+    EventBits_t bits = group->bits;
+    pthread_mutex_unlock(&group->w.lock);
+    return bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t xEventGroup, EventBits_t uxBitsToWaitFor,
+                                BaseType_t xClearOnExit, BaseType_t xWaitForAllBits, TickType_t xTicksToWait)
+{
+    event_group_t *group = xEventGroup;
+    struct timespec ts;
+    const struct timespec *deadline = deadline_from_ticks(xTicksToWait, &ts);
+
+    bool met = false;
+
+    pthread_mutex_lock(&group->w.lock);
+    for (;;)
+    {
+        EventBits_t set = group->bits & uxBitsToWaitFor;
+        if (xWaitForAllBits ? set == uxBitsToWaitFor : set != 0)
+        {
+            met = true;
+            break;
+        }
+        if (!xTicksToWait || !waitable_wait(&group->w, deadline))
+        {
+            break;
+        }
+    }
+    EventBits_t bits = group->bits;
+    if (met && xClearOnExit)
+    {
+        group->bits &= ~uxBitsToWaitFor;
+    }
+    pthread_mutex_unlock(&group->w.lock);
+    return bits;
+}
+
+void vEventGroupDelete(EventGroupHandle_t xEventGroup)
+{
+    free(xEventGroup);
+}
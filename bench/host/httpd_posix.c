@@ -0,0 +1,1187 @@
+/* Host stand-in for esp_http_server
+
+   One server task accepts connections, parses requests and runs the URI handlers
+   and queued work one at a time, like the ESP-IDF 4.3 server task. Responses go
+   out with the same sequence of send calls as the IDF implementation (status
+   line, then every header field piece by piece), so send overrides and per-send
+   costs see what they would see on the device. Like lwIP under esp_http_server,
+   Nagle stays on, so small trailing segments wait for the client's delayed ACK;
+   BENCH_TCP_NODELAY=1 turns it off. Sends occupy the simulated Wi-Fi link
+   (BENCH_NET_KBPS). BENCH_HTTPD_PORT overrides the configured port.
+*/
+#include <errno.h>
+#include <stdarg.h>
+#include <strings.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_http_server.h"
+#include "bench_host.h"
+
+#define HTTPD_SCRATCH_BUF (CONFIG_HTTPD_MAX_REQ_HDR_LEN)
+
+static const char *TAG = "httpd";
+
+struct sock_db
+{
+    int fd;
+    void *ctx;
+    httpd_free_ctx_fn_t free_ctx;
+    bool ignore_sess_ctx_changes;
+    httpd_send_func_t send_fn;
+    httpd_recv_func_t recv_fn;
+    char rx[HTTPD_SCRATCH_BUF]; /* bytes received after the current request head */
+    size_t rx_len;
+};
+
+struct resp_hdr
+{
+    const char *field;
+    const char *value;
+};
+
+struct httpd_req_aux
+{
+    struct sock_db *sd;
+    char scratch[HTTPD_SCRATCH_BUF + 1]; /* request head, reused for the response head */
+    size_t remaining_len;                /* request body bytes not read yet */
+    const char *hdrs;                    /* request header lines inside scratch */
+    bool hdrs_valid;
+    const char *status;
+    const char *content_type;
+    bool first_chunk_sent;
+    unsigned resp_hdrs_count;
+    struct resp_hdr *resp_hdrs;
+};
+
+struct httpd_work
+{
+    httpd_work_fn_t fn;
+    void *arg;
+    int close_fd; /* >= 0: close that session instead of calling fn */
+    struct httpd_work *next;
+};
+
+struct httpd_data
+{
+    httpd_config_t config;
+    int listen_fd;
+    bool nodelay;
+    int ctrl_fds[2];
+    httpd_uri_t *handlers;
+    unsigned handler_count;
+    struct sock_db **sessions;
+    pthread_mutex_t sess_lock; /* session table, for httpd_socket_send() from other tasks */
+    pthread_mutex_t work_lock;
+    struct httpd_work *work_head;
+    struct httpd_work *work_tail;
+    httpd_req_t req;
+    struct httpd_req_aux aux;
+    volatile bool stop;
+    SemaphoreHandle_t stopped;
+};
+
+const char *http_method_str(enum http_method m)
+{
+    switch (m)
+    {
+    case HTTP_DELETE:
+        return "DELETE";
+    case HTTP_GET:
+        return "GET";
+    case HTTP_HEAD:
+        return "HEAD";
+    case HTTP_POST:
+        return "POST";
+    case HTTP_PUT:
+        return "PUT";
+    case HTTP_OPTIONS:
+        return "OPTIONS";
+    }
+    return "<unknown>";
+}
+
+static int httpd_method_parse(const char *method, size_t len)
+{
+    static const enum http_method methods[] = {HTTP_DELETE, HTTP_GET, HTTP_HEAD, HTTP_POST, HTTP_PUT, HTTP_OPTIONS};
+    for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); i++)
+    {
+        const char *name = http_method_str(methods[i]);
+        if (strlen(name) == len && !memcmp(name, method, len))
+        {
+            return methods[i];
+        }
+    }
+    return -1;
+}
+
+ssize_t bench_net_send(int fd, const void *buf, size_t len, int flags)
+{
+    ssize_t ret = send(fd, buf, len, flags | MSG_NOSIGNAL);
+    if (ret > 0)
+    {
+        bench_link_transfer(BENCH_LINK_NET, ret);
+    }
+    return ret;
+}
+
+static int httpd_default_send(httpd_handle_t hd, int sockfd, const char *buf, size_t buf_len, int flags)
+{
+    int ret = bench_net_send(sockfd, buf, buf_len, flags);
+    if (ret < 0)
+    {
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+    }
+    return ret;
+}
+
+static int httpd_default_recv(httpd_handle_t hd, int sockfd, char *buf, size_t buf_len, int flags)
+{
+    int ret = recv(sockfd, buf, buf_len, flags);
+    if (ret < 0)
+    {
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+    }
+    return ret;
+}
+
+/* ---- Sessions ---- */
+
+static struct sock_db *httpd_sess_get(struct httpd_data *hd, int sockfd)
+{
+    for (unsigned i = 0; i < hd->config.max_open_sockets; i++)
+    {
+        if (hd->sessions[i] && hd->sessions[i]->fd == sockfd)
+        {
+            return hd->sessions[i];
+        }
+    }
+    return NULL;
+}
+
+static unsigned httpd_sess_count(struct httpd_data *hd)
+{
+    unsigned count = 0;
+    for (unsigned i = 0; i < hd->config.max_open_sockets; i++)
+    {
+        count += hd->sessions[i] != NULL;
+    }
+    return count;
+}
+
+static void httpd_sess_free_ctx(void **ctx, httpd_free_ctx_fn_t free_fn)
+{
+    if (*ctx)
+    {
+        if (free_fn)
+        {
+            free_fn(*ctx);
+        }
+        else
+        {
+            free(*ctx);
+        }
+        *ctx = NULL;
+    }
+}
+
+static void httpd_sess_delete(struct httpd_data *hd, struct sock_db *sd)
+{
+    pthread_mutex_lock(&hd->sess_lock);
+    for (unsigned i = 0; i < hd->config.max_open_sockets; i++)
+    {
+        if (hd->sessions[i] == sd)
+        {
+            hd->sessions[i] = NULL;
+        }
+    }
+    pthread_mutex_unlock(&hd->sess_lock);
+
+    httpd_sess_free_ctx(&sd->ctx, sd->free_ctx);
+    if (hd->config.close_fn)
+    {
+        hd->config.close_fn(hd, sd->fd); /* closes the socket itself, as in IDF */
+    }
+    else
+    {
+        close(sd->fd);
+    }
+    free(sd);
+}
+
+static void httpd_accept_conn(struct httpd_data *hd)
+{
+    int fd = accept(hd->listen_fd, NULL, NULL);
+    if (fd < 0)
+    {
+        ESP_LOGW(TAG, "accept failed: %s", strerror(errno));
+        return;
+    }
+    struct timeval tv = {.tv_sec = hd->config.recv_wait_timeout};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    tv.tv_sec = hd->config.send_wait_timeout;
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    if (hd->nodelay)
+    {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+
+    struct sock_db *sd = calloc(1, sizeof(struct sock_db));
+    if (!sd)
+    {
+        close(fd);
+        return;
+    }
+    sd->fd = fd;
+    sd->send_fn = httpd_default_send;
+    sd->recv_fn = httpd_default_recv;
+
+    pthread_mutex_lock(&hd->sess_lock);
+    for (unsigned i = 0; i < hd->config.max_open_sockets; i++)
+    {
+        if (!hd->sessions[i])
+        {
+            hd->sessions[i] = sd;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&hd->sess_lock);
+
+    if (hd->config.open_fn && hd->config.open_fn(hd, fd) != ESP_OK)
+    {
+        httpd_sess_delete(hd, sd);
+    }
+}
+
+/* ---- Request parsing ---- */
+
+static const char *httpd_find_hdr(httpd_req_t *r, const char *field, size_t *val_len)
+{
+    struct httpd_req_aux *ra = r->aux;
+    size_t field_len = strlen(field);
+
+    if (!ra->hdrs_valid)
+    {
+        return NULL;
+    }
+    for (const char *line = ra->hdrs; *line && *line != '\r';)
+    {
+        const char *end = strstr(line, "\r\n");
+        if (!end)
+        {
+            break;
+        }
+        if (!strncasecmp(line, field, field_len) && line[field_len] == ':')
+        {
+            const char *val = line + field_len + 1;
+            while (val < end && (*val == ' ' || *val == '\t'))
+            {
+                val++;
+            }
+            const char *val_end = end;
+            while (val_end > val && (val_end[-1] == ' ' || val_end[-1] == '\t'))
+            {
+                val_end--;
+            }
+            *val_len = val_end - val;
+            return val;
+        }
+        line = end + 2;
+    }
+    return NULL;
+}
+
+static void httpd_req_init(struct httpd_data *hd, struct sock_db *sd)
+{
+    httpd_req_t *r = &hd->req;
+    struct httpd_req_aux *ra = &hd->aux;
+
+    memset(r, 0, sizeof(*r));
+    ra->remaining_len = 0;
+    ra->hdrs = NULL;
+    ra->hdrs_valid = false;
+    ra->status = HTTPD_200;
+    ra->content_type = HTTPD_TYPE_TEXT;
+    ra->first_chunk_sent = false;
+    ra->resp_hdrs_count = 0;
+    ra->sd = sd;
+    r->handle = hd;
+    r->aux = ra;
+    r->sess_ctx = sd->ctx;
+    r->free_ctx = sd->free_ctx;
+    r->ignore_sess_ctx_changes = sd->ignore_sess_ctx_changes;
+}
+
+static esp_err_t httpd_req_handle_err(httpd_req_t *r, httpd_err_code_t error)
+{
+    httpd_resp_send_err(r, error, NULL);
+    return ESP_FAIL;
+}
+
+/* Read until the request head is complete, parse the request line and headers */
+static esp_err_t httpd_parse_req(struct httpd_data *hd)
+{
+    httpd_req_t *r = &hd->req;
+    struct httpd_req_aux *ra = r->aux;
+    struct sock_db *sd = ra->sd;
+    char *head_end;
+
+    while (!(head_end = sd->rx_len ? memmem(sd->rx, sd->rx_len, "\r\n\r\n", 4) : NULL))
+    {
+        if (sd->rx_len >= sizeof(sd->rx))
+        {
+            return httpd_req_handle_err(r, HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE);
+        }
+        int ret = sd->recv_fn(hd, sd->fd, sd->rx + sd->rx_len, sizeof(sd->rx) - sd->rx_len, 0);
+        if (ret <= 0)
+        {
+            return ESP_FAIL; /* closed or timed out between requests */
+        }
+        sd->rx_len += ret;
+    }
+
+    size_t head_len = head_end + 4 - sd->rx;
+    memcpy(ra->scratch, sd->rx, head_len);
+    ra->scratch[head_len] = '\0';
+    sd->rx_len -= head_len;
+    memmove(sd->rx, sd->rx + head_len, sd->rx_len);
+
+    /* Request line */
+    char *method_end = strchr(ra->scratch, ' ');
+    char *uri = method_end ? method_end + 1 : NULL;
+    char *uri_end = uri ? strchr(uri, ' ') : NULL;
+    char *line_end = strstr(ra->scratch, "\r\n");
+    if (!uri_end || uri_end > line_end)
+    {
+        return httpd_req_handle_err(r, HTTPD_400_BAD_REQUEST);
+    }
+    if (strncmp(uri_end + 1, "HTTP/1.1", line_end - uri_end - 1))
+    {
+        return httpd_req_handle_err(r, HTTPD_505_VERSION_NOT_SUPPORTED);
+    }
+    r->method = httpd_method_parse(ra->scratch, method_end - ra->scratch);
+    if (r->method < 0)
+    {
+        return httpd_req_handle_err(r, HTTPD_501_METHOD_NOT_IMPLEMENTED);
+    }
+    if ((size_t)(uri_end - uri) > CONFIG_HTTPD_MAX_URI_LEN)
+    {
+        return httpd_req_handle_err(r, HTTPD_414_URI_TOO_LONG);
+    }
+    memcpy((char *)r->uri, uri, uri_end - uri);
+    ((char *)r->uri)[uri_end - uri] = '\0';
+    ra->hdrs = line_end + 2;
+    ra->hdrs_valid = true;
+
+    size_t len;
+    const char *content_len = httpd_find_hdr(r, "Content-Length", &len);
+    if (content_len)
+    {
+        r->content_len = strtoul(content_len, NULL, 10);
+    }
+    ra->remaining_len = r->content_len;
+    return ESP_OK;
+}
+
+bool httpd_uri_match_wildcard(const char *template, const char *uri, size_t len)
+{
+    const size_t tpl_len = strlen(template);
+    size_t exact_match_chars = tpl_len;
+
+    /* Trailing '*' matches anything, trailing '?' makes the character before it optional */
+    const char last = (const char)(tpl_len > 0 ? template[tpl_len - 1] : 0);
+    const char prevlast = (const char)(tpl_len > 1 ? template[tpl_len - 2] : 0);
+    const bool asterisk = last == '*' || (prevlast == '*' && last == '?');
+    const bool quest = last == '?' || (prevlast == '?' && last == '*');
+
+    if (exact_match_chars < asterisk + quest * 2)
+    {
+        return false;
+    }
+    exact_match_chars -= asterisk + quest * 2;
+    if (len < exact_match_chars)
+    {
+        return false;
+    }
+    if (!quest)
+    {
+        if (!asterisk && len != exact_match_chars)
+        {
+            return false;
+        }
+        return strncmp(template, uri, exact_match_chars) == 0;
+    }
+    if (len > exact_match_chars && template[exact_match_chars] != uri[exact_match_chars])
+    {
+        return false;
+    }
+    if (strncmp(template, uri, exact_match_chars) != 0)
+    {
+        return false;
+    }
+    return asterisk || len <= exact_match_chars + 1;
+}
+
+static const httpd_uri_t *httpd_find_uri_handler(struct httpd_data *hd, const char *uri, size_t uri_len,
+                                                 int method, httpd_err_code_t *err)
+{
+    *err = HTTPD_404_NOT_FOUND;
+    for (unsigned i = 0; i < hd->handler_count; i++)
+    {
+        const httpd_uri_t *h = &hd->handlers[i];
+        bool match = hd->config.uri_match_fn ? hd->config.uri_match_fn(h->uri, uri, uri_len)
+                                             : strlen(h->uri) == uri_len && !strncmp(h->uri, uri, uri_len);
+        if (match)
+        {
+            if (h->method == method)
+            {
+                return h;
+            }
+            *err = HTTPD_405_METHOD_NOT_ALLOWED;
+        }
+    }
+    return NULL;
+}
+
+/* Drop the part of the body the handler didn't read so the next request parses */
+static void httpd_req_cleanup(struct httpd_data *hd)
+{
+    httpd_req_t *r = &hd->req;
+    struct httpd_req_aux *ra = r->aux;
+    struct sock_db *sd = ra->sd;
+    char dummy[HTTPD_SCRATCH_BUF];
+
+    while (ra->remaining_len)
+    {
+        if (httpd_req_recv(r, dummy, sizeof(dummy)) <= 0)
+        {
+            break;
+        }
+    }
+    if (!r->ignore_sess_ctx_changes && sd->ctx != r->sess_ctx)
+    {
+        httpd_sess_free_ctx(&sd->ctx, sd->free_ctx);
+    }
+    sd->ctx = r->sess_ctx;
+    sd->free_ctx = r->free_ctx;
+    sd->ignore_sess_ctx_changes = r->ignore_sess_ctx_changes;
+}
+
+static esp_err_t httpd_sess_process(struct httpd_data *hd, struct sock_db *sd)
+{
+    httpd_req_init(hd, sd);
+    esp_err_t ret = httpd_parse_req(hd);
+    if (ret == ESP_OK)
+    {
+        httpd_req_t *r = &hd->req;
+        httpd_err_code_t err;
+        const httpd_uri_t *h = httpd_find_uri_handler(hd, r->uri, strcspn(r->uri, "?"), r->method, &err);
+        if (!h)
+        {
+            ret = httpd_req_handle_err(r, err);
+        }
+        else
+        {
+            r->user_ctx = h->user_ctx;
+            ret = h->handler(r);
+            if (ret != ESP_OK)
+            {
+                ESP_LOGW(TAG, "uri handler execution failed");
+            }
+        }
+        httpd_req_cleanup(hd);
+    }
+    hd->aux.sd = NULL;
+    return ret;
+}
+
+/* ---- Server task ---- */
+
+static void httpd_process_ctrl_msg(struct httpd_data *hd)
+{
+    char drain[64];
+    while (read(hd->ctrl_fds[0], drain, sizeof(drain)) == sizeof(drain))
+    {
+    }
+
+    pthread_mutex_lock(&hd->work_lock);
+    struct httpd_work *work = hd->work_head;
+    hd->work_head = hd->work_tail = NULL;
+    pthread_mutex_unlock(&hd->work_lock);
+
+    while (work)
+    {
+        struct httpd_work *next = work->next;
+        if (work->close_fd >= 0)
+        {
+            struct sock_db *sd = httpd_sess_get(hd, work->close_fd);
+            if (sd)
+            {
+                httpd_sess_delete(hd, sd);
+            }
+        }
+        else
+        {
+            work->fn(work->arg);
+        }
+        free(work);
+        work = next;
+    }
+}
+
+static void httpd_thread(void *arg)
+{
+    struct httpd_data *hd = arg;
+
+    while (!hd->stop)
+    {
+        fd_set fds;
+        int maxfd = hd->ctrl_fds[0];
+        FD_ZERO(&fds);
+        FD_SET(hd->ctrl_fds[0], &fds);
+        if (httpd_sess_count(hd) < hd->config.max_open_sockets)
+        {
+            FD_SET(hd->listen_fd, &fds);
+            maxfd = hd->listen_fd > maxfd ? hd->listen_fd : maxfd;
+        }
+        for (unsigned i = 0; i < hd->config.max_open_sockets; i++)
+        {
+            if (hd->sessions[i])
+            {
+                FD_SET(hd->sessions[i]->fd, &fds);
+                maxfd = hd->sessions[i]->fd > maxfd ? hd->sessions[i]->fd : maxfd;
+            }
+        }
+        if (select(maxfd + 1, &fds, NULL, NULL, NULL) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            ESP_LOGE(TAG, "select failed: %s", strerror(errno));
+            break;
+        }
+        if (FD_ISSET(hd->ctrl_fds[0], &fds))
+        {
+            httpd_process_ctrl_msg(hd);
+        }
+        for (unsigned i = 0; i < hd->config.max_open_sockets; i++)
+        {
+            struct sock_db *sd = hd->sessions[i];
+            if (sd && FD_ISSET(sd->fd, &fds))
+            {
+                /* A pipelined request may already sit in the buffer */
+                do
+                {
+                    if (httpd_sess_process(hd, sd) != ESP_OK)
+                    {
+                        httpd_sess_delete(hd, sd);
+                        break;
+                    }
+                } while (sd->rx_len && memmem(sd->rx, sd->rx_len, "\r\n\r\n", 4));
+            }
+        }
+        if (FD_ISSET(hd->listen_fd, &fds))
+        {
+            httpd_accept_conn(hd);
+        }
+    }
+
+    for (unsigned i = 0; i < hd->config.max_open_sockets; i++)
+    {
+        if (hd->sessions[i])
+        {
+            httpd_sess_delete(hd, hd->sessions[i]);
+        }
+    }
+    xSemaphoreGive(hd->stopped);
+    vTaskDelete(NULL);
+}
+
+static esp_err_t httpd_post_work(struct httpd_data *hd, httpd_work_fn_t fn, void *arg, int close_fd)
+{
+    struct httpd_work *work = calloc(1, sizeof(struct httpd_work));
+    if (!work)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    work->fn = fn;
+    work->arg = arg;
+    work->close_fd = close_fd;
+
+    pthread_mutex_lock(&hd->work_lock);
+    if (hd->work_tail)
+    {
+        hd->work_tail->next = work;
+    }
+    else
+    {
+        hd->work_head = work;
+    }
+    hd->work_tail = work;
+    pthread_mutex_unlock(&hd->work_lock);
+
+    char msg = 0;
+    return write(hd->ctrl_fds[1], &msg, 1) == 1 ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *arg)
+{
+    if (!handle || !work)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return httpd_post_work(handle, work, arg, -1);
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd)
+{
+    if (!handle)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return httpd_post_work(handle, NULL, NULL, sockfd);
+}
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config)
+{
+    if (!handle || !config)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct httpd_data *hd = calloc(1, sizeof(struct httpd_data));
+    if (!hd)
+    {
+        return ESP_ERR_HTTPD_ALLOC_MEM;
+    }
+    hd->config = *config;
+    const char *port = getenv("BENCH_HTTPD_PORT");
+    if (port)
+    {
+        hd->config.server_port = atoi(port);
+    }
+    const char *nodelay = getenv("BENCH_TCP_NODELAY");
+    hd->nodelay = nodelay && atoi(nodelay);
+    hd->handlers = calloc(config->max_uri_handlers, sizeof(httpd_uri_t));
+    hd->sessions = calloc(config->max_open_sockets, sizeof(struct sock_db *));
+    hd->aux.resp_hdrs = calloc(config->max_resp_headers, sizeof(struct resp_hdr));
+    hd->stopped = xSemaphoreCreateBinary();
+    pthread_mutex_init(&hd->sess_lock, NULL);
+    pthread_mutex_init(&hd->work_lock, NULL);
+    if (!hd->handlers || !hd->sessions || !hd->aux.resp_hdrs || pipe(hd->ctrl_fds) != 0)
+    {
+        goto err;
+    }
+
+    hd->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int enable = 1;
+    setsockopt(hd->listen_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(hd->config.server_port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    if (hd->listen_fd < 0 || bind(hd->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(hd->listen_fd, hd->config.backlog_conn) != 0)
+    {
+        ESP_LOGE(TAG, "Failed to listen on port %u: %s", hd->config.server_port, strerror(errno));
+        goto err;
+    }
+    if (xTaskCreatePinnedToCore(httpd_thread, "httpd", hd->config.stack_size, hd, hd->config.task_priority,
+                                NULL, hd->config.core_id) != pdPASS)
+    {
+        goto err;
+    }
+    *handle = hd;
+    return ESP_OK;
+err:
+    if (hd->listen_fd > 0)
+    {
+        close(hd->listen_fd);
+    }
+    free(hd->handlers);
+    free(hd->sessions);
+    free(hd->aux.resp_hdrs);
+    free(hd);
+    return ESP_ERR_HTTPD_TASK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle)
+{
+    struct httpd_data *hd = handle;
+    if (!hd)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    hd->stop = true;
+    char msg = 0;
+    if (write(hd->ctrl_fds[1], &msg, 1) == 1)
+    {
+        xSemaphoreTake(hd->stopped, portMAX_DELAY);
+    }
+    close(hd->listen_fd);
+    close(hd->ctrl_fds[0]);
+    close(hd->ctrl_fds[1]);
+    vSemaphoreDelete(hd->stopped);
+    free(hd->handlers);
+    free(hd->sessions);
+    free(hd->aux.resp_hdrs);
+    free(hd);
+    return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler)
+{
+    struct httpd_data *hd = handle;
+    if (!hd || !uri_handler)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (unsigned i = 0; i < hd->handler_count; i++)
+    {
+        if (hd->handlers[i].method == uri_handler->method && !strcmp(hd->handlers[i].uri, uri_handler->uri))
+        {
+            return ESP_ERR_HTTPD_HANDLER_EXISTS;
+        }
+    }
+    if (hd->handler_count == hd->config.max_uri_handlers)
+    {
+        ESP_LOGW(TAG, "no slots left for registering handler");
+        return ESP_ERR_HTTPD_HANDLERS_FULL;
+    }
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    if (uri_handler->is_websocket)
+    {
+        ESP_LOGW(TAG, "no WebSocket support, %s not registered", uri_handler->uri);
+        return ESP_OK;
+    }
+#endif
+    hd->handlers[hd->handler_count++] = *uri_handler;
+    return ESP_OK;
+}
+
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *pkt, size_t max_len)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t httpd_ws_send_frame(httpd_req_t *req, httpd_ws_frame_t *pkt)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t httpd_ws_send_frame_async(httpd_handle_t hd, int fd, httpd_ws_frame_t *frame)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+httpd_ws_client_info_t httpd_ws_get_fd_info(httpd_handle_t hd, int fd)
+{
+    return HTTPD_WS_CLIENT_INVALID;
+}
+#endif
+
+/* ---- Requests ---- */
+
+int httpd_req_to_sockfd(httpd_req_t *r)
+{
+    return r && r->aux ? ((struct httpd_req_aux *)r->aux)->sd->fd : -1;
+}
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len)
+{
+    struct httpd_req_aux *ra = r->aux;
+    struct sock_db *sd = ra->sd;
+
+    if (buf_len > ra->remaining_len)
+    {
+        buf_len = ra->remaining_len;
+    }
+    if (!buf_len)
+    {
+        return 0;
+    }
+    int ret;
+    if (sd->rx_len)
+    {
+        ret = buf_len < sd->rx_len ? buf_len : sd->rx_len;
+        memcpy(buf, sd->rx, ret);
+        sd->rx_len -= ret;
+        memmove(sd->rx, sd->rx + ret, sd->rx_len);
+    }
+    else
+    {
+        ret = sd->recv_fn(r->handle, sd->fd, buf, buf_len, 0);
+        if (ret <= 0)
+        {
+            return ret;
+        }
+    }
+    ra->remaining_len -= ret;
+    return ret;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field)
+{
+    size_t len = 0;
+    return httpd_find_hdr(r, field, &len) ? len : 0;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size)
+{
+    size_t len;
+    const char *value = httpd_find_hdr(r, field, &len);
+    if (!value)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (!val_size)
+    {
+        return ESP_ERR_HTTPD_RESULT_TRUNC;
+    }
+    size_t copy = len < val_size - 1 ? len : val_size - 1;
+    memcpy(val, value, copy);
+    val[copy] = '\0';
+    return copy < len ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+size_t httpd_req_get_url_query_len(httpd_req_t *r)
+{
+    const char *query = strchr(r->uri, '?');
+    return query ? strlen(query + 1) : 0;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len)
+{
+    const char *query = strchr(r->uri, '?');
+    if (!query)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (!buf_len)
+    {
+        return ESP_ERR_HTTPD_RESULT_TRUNC;
+    }
+    return strlcpy(buf, query + 1, buf_len) < buf_len ? ESP_OK : ESP_ERR_HTTPD_RESULT_TRUNC;
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size)
+{
+    size_t key_len = strlen(key);
+    for (const char *p = qry; p && *p; p = strchr(p, '&') ? strchr(p, '&') + 1 : NULL)
+    {
+        if (!strncmp(p, key, key_len) && p[key_len] == '=')
+        {
+            const char *value = p + key_len + 1;
+            size_t len = strcspn(value, "&");
+            if (!val_size)
+            {
+                return ESP_ERR_HTTPD_RESULT_TRUNC;
+            }
+            size_t copy = len < val_size - 1 ? len : val_size - 1;
+            memcpy(val, value, copy);
+            val[copy] = '\0';
+            return copy < len ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+/* ---- Responses ---- */
+
+int httpd_send(httpd_req_t *r, const char *buf, size_t buf_len)
+{
+    if (!r || !r->aux || (!buf && buf_len))
+    {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+    struct sock_db *sd = ((struct httpd_req_aux *)r->aux)->sd;
+    return sd->send_fn(r->handle, sd->fd, buf, buf_len, 0);
+}
+
+static esp_err_t httpd_send_all(httpd_req_t *r, const char *buf, size_t buf_len)
+{
+    while (buf_len > 0)
+    {
+        int ret = httpd_send(r, buf, buf_len);
+        if (ret < 0)
+        {
+            return ESP_FAIL;
+        }
+        buf += ret;
+        buf_len -= ret;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t httpd_send_hdrs(httpd_req_t *r, const char *fmt, ...)
+{
+    struct httpd_req_aux *ra = r->aux;
+    va_list args;
+
+    /* The scratch buffer held the request, its headers are gone from here on */
+    ra->hdrs_valid = false;
+    va_start(args, fmt);
+    int len = vsnprintf(ra->scratch, sizeof(ra->scratch), fmt, args);
+    va_end(args);
+    if (len < 0 || (size_t)len >= sizeof(ra->scratch))
+    {
+        return ESP_ERR_HTTPD_RESP_HDR;
+    }
+    if (httpd_send_all(r, ra->scratch, len) != ESP_OK)
+    {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    for (unsigned i = 0; i < ra->resp_hdrs_count; i++)
+    {
+        if (httpd_send_all(r, ra->resp_hdrs[i].field, strlen(ra->resp_hdrs[i].field)) != ESP_OK ||
+            httpd_send_all(r, ": ", 2) != ESP_OK ||
+            httpd_send_all(r, ra->resp_hdrs[i].value, strlen(ra->resp_hdrs[i].value)) != ESP_OK ||
+            httpd_send_all(r, "\r\n", 2) != ESP_OK)
+        {
+            return ESP_ERR_HTTPD_RESP_SEND;
+        }
+    }
+    if (httpd_send_all(r, "\r\n", 2) != ESP_OK)
+    {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status)
+{
+    if (!r || !r->aux || !status)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    ((struct httpd_req_aux *)r->aux)->status = status;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type)
+{
+    if (!r || !r->aux || !type)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    ((struct httpd_req_aux *)r->aux)->content_type = type;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value)
+{
+    struct httpd_req_aux *ra = r ? r->aux : NULL;
+    if (!ra || !field || !value)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (ra->resp_hdrs_count >= ((struct httpd_data *)r->handle)->config.max_resp_headers)
+    {
+        return ESP_ERR_HTTPD_RESP_HDR;
+    }
+    ra->resp_hdrs[ra->resp_hdrs_count].field = field;
+    ra->resp_hdrs[ra->resp_hdrs_count].value = value;
+    ra->resp_hdrs_count++;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    struct httpd_req_aux *ra = r ? r->aux : NULL;
+    if (!ra)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    buf_len = buf_len == HTTPD_RESP_USE_STRLEN ? (buf ? (ssize_t)strlen(buf) : 0) : buf_len;
+    esp_err_t ret = httpd_send_hdrs(r, "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %d\r\n",
+                                    ra->status, ra->content_type, (int)buf_len);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    if (buf && buf_len && httpd_send_all(r, buf, buf_len) != ESP_OK)
+    {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    struct httpd_req_aux *ra = r ? r->aux : NULL;
+    if (!ra)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    buf_len = buf_len == HTTPD_RESP_USE_STRLEN ? (buf ? (ssize_t)strlen(buf) : 0) : buf_len;
+    if (!ra->first_chunk_sent)
+    {
+        esp_err_t ret = httpd_send_hdrs(r, "HTTP/1.1 %s\r\nContent-Type: %s\r\nTransfer-Encoding: chunked\r\n",
+                                        ra->status, ra->content_type);
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+        ra->first_chunk_sent = true;
+    }
+    char len_str[10];
+    snprintf(len_str, sizeof(len_str), "%x\r\n", (unsigned)buf_len);
+    if (httpd_send_all(r, len_str, strlen(len_str)) != ESP_OK ||
+        (buf && httpd_send_all(r, buf, buf_len) != ESP_OK) ||
+        httpd_send_all(r, "\r\n", 2) != ESP_OK)
+    {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *usr_msg)
+{
+    const char *status;
+    const char *msg;
+
+    switch (error)
+    {
+    case HTTPD_501_METHOD_NOT_IMPLEMENTED:
+        status = "501 Method Not Implemented";
+        msg = "Request method is not supported by server";
+        break;
+    case HTTPD_505_VERSION_NOT_SUPPORTED:
+        status = "505 Version Not Supported";
+        msg = "HTTP version not supported by server";
+        break;
+    case HTTPD_400_BAD_REQUEST:
+        status = "400 Bad Request";
+        msg = "Server unable to understand request due to invalid syntax";
+        break;
+    case HTTPD_401_UNAUTHORIZED:
+        status = "401 Unauthorized";
+        msg = "Server known request method but target resource requires authentication";
+        break;
+    case HTTPD_403_FORBIDDEN:
+        status = "403 Forbidden";
+        msg = "Server is refusing to respond to request";
+        break;
+    case HTTPD_404_NOT_FOUND:
+        status = "404 Not Found";
+        msg = "This URI does not exist";
+        break;
+    case HTTPD_405_METHOD_NOT_ALLOWED:
+        status = "405 Method Not Allowed";
+        msg = "Request method for this URI is not handled by server";
+        break;
+    case HTTPD_408_REQ_TIMEOUT:
+        status = "408 Request Timeout";
+        msg = "Server closed this connection";
+        break;
+    case HTTPD_411_LENGTH_REQUIRED:
+        status = "411 Length Required";
+        msg = "Chunked encoding not supported by server";
+        break;
+    case HTTPD_414_URI_TOO_LONG:
+        status = "414 URI Too Long";
+        msg = "URI is too long";
+        break;
+    case HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE:
+        status = "431 Request Header Fields Too Large";
+        msg = "Header fields are too long";
+        break;
+    case HTTPD_500_INTERNAL_SERVER_ERROR:
+    default:
+        status = "500 Internal Server Error";
+        msg = "Server has encountered an unexpected error";
+    }
+    msg = usr_msg ? usr_msg : msg;
+    httpd_resp_set_status(req, status);
+    httpd_resp_set_type(req, HTTPD_TYPE_TEXT);
+    return httpd_resp_send(req, msg, strlen(msg));
+}
+
+/* ---- Sockets of other sessions ---- */
+
+int httpd_socket_send(httpd_handle_t hd, int sockfd, const char *buf, size_t buf_len, int flags)
+{
+    struct httpd_data *data = hd;
+    pthread_mutex_lock(&data->sess_lock);
+    struct sock_db *sd = httpd_sess_get(data, sockfd);
+    httpd_send_func_t send_fn = sd ? sd->send_fn : NULL;
+    pthread_mutex_unlock(&data->sess_lock);
+    if (!send_fn)
+    {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+    return send_fn(hd, sockfd, buf, buf_len, flags);
+}
+
+int httpd_socket_recv(httpd_handle_t hd, int sockfd, char *buf, size_t buf_len, int flags)
+{
+    struct httpd_data *data = hd;
+    pthread_mutex_lock(&data->sess_lock);
+    struct sock_db *sd = httpd_sess_get(data, sockfd);
+    httpd_recv_func_t recv_fn = sd ? sd->recv_fn : NULL;
+    pthread_mutex_unlock(&data->sess_lock);
+    if (!recv_fn)
+    {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+    return recv_fn(hd, sockfd, buf, buf_len, flags);
+}
+
+esp_err_t httpd_sess_set_send_override(httpd_handle_t hd, int sockfd, httpd_send_func_t send_func)
+{
+    struct sock_db *sd = httpd_sess_get(hd, sockfd);
+    if (!sd)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    sd->send_fn = send_func;
+    return ESP_OK;
+}
+
+void *httpd_sess_get_ctx(httpd_handle_t handle, int sockfd)
+{
+    struct httpd_data *hd = handle;
+    struct sock_db *sd = httpd_sess_get(hd, sockfd);
+    if (!sd)
+    {
+        return NULL;
+    }
+    /* The handler running right now sees its own, possibly updated, copy */
+    if (hd->aux.sd == sd)
+    {
+        return hd->req.sess_ctx;
+    }
+    return sd->ctx;
+}
+
+void httpd_sess_set_ctx(httpd_handle_t handle, int sockfd, void *ctx, httpd_free_ctx_fn_t free_fn)
+{
+    struct httpd_data *hd = handle;
+    struct sock_db *sd = httpd_sess_get(hd, sockfd);
+    if (!sd)
+    {
+        return;
+    }
+    if (hd->aux.sd == sd)
+    {
+        hd->req.sess_ctx = ctx;
+        hd->req.free_ctx = free_fn;
+        return;
+    }
+    if (sd->ctx != ctx)
+    {
+        httpd_sess_free_ctx(&sd->ctx, sd->free_ctx);
+    }
+    sd->ctx = ctx;
+    sd->free_ctx = free_fn;
+}
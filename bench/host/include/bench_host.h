@@ -0,0 +1,53 @@
+// bench_host.h
+// Knobs of the host stand-ins that the bench driver sets up
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef struct
+{
+    int64_t in_use;  /* bytes currently allocated by the firmware code */
+    int64_t peak;    /* high-water mark of in_use, the driver resets it per scenario */
+    uint64_t allocs; /* allocation calls */
+} bench_heap_stats_t;
+
+/* Account every malloc/calloc/realloc/free of this process into stats from now on.
+ * stats may live in memory shared with the load generator process. */
+void bench_heap_track(bench_heap_stats_t *stats);
+
+typedef struct
+{
+    uint64_t sends; /* send() calls on server sockets */
+    uint64_t reads; /* read() calls on files below the web mount point */
+} bench_io_stats_t;
+
+/* Count the server's socket sends and file reads into stats from now on */
+void bench_io_track(bench_io_stats_t *stats);
+
+/* Paths below mount_point (CONFIG_EXAMPLE_WEB_MOUNT_POINT) resolve into dir */
+void bench_vfs_set_root(const char *mount_point, const char *dir);
+
+/* Confine this process to host CPUs 0..cores-1 and run the tasks created for core
+ * n on CPU n, standing in for the two ESP32 cores; unpinned tasks move between them.
+ * Cores beyond the CPUs of the host wrap around. 0 (the default) leaves affinity
+ * to the host scheduler. Priorities are never applied. */
+void bench_set_cores(unsigned cores);
+
+/* Networks reported by every Wi-Fi scan; some SSIDs show up with several BSSIDs */
+void bench_wifi_set_networks(unsigned count);
+
+typedef enum
+{
+    BENCH_LINK_SD,  /* file reads under the web mount point, rate from BENCH_SD_KBPS */
+    BENCH_LINK_NET, /* server socket sends, rate from BENCH_NET_KBPS */
+    BENCH_LINK_MAX,
+} bench_link_t;
+
+/* Occupy a shared link for bytes: transfers queue up behind each other and the
+ * caller sleeps until its bytes are through. Only counted for a link without a rate. */
+void bench_link_transfer(bench_link_t link, size_t bytes);
+
+/* send() of the firmware sockets: MSG_NOSIGNAL, then the bytes occupy BENCH_LINK_NET */
+ssize_t bench_net_send(int fd, const void *buf, size_t len, int flags);
@@ -0,0 +1,24 @@
+// bench_vfs.h
+// Force-included into the firmware sources: open(), fopen() and stat() of paths
+// under the web mount point go to the directory set with bench_vfs_set_root(),
+// read() of such files goes through the simulated SD bus and send() through the
+// simulated Wi-Fi link
+#pragma once
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+int bench_vfs_open(const char *path, int flags, ...);
+FILE *bench_vfs_fopen(const char *path, const char *mode);
+int bench_vfs_stat(const char *path, struct stat *st);
+ssize_t bench_vfs_read(int fd, void *buf, size_t len);
+ssize_t bench_net_send(int fd, const void *buf, size_t len, int flags);
+
+#define open(...) bench_vfs_open(__VA_ARGS__)
+#define fopen(path, mode) bench_vfs_fopen(path, mode)
+#define stat(path, st) bench_vfs_stat(path, st)
+#define read(fd, buf, len) bench_vfs_read(fd, buf, len)
+#define send(fd, buf, len, flags) bench_net_send(fd, buf, len, flags)
@@ -0,0 +1,27 @@
+// esp_system.h
+// Host stand-in for the ESP-IDF header, only what main/ uses
+#pragma once
+
+#include "esp_err.h"
+
+typedef enum
+{
+    CHIP_ESP32 = 1,
+} esp_chip_model_t;
+
+typedef struct
+{
+    esp_chip_model_t model;
+    uint32_t features;
+    uint8_t cores;
+    uint8_t revision;
+} esp_chip_info_t;
+
+#define MACSTR "%02x:%02x:%02x:%02x:%02x:%02x"
+#define MAC2STR(a) (a)[0], (a)[1], (a)[2], (a)[3], (a)[4], (a)[5]
+
+void esp_chip_info(esp_chip_info_t *out_info);
+uint32_t esp_random(void);
+void esp_restart(void);
+uint32_t esp_get_free_heap_size(void);
+uint32_t esp_get_minimum_free_heap_size(void);
@@ -0,0 +1,9 @@
+// esp_vfs.h
+// Host stand-in: the /www mount point is remapped by bench_vfs.h
+#pragma once
+
+#include <unistd.h>
+#include <fcntl.h>
+#include "esp_err.h"
+
+#define ESP_VFS_PATH_MAX (15)
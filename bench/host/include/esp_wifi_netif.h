@@ -0,0 +1,5 @@
+// esp_wifi_netif.h
+// Host stand-in, see esp_netif.h
+#pragma once
+
+#include "esp_netif.h"
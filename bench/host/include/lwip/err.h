@@ -0,0 +1,3 @@
+// err.h
+// Host stand-in for the lwIP header
+#pragma once
@@ -0,0 +1,3 @@
+// sys.h
+// Host stand-in for the lwIP header
+#pragma once
@@ -0,0 +1,8 @@
+// nvs_flash.h
+// Host stand-in: NVS lives in memory for the lifetime of the process
+#pragma once
+
+#include "esp_err.h"
+
+esp_err_t nvs_flash_init(void);
+esp_err_t nvs_flash_erase(void);
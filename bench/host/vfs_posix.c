@@ -0,0 +1,89 @@
+/* Host stand-in for the VFS mount of the web root
+
+   The firmware opens files as <mount point>/<site>/<file>; on the host the mount
+   point is a directory prepared by the bench driver. Reads of those files take
+   the time the SD bus would need (BENCH_SD_KBPS).
+*/
+#include <limits.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include "bench_host.h"
+#include "bench_vfs.h"
+
+#undef open
+#undef fopen
+#undef stat
+#undef read
+
+#define VFS_FDS_MAX (1024)
+
+static char s_mount_point[32];
+static char s_root[PATH_MAX];
+/* Descriptors opened below the mount point. The firmware reads sockets with recv(),
+   so a stale flag on a reused descriptor is cleared by the next open() of it. */
+static bool s_vfs_fds[VFS_FDS_MAX];
+
+void bench_vfs_set_root(const char *mount_point, const char *dir)
+{
+    snprintf(s_mount_point, sizeof(s_mount_point), "%s", mount_point);
+    snprintf(s_root, sizeof(s_root), "%s", dir);
+}
+
+static bool vfs_mounted(const char *path)
+{
+    size_t len = strlen(s_mount_point);
+    return len && !strncmp(path, s_mount_point, len) && (path[len] == '/' || path[len] == '\0');
+}
+
+static const char *vfs_path(const char *path, char *buf, size_t size)
+{
+    if (vfs_mounted(path))
+    {
+        snprintf(buf, size, "%s%s", s_root, path + strlen(s_mount_point));
+        return buf;
+    }
+    return path;
+}
+
+int bench_vfs_open(const char *path, int flags, ...)
+{
+    char buf[PATH_MAX];
+    mode_t mode = 0;
+    if (flags & O_CREAT)
+    {
+        va_list args;
+        va_start(args, flags);
+        mode = va_arg(args, int);
+        va_end(args);
+    }
+    int fd = open(vfs_path(path, buf, sizeof(buf)), flags, mode);
+    if (fd >= 0 && fd < VFS_FDS_MAX)
+    {
+        s_vfs_fds[fd] = vfs_mounted(path);
+    }
+    return fd;
+}
+
+FILE *bench_vfs_fopen(const char *path, const char *mode)
+{
+    char buf[PATH_MAX];
+    return fopen(vfs_path(path, buf, sizeof(buf)), mode);
+}
+
+int bench_vfs_stat(const char *path, struct stat *st)
+{
+    char buf[PATH_MAX];
+    return stat(vfs_path(path, buf, sizeof(buf)), st);
+}
+
+ssize_t bench_vfs_read(int fd, void *buf, size_t len)
+{
+    ssize_t ret = read(fd, buf, len);
+    if (ret > 0 && fd >= 0 && fd < VFS_FDS_MAX && s_vfs_fds[fd])
+    {
+        bench_link_transfer(BENCH_LINK_SD, ret);
+    }
+    return ret;
+}
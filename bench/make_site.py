@@ -0,0 +1,82 @@
+#!/usr/bin/env python
+#
+# Generate the synthetic site served by the host benchmark
+#
+#   make_site.py -o <dir>
+#
+# Shaped like a Vue CLI build of front_/greetings: index.html, hashed js/css/img
+# files and favicon.ico, with .gz sidecars for the text files like main/CMakeLists.txt
+# produces them. The vendor chunk is larger than CONFIG_EXAMPLE_FILE_CACHE_MAX_FILE so
+# it is streamed from the filesystem instead of the file cache. Output is
+# deterministic, the same site is generated for every revision being compared.
+
+import argparse
+import gzip
+import hashlib
+import os
+import random
+import sys
+
+WORDS = ('function', 'return', 'const', 'let', 'this', 'props', 'render', 'component',
+         'data', 'methods', 'computed', 'watch', 'created', 'mounted', 'axios', 'then',
+         'catch', 'error', 'list', 'item', 'value', 'index', 'length', 'push', 'state')
+
+
+def text(rng, size, sep):
+    out = []
+    length = 0
+    while length < size:
+        line = sep.join(rng.choice(WORDS) + str(rng.randrange(100)) for _ in range(8)) + ';\n'
+        out.append(line)
+        length += len(line)
+    return ''.join(out)[:size].encode()
+
+
+def binary(rng, size):
+    return bytes(rng.randrange(256) for _ in range(size))
+
+
+def hashed(name, data):
+    stem, ext = os.path.splitext(name)
+    return '%s.%s%s' % (stem, hashlib.sha256(data).hexdigest()[:8], ext)
+
+
+def write(root, rel, data, compress):
+    path = os.path.join(root, rel)
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    with open(path, 'wb') as f:
+        f.write(data)
+    if compress:
+        with open(path + '.gz', 'wb') as f:
+            f.write(gzip.compress(data, compresslevel=9, mtime=0))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('-o', '--output', required=True, help='site directory to create')
+    args = parser.parse_args()
+
+    rng = random.Random(12)
+    files = {}
+    for name, data, compress in (('js/app.js', text(rng, 18 * 1024, '.'), True),
+                                 ('js/chunk-vendors.js', text(rng, 160 * 1024, '.'), True),
+                                 ('css/app.css', text(rng, 3 * 1024, '-'), True),
+                                 ('img/logo.png', binary(rng, 6 * 1024), False)):
+        files[hashed(name, data)] = (data, compress)
+    files['favicon.ico'] = (binary(rng, 4286), True)
+    scripts = ''.join('<script src="/%s"></script>' % name for name in sorted(files) if name.endswith('.js'))
+    styles = ''.join('<link href="/%s" rel="stylesheet">' % name for name in sorted(files) if name.endswith('.css'))
+    index = ('<!DOCTYPE html><html lang="en"><head><meta charset="utf-8">'
+             '<meta name="viewport" content="width=device-width,initial-scale=1.0">'
+             '<link rel="icon" href="/favicon.ico"><title>greetings</title>%s</head>'
+             '<body><noscript><strong>This page needs JavaScript.</strong></noscript>'
+             '<div id="app"></div>%s</body></html>' % (styles, scripts))
+    files['index.html'] = (index.encode(), True)
+
+    for rel, (data, compress) in sorted(files.items()):
+        write(args.output, rel, data, compress)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,850 @@
+/* Host load test of the REST server
+
+   Forks: the child runs the firmware's rest_server.c, wifi.c and the rest of main/
+   on the POSIX stand-ins from bench/host, with the SoftAP data path up (background
+   scanner publishing synthetic networks) and the generated site mounted as
+   /www/prod. The parent drives it over loopback with keep-alive connections, one
+   thread per connection, and prints one JSON document:
+
+     rest_bench [--concurrency N] [--duration S]
+                [--scenarios static,aps,updpassword,large,aps_cbor,updpassword_cbor,pipelined]
+                [--www DIR] [--networks N] [--label TEXT] [--output FILE] [--nodelay]
+                [--sd-kbps N] [--net-kbps N] [--cores N]
+
+   Per scenario it reports throughput, latency percentiles, status classes and the
+   peak of the firmware's heap use (allocations made by main/ and the stand-ins)
+   next to the server process peak RSS. The server keeps Nagle on like the device,
+   so responses written in several small pieces show the ~40 ms delayed-ACK stall;
+   --nodelay disables it to compare CPU cost only. --sd-kbps and --net-kbps give the
+   card reads and the server sends a fixed shared rate like the SD bus and the Wi-Fi
+   air time of the device; "large" streams the biggest file uncompressed to show how
+   well the two overlap. The _cbor variants ask for and post CBOR instead of JSON.
+   "pipelined" sends a request for the large file and one for /aps back to back
+   and counts an error unless both responses arrive whole and in order.
+   --cores 2 runs the server on two host CPUs with tasks pinned like on the ESP32
+   and the load generator on CPU 0, where the Wi-Fi driver and lwIP run on the
+   device, so the scheduling profiles can be compared (bench/sched_sweep.sh).
+*/
+#include <dirent.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "esp_err.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "nvs_flash.h"
+#include "sdkconfig.h"
+#include "ap_scan.h"
+#include "wifi.h"
+#include "bench_host.h"
+
+#define BENCH_MAX_URIS (64)
+#define BENCH_URI_MAX (256)
+#define BENCH_RX_BUF (16 * 1024)
+#define BENCH_READY_TIMEOUT_S (10)
+
+/* Baseline revisions from before the read-ahead stage */
+#ifndef CONFIG_EXAMPLE_READAHEAD_CHUNKS
+#define CONFIG_EXAMPLE_READAHEAD_CHUNKS (0)
+#define CONFIG_EXAMPLE_READAHEAD_CHUNK_SIZE (0)
+#endif
+
+typedef struct
+{
+    bench_heap_stats_t heap;
+    bench_io_stats_t io;
+} bench_shared_t;
+
+typedef struct
+{
+    const char *name;
+    /* Request number n of a worker, returns its length */
+    int (*build)(char *buf, size_t size, unsigned worker, unsigned n);
+    /* Requests build() writes back to back, their responses are read in order */
+    unsigned pipelined;
+} scenario_t;
+
+typedef struct
+{
+    const scenario_t *scenario;
+    unsigned index;
+    int64_t deadline_us;
+    /* results */
+    uint32_t *latency_us;
+    size_t count;
+    size_t capacity;
+    uint64_t bytes;
+    unsigned status[6]; /* by hundreds, [0] for failed exchanges */
+    unsigned reconnects;
+} worker_t;
+
+esp_err_t start_rest_server(const char *base_path);
+
+static uint16_t s_port;
+static char s_uris[BENCH_MAX_URIS][BENCH_URI_MAX];
+static unsigned s_uri_count;
+static unsigned s_largest_uri;
+static off_t s_largest_size;
+static bench_shared_t *s_shared;
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* ---- Server process ---- */
+
+static void server_main(const char *www, unsigned networks, unsigned cores, int ready_fd)
+{
+    signal(SIGPIPE, SIG_IGN);
+    bench_set_cores(cores);
+    bench_heap_track(&s_shared->heap);
+    bench_io_track(&s_shared->io);
+    bench_vfs_set_root(CONFIG_EXAMPLE_WEB_MOUNT_POINT, www);
+    bench_wifi_set_networks(networks);
+
+    ESP_ERROR_CHECK(nvs_flash_init());
+    ESP_ERROR_CHECK(esp_netif_init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    wifi_init_softap();
+    ESP_ERROR_CHECK(start_rest_server(CONFIG_EXAMPLE_WEB_MOUNT_POINT "/prod"));
+
+    /* Ready once the first scan is published so /aps has something to list */
+    ap_snapshot_t *snap = malloc(sizeof(ap_snapshot_t));
+    do
+    {
+        usleep(1000);
+        ap_scan_read(snap);
+    } while (!snap->generation);
+    free(snap);
+
+    char ready = 1;
+    if (write(ready_fd, &ready, 1) != 1)
+    {
+        exit(1);
+    }
+    for (;;)
+    {
+        pause();
+    }
+}
+
+static long server_peak_rss_kb(pid_t pid)
+{
+    char path[64];
+    char line[256];
+    long kb = -1;
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+    FILE *f = fopen(path, "r");
+    if (!f)
+    {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f))
+    {
+        if (sscanf(line, "VmHWM: %ld kB", &kb) == 1)
+        {
+            break;
+        }
+    }
+    fclose(f);
+    return kb;
+}
+
+/* ---- Scenarios ---- */
+
+static void collect_uris(const char *root, const char *rel)
+{
+    char path[BENCH_URI_MAX * 2];
+    snprintf(path, sizeof(path), "%s%s", root, rel);
+    DIR *dir = opendir(path);
+    if (!dir)
+    {
+        return;
+    }
+    struct dirent *de;
+    while ((de = readdir(dir)) && s_uri_count < BENCH_MAX_URIS)
+    {
+        const char *name = de->d_name;
+        size_t len = strlen(name);
+        char child[BENCH_URI_MAX];
+        struct stat st;
+
+        if (name[0] == '.' || (len > 3 && (!strcmp(name + len - 3, ".gz") || !strcmp(name + len - 3, ".br"))) ||
+            !strcmp(name, "asset-manifest.txt"))
+        {
+            continue;
+        }
+        if (snprintf(child, sizeof(child), "%s/%s", rel, name) >= (int)sizeof(child) ||
+            snprintf(path, sizeof(path), "%s%s", root, child) >= (int)sizeof(path) || stat(path, &st) != 0)
+        {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode))
+        {
+            collect_uris(root, child);
+        }
+        else
+        {
+            if (st.st_size > s_largest_size)
+            {
+                s_largest_size = st.st_size;
+                s_largest_uri = s_uri_count;
+            }
+            strcpy(s_uris[s_uri_count++], strcmp(child, "/index.html") ? child : "/");
+        }
+    }
+    closedir(dir);
+}
+
+static int build_static(char *buf, size_t size, unsigned worker, unsigned n)
+{
+    return snprintf(buf, size,
+                    "GET %s HTTP/1.1\r\nHost: esp-home.local\r\n"
+                    "Accept-Encoding: gzip, deflate, br\r\n\r\n",
+                    s_uris[(worker + n) % s_uri_count]);
+}
+
+static int build_aps(char *buf, size_t size, unsigned worker, unsigned n)
+{
+    return snprintf(buf, size, "GET /aps HTTP/1.1\r\nHost: esp-home.local\r\nAccept: application/json\r\n\r\n");
+}
+
+static int build_updpassword(char *buf, size_t size, unsigned worker, unsigned n)
+{
+    char body[128];
+    int body_len = snprintf(body, sizeof(body), "{\"id\":%u,\"ssid\":\"bench-net-%02u\",\"password\":\"pass-%u-%u\"}",
+                            n % 4, n % 4, worker, n);
+    return snprintf(buf, size,
+                    "POST /updpassword HTTP/1.1\r\nHost: esp-home.local\r\n"
+                    "Content-Type: application/json\r\nContent-Length: %d\r\n\r\n%s",
+                    body_len, body);
+}
+
+static int build_aps_cbor(char *buf, size_t size, unsigned worker, unsigned n)
+{
+    return snprintf(buf, size, "GET /aps HTTP/1.1\r\nHost: esp-home.local\r\nAccept: application/cbor\r\n\r\n");
+}
+
+static size_t cbor_put_text(uint8_t *p, const char *s)
+{
+    size_t len = strlen(s); /* < 24 bytes here */
+    p[0] = 0x60 | len;
+    memcpy(p + 1, s, len);
+    return len + 1;
+}
+
+/* Same fields as build_updpassword, as a CBOR map */
+static int build_updpassword_cbor(char *buf, size_t size, unsigned worker, unsigned n)
+{
+    uint8_t body[96];
+    char text[32];
+    size_t body_len = 0;
+
+    body[body_len++] = 0xa3; /* map of 3 */
+    body_len += cbor_put_text(body + body_len, "id");
+    body[body_len++] = n % 4;
+    body_len += cbor_put_text(body + body_len, "ssid");
+    snprintf(text, sizeof(text), "bench-net-%02u", n % 4);
+    body_len += cbor_put_text(body + body_len, text);
+    body_len += cbor_put_text(body + body_len, "password");
+    snprintf(text, sizeof(text), "pass-%u-%u", worker % 1000, n % 100000);
+    body_len += cbor_put_text(body + body_len, text);
+
+    int head_len = snprintf(buf, size,
+                            "POST /updpassword HTTP/1.1\r\nHost: esp-home.local\r\n"
+                            "Content-Type: application/cbor\r\nContent-Length: %u\r\n\r\n",
+                            (unsigned)body_len);
+    memcpy(buf + head_len, body, body_len);
+    return head_len + body_len;
+}
+
+static int build_large(char *buf, size_t size, unsigned worker, unsigned n)
+{
+    return snprintf(buf, size, "GET %s HTTP/1.1\r\nHost: esp-home.local\r\n\r\n", s_uris[s_largest_uri]);
+}
+
+/* The large file, streamed by a worker, with /aps pipelined behind it on the same
+   connection: the /aps response must not start before the file ends */
+static int build_pipelined(char *buf, size_t size, unsigned worker, unsigned n)
+{
+    int len = build_large(buf, size, worker, n);
+    return len + build_aps(buf + len, size - len, worker, n);
+}
+
+static const scenario_t s_scenarios[] = {
+    {"static", build_static, 1},
+    {"aps", build_aps, 1},
+    {"updpassword", build_updpassword, 1},
+    {"large", build_large, 1},
+    {"aps_cbor", build_aps_cbor, 1},
+    {"updpassword_cbor", build_updpassword_cbor, 1},
+    {"pipelined", build_pipelined, 2},
+};
+
+/* ---- Load generator ---- */
+
+typedef struct
+{
+    int fd;
+    char buf[BENCH_RX_BUF];
+    size_t len;
+    size_t pos;
+} conn_t;
+
+static bool conn_open(conn_t *c, int64_t deadline_us)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(s_port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    int one = 1;
+    int64_t left_us = deadline_us - now_us();
+    struct timeval tv = {.tv_sec = left_us > 0 ? left_us / 1000000 + 5 : 5};
+
+    c->len = c->pos = 0;
+    c->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (c->fd < 0)
+    {
+        return false;
+    }
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(c->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (connect(c->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        close(c->fd);
+        c->fd = -1;
+        return false;
+    }
+    return true;
+}
+
+static void conn_close(conn_t *c)
+{
+    if (c->fd >= 0)
+    {
+        close(c->fd);
+        c->fd = -1;
+    }
+}
+
+static bool conn_fill(conn_t *c)
+{
+    if (c->pos == c->len)
+    {
+        c->pos = c->len = 0;
+    }
+    else if (c->len == sizeof(c->buf))
+    {
+        memmove(c->buf, c->buf + c->pos, c->len - c->pos);
+        c->len -= c->pos;
+        c->pos = 0;
+    }
+    ssize_t ret = recv(c->fd, c->buf + c->len, sizeof(c->buf) - c->len, 0);
+    if (ret <= 0)
+    {
+        return false;
+    }
+    c->len += ret;
+    return true;
+}
+
+/* Reads up to and including the next CRLF, returns the line without it */
+static char *conn_line(conn_t *c, char *line, size_t size)
+{
+    for (;;)
+    {
+        char *end = memmem(c->buf + c->pos, c->len - c->pos, "\r\n", 2);
+        if (end)
+        {
+            size_t len = end - (c->buf + c->pos);
+            if (len >= size)
+            {
+                return NULL;
+            }
+            memcpy(line, c->buf + c->pos, len);
+            line[len] = '\0';
+            c->pos += len + 2;
+            return line;
+        }
+        if (!conn_fill(c))
+        {
+            return NULL;
+        }
+    }
+}
+
+static bool conn_skip(conn_t *c, size_t len)
+{
+    while (len)
+    {
+        if (c->pos == c->len && !conn_fill(c))
+        {
+            return false;
+        }
+        size_t take = c->len - c->pos < len ? c->len - c->pos : len;
+        c->pos += take;
+        len -= take;
+    }
+    return true;
+}
+
+/* One response: status code or 0 on a broken connection, *bytes counts the whole message */
+static int conn_read_response(conn_t *c, uint64_t *bytes)
+{
+    char line[1024];
+    size_t start_pos = c->pos;
+    uint64_t total = 0;
+    long content_length = -1;
+    bool chunked = false;
+    int status = 0;
+
+    if (!conn_line(c, line, sizeof(line)) || sscanf(line, "HTTP/1.1 %d", &status) != 1)
+    {
+        return 0;
+    }
+    total += strlen(line) + 2;
+    for (;;)
+    {
+        if (!conn_line(c, line, sizeof(line)))
+        {
+            return 0;
+        }
+        total += strlen(line) + 2;
+        if (!line[0])
+        {
+            break;
+        }
+        if (!strncasecmp(line, "Content-Length:", 15))
+        {
+            content_length = strtol(line + 15, NULL, 10);
+        }
+        else if (!strncasecmp(line, "Transfer-Encoding:", 18) && strstr(line + 18, "chunked"))
+        {
+            chunked = true;
+        }
+    }
+    if (chunked)
+    {
+        for (;;)
+        {
+            if (!conn_line(c, line, sizeof(line)))
+            {
+                return 0;
+            }
+            long chunk = strtol(line, NULL, 16);
+            total += strlen(line) + 2 + chunk + 2;
+            if (!conn_skip(c, chunk + 2))
+            {
+                return 0;
+            }
+            if (!chunk)
+            {
+                break;
+            }
+        }
+    }
+    else if (content_length > 0)
+    {
+        if (!conn_skip(c, content_length))
+        {
+            return 0;
+        }
+        total += content_length;
+    }
+    (void)start_pos;
+    *bytes += total;
+    return status;
+}
+
+static void worker_record(worker_t *w, uint32_t latency_us)
+{
+    if (w->count == w->capacity)
+    {
+        w->capacity = w->capacity ? w->capacity * 2 : 4096;
+        w->latency_us = realloc(w->latency_us, w->capacity * sizeof(uint32_t));
+        if (!w->latency_us)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    w->latency_us[w->count++] = latency_us;
+}
+
+static void *worker_run(void *arg)
+{
+    worker_t *w = arg;
+    conn_t *c = malloc(sizeof(conn_t));
+    char req[1024];
+    unsigned n = 0;
+
+    c->fd = -1;
+    while (now_us() < w->deadline_us)
+    {
+        if (c->fd < 0)
+        {
+            if (!conn_open(c, w->deadline_us))
+            {
+                w->status[0]++;
+                usleep(10000);
+                continue;
+            }
+            w->reconnects++;
+        }
+        int len = w->scenario->build(req, sizeof(req), w->index, n++);
+        int64_t start = now_us();
+        int status = 0;
+        bool sent = send(c->fd, req, len, MSG_NOSIGNAL) == len;
+        /* One exchange per build(), counted with the first status that isn't 2xx. A
+           response out of place garbles the framing of the ones after it. */
+        for (unsigned i = 0; sent && i < w->scenario->pipelined && (i == 0 || status / 100 == 2); i++)
+        {
+            status = conn_read_response(c, &w->bytes);
+        }
+        if (status < 100 || status > 599)
+        {
+            /* Server closed the connection, e.g. after a handler error */
+            w->status[0]++;
+            conn_close(c);
+            continue;
+        }
+        worker_record(w, now_us() - start);
+        w->status[status / 100]++;
+    }
+    conn_close(c);
+    free(c);
+    return NULL;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static uint32_t percentile(const uint32_t *sorted, size_t count, double p)
+{
+    if (!count)
+    {
+        return 0;
+    }
+    size_t i = (size_t)(p / 100.0 * (count - 1) + 0.5);
+    return sorted[i < count ? i : count - 1];
+}
+
+static void run_scenario(FILE *out, const scenario_t *scenario, unsigned concurrency, double duration_s,
+                         pid_t server, bool first)
+{
+    worker_t *workers = calloc(concurrency, sizeof(worker_t));
+    pthread_t *threads = calloc(concurrency, sizeof(pthread_t));
+    bench_heap_stats_t *heap = &s_shared->heap;
+
+    __atomic_store_n(&heap->peak, __atomic_load_n(&heap->in_use, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+    int64_t heap_before = __atomic_load_n(&heap->in_use, __ATOMIC_RELAXED);
+    uint64_t allocs_before = __atomic_load_n(&heap->allocs, __ATOMIC_RELAXED);
+    bench_io_stats_t io_before = s_shared->io;
+    int64_t start = now_us();
+    int64_t deadline = start + (int64_t)(duration_s * 1e6);
+
+    for (unsigned i = 0; i < concurrency; i++)
+    {
+        workers[i].scenario = scenario;
+        workers[i].index = i;
+        workers[i].deadline_us = deadline;
+        pthread_create(&threads[i], NULL, worker_run, &workers[i]);
+    }
+    size_t total = 0;
+    for (unsigned i = 0; i < concurrency; i++)
+    {
+        pthread_join(threads[i], NULL);
+        total += workers[i].count;
+    }
+    double elapsed_s = (now_us() - start) / 1e6;
+
+    uint32_t *all = malloc((total ? total : 1) * sizeof(uint32_t));
+    uint64_t bytes = 0;
+    unsigned status[6] = {0};
+    unsigned reconnects = 0;
+    size_t pos = 0;
+    for (unsigned i = 0; i < concurrency; i++)
+    {
+        memcpy(all + pos, workers[i].latency_us, workers[i].count * sizeof(uint32_t));
+        pos += workers[i].count;
+        bytes += workers[i].bytes;
+        reconnects += workers[i].reconnects;
+        for (int s = 0; s < 6; s++)
+        {
+            status[s] += workers[i].status[s];
+        }
+        free(workers[i].latency_us);
+    }
+    qsort(all, total, sizeof(uint32_t), cmp_u32);
+
+    int64_t peak = __atomic_load_n(&heap->peak, __ATOMIC_RELAXED);
+    uint64_t allocs = __atomic_load_n(&heap->allocs, __ATOMIC_RELAXED) - allocs_before;
+    uint64_t sends = __atomic_load_n(&s_shared->io.sends, __ATOMIC_RELAXED) - io_before.sends;
+    uint64_t reads = __atomic_load_n(&s_shared->io.reads, __ATOMIC_RELAXED) - io_before.reads;
+    fprintf(out,
+            "%s\n    {\n"
+            "      \"name\": \"%s\",\n"
+            "      \"requests\": %zu,\n"
+            "      \"errors\": %u,\n"
+            "      \"connections\": %u,\n"
+            "      \"throughput_rps\": %.1f,\n"
+            "      \"bytes_per_s\": %.0f,\n"
+            "      \"latency_us\": {\"p50\": %u, \"p90\": %u, \"p99\": %u, \"max\": %u},\n"
+            "      \"status\": {\"2xx\": %u, \"3xx\": %u, \"4xx\": %u, \"5xx\": %u},\n"
+            "      \"heap\": {\"start_bytes\": %lld, \"peak_bytes\": %lld, \"allocs_per_request\": %.2f},\n"
+            "      \"io\": {\"sends_per_request\": %.2f, \"file_reads_per_request\": %.2f},\n"
+            "      \"server_peak_rss_kb\": %ld\n"
+            "    }",
+            first ? "" : ",", scenario->name, total, status[0] + status[4] + status[5], reconnects,
+            total / elapsed_s, bytes / elapsed_s,
+            percentile(all, total, 50), percentile(all, total, 90), percentile(all, total, 99),
+            total ? all[total - 1] : 0,
+            status[2], status[3], status[4], status[5],
+            (long long)heap_before, (long long)peak, total ? (double)allocs / total : 0.0,
+            total ? (double)sends / total : 0.0, total ? (double)reads / total : 0.0,
+            server_peak_rss_kb(server));
+    fprintf(stderr, "%-12s %8zu req %9.1f req/s  p50 %6u us  p99 %6u us  heap peak %lld B  %.1f sends/req\n",
+            scenario->name, total, total / elapsed_s, percentile(all, total, 50), percentile(all, total, 99),
+            (long long)peak, total ? (double)sends / total : 0.0);
+
+    free(all);
+    free(workers);
+    free(threads);
+}
+
+static uint16_t pick_port(void)
+{
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t len = sizeof(addr);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        getsockname(fd, (struct sockaddr *)&addr, &len) != 0)
+    {
+        perror("pick port");
+        exit(1);
+    }
+    close(fd);
+    return ntohs(addr.sin_port);
+}
+
+static bool wait_ready(int fd)
+{
+    fd_set fds;
+    struct timeval tv = {.tv_sec = BENCH_READY_TIMEOUT_S};
+    char ready;
+    FD_ZERO(&fds);
+    FD_SET(fd, &fds);
+    return select(fd + 1, &fds, NULL, NULL, &tv) == 1 && read(fd, &ready, 1) == 1;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [--concurrency N] [--duration S]\n"
+            "          [--scenarios static,aps,updpassword,large,aps_cbor,updpassword_cbor,pipelined]\n"
+            "          [--www DIR] [--networks N] [--label TEXT] [--output FILE] [--nodelay]\n"
+            "          [--sd-kbps N] [--net-kbps N] [--cores N]\n",
+            prog);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] = {
+        {"concurrency", required_argument, NULL, 'c'},
+        {"duration", required_argument, NULL, 'd'},
+        {"scenarios", required_argument, NULL, 's'},
+        {"www", required_argument, NULL, 'w'},
+        {"networks", required_argument, NULL, 'n'},
+        {"label", required_argument, NULL, 'l'},
+        {"output", required_argument, NULL, 'o'},
+        {"nodelay", no_argument, NULL, 'N'},
+        {"sd-kbps", required_argument, NULL, 'S'},
+        {"net-kbps", required_argument, NULL, 'W'},
+        {"cores", required_argument, NULL, 'C'},
+        {NULL, 0, NULL, 0},
+    };
+    unsigned concurrency = 4;
+    double duration_s = 5;
+    char scenarios[128] = "static,aps,updpassword";
+    const char *www = BENCH_DEFAULT_WWW;
+    unsigned networks = 24;
+    const char *label = "";
+    const char *output = NULL;
+    bool nodelay = false;
+    unsigned sd_kbps = 0;
+    unsigned net_kbps = 0;
+    unsigned cores = 0;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "c:d:s:w:n:l:o:", options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            concurrency = strtoul(optarg, NULL, 10);
+            break;
+        case 'd':
+            duration_s = strtod(optarg, NULL);
+            break;
+        case 's':
+            snprintf(scenarios, sizeof(scenarios), "%s", optarg);
+            break;
+        case 'w':
+            www = optarg;
+            break;
+        case 'n':
+            networks = strtoul(optarg, NULL, 10);
+            break;
+        case 'l':
+            label = optarg;
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case 'N':
+            nodelay = true;
+            break;
+        case 'S':
+            sd_kbps = strtoul(optarg, NULL, 10);
+            break;
+        case 'W':
+            net_kbps = strtoul(optarg, NULL, 10);
+            break;
+        case 'C':
+            cores = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (!concurrency || duration_s <= 0)
+    {
+        usage(argv[0]);
+    }
+
+    char site[BENCH_URI_MAX];
+    snprintf(site, sizeof(site), "%s/prod", www);
+    collect_uris(site, "");
+    if (!s_uri_count)
+    {
+        fprintf(stderr, "No files in %s\n", site);
+        return 1;
+    }
+
+    s_shared = mmap(NULL, sizeof(bench_shared_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (s_shared == MAP_FAILED)
+    {
+        perror("mmap");
+        return 1;
+    }
+    s_port = pick_port();
+    char port[8];
+    snprintf(port, sizeof(port), "%u", s_port);
+    setenv("BENCH_HTTPD_PORT", port, 1);
+    setenv("BENCH_TCP_NODELAY", nodelay ? "1" : "0", 1);
+    char rate[16];
+    snprintf(rate, sizeof(rate), "%u", sd_kbps);
+    setenv("BENCH_SD_KBPS", rate, 1);
+    snprintf(rate, sizeof(rate), "%u", net_kbps);
+    setenv("BENCH_NET_KBPS", rate, 1);
+
+    int ready[2];
+    if (pipe(ready) != 0)
+    {
+        perror("pipe");
+        return 1;
+    }
+    pid_t server = fork();
+    if (server == 0)
+    {
+        close(ready[0]);
+        server_main(www, networks, cores, ready[1]);
+    }
+    if (cores)
+    {
+        /* The load generator takes the place of the network stack on core 0 */
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(0, &set);
+        sched_setaffinity(0, sizeof(set), &set);
+    }
+    close(ready[1]);
+    if (server < 0 || !wait_ready(ready[0]))
+    {
+        fprintf(stderr, "Server didn't start\n");
+        if (server > 0)
+        {
+            kill(server, SIGKILL);
+        }
+        return 1;
+    }
+
+    FILE *out = output ? fopen(output, "w") : stdout;
+    if (!out)
+    {
+        perror(output);
+        kill(server, SIGKILL);
+        return 1;
+    }
+    fprintf(out,
+            "{\n"
+            "  \"label\": \"%s\",\n"
+            "  \"config\": {\"concurrency\": %u, \"duration_s\": %.1f, \"networks\": %u, \"files\": %u, "
+            "\"nodelay\": %s, \"sd_kbps\": %u, \"net_kbps\": %u, \"cores\": %u, "
+            "\"readahead_chunks\": %d, \"readahead_chunk_size\": %d},\n"
+            "  \"scenarios\": [",
+            label, concurrency, duration_s, networks, s_uri_count, nodelay ? "true" : "false", sd_kbps,
+            net_kbps, cores, CONFIG_EXAMPLE_READAHEAD_CHUNKS, CONFIG_EXAMPLE_READAHEAD_CHUNK_SIZE);
+    bool first = true;
+    for (char *name = strtok(scenarios, ","); name; name = strtok(NULL, ","))
+    {
+        const scenario_t *scenario = NULL;
+        for (size_t i = 0; i < sizeof(s_scenarios) / sizeof(s_scenarios[0]); i++)
+        {
+            if (!strcmp(s_scenarios[i].name, name))
+            {
+                scenario = &s_scenarios[i];
+            }
+        }
+        if (!scenario)
+        {
+            fprintf(stderr, "Unknown scenario %s\n", name);
+            continue;
+        }
+        run_scenario(out, scenario, concurrency, duration_s, server, first);
+        first = false;
+    }
+    fprintf(out, "\n  ]\n}\n");
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+    return 0;
+}
@@ -0,0 +1,47 @@
+#!/bin/sh
+#
+# Build and run the host REST benchmark, optionally against a baseline revision
+#
+#   bench/run.sh [--baseline <git rev>] [rest_bench options...]
+#
+# Without --baseline prints the rest_bench JSON of the working tree. With it the
+# baseline's main/ is checked out into a temporary worktree, built with this
+# harness and run with the same options, and the output is
+# {"baseline": {...}, "current": {...}}. The baseline must be a revision that
+# already has bench/ (older asset index generators can't index the synthetic site).
+
+set -e
+
+BENCH_DIR=$(cd "$(dirname "$0")" && pwd)
+ROOT=$(cd "$BENCH_DIR/.." && pwd)
+BUILD_DIR=${BENCH_BUILD_DIR:-$ROOT/_bench_build}
+
+baseline=
+if [ "$1" = "--baseline" ]; then
+    baseline=$2
+    shift 2
+fi
+
+build() # <build dir> <firmware root>
+{
+    cmake -S "$BENCH_DIR" -B "$1" -DCMAKE_BUILD_TYPE=RelWithDebInfo -DFIRMWARE_ROOT="$2" >&2
+    cmake --build "$1" -j"$(nproc)" >&2
+}
+
+build "$BUILD_DIR/current" "$ROOT"
+if [ -z "$baseline" ]; then
+    exec "$BUILD_DIR/current/rest_bench" --label current "$@"
+fi
+
+worktree=$(mktemp -d)
+trap 'git -C "$ROOT" worktree remove --force "$worktree" >/dev/null 2>&1; rm -rf "$worktree"' EXIT
+git -C "$ROOT" worktree add --detach "$worktree" "$baseline" >&2
+build "$BUILD_DIR/baseline" "$worktree"
+
+"$BUILD_DIR/baseline/rest_bench" --label "$baseline" --output "$BUILD_DIR/baseline.json" "$@"
+"$BUILD_DIR/current/rest_bench" --label current --output "$BUILD_DIR/current.json" "$@"
+printf '{\n"baseline": '
+cat "$BUILD_DIR/baseline.json"
+printf ',\n"current": '
+cat "$BUILD_DIR/current.json"
+printf '}\n'
@@ -0,0 +1,43 @@
+#!/bin/sh
+#
+# Compare the task scheduling profiles
+#
+#   bench/sched_sweep.sh [rest_bench options...]
+#
+# Builds the benchmark once per profile and prints a JSON array with one rest_bench
+# result per build, all run with --cores 2: the server on two host CPUs with its
+# tasks pinned as the profile says, the load generator on CPU 0 in place of the
+# Wi-Fi driver and lwIP. "shared" is the custom profile with every server task on
+# core 0, the worst case the app-core profile is meant to avoid. Host priorities
+# aren't applied, and on a host with a single CPU all profiles measure the same.
+
+set -e
+
+BENCH_DIR=$(cd "$(dirname "$0")" && pwd)
+ROOT=$(cd "$BENCH_DIR/.." && pwd)
+BUILD_DIR=${BENCH_BUILD_DIR:-$ROOT/_bench_build}
+PROFILES=${PROFILES:-"default app-core shared"}
+
+sep='['
+for profile in $PROFILES; do
+    case $profile in
+        default) config="CONFIG_EXAMPLE_SCHED_PROFILE_DEFAULT=y" ;;
+        # what sdkconfig.defaults.app_core selects
+        app-core) config="CONFIG_EXAMPLE_SCHED_PROFILE_DEFAULT=n;CONFIG_EXAMPLE_SCHED_PROFILE_APP_CORE=y"
+                  config="$config;CONFIG_LWIP_TCPIP_TASK_AFFINITY_NO_AFFINITY=n"
+                  config="$config;CONFIG_LWIP_TCPIP_TASK_AFFINITY_CPU0=y;CONFIG_LWIP_TCPIP_TASK_AFFINITY=0x0" ;;
+        shared) config="CONFIG_EXAMPLE_SCHED_PROFILE_DEFAULT=n;CONFIG_EXAMPLE_SCHED_PROFILE_CUSTOM=y"
+                config="$config;CONFIG_EXAMPLE_SCHED_HTTPD_CORE=0;CONFIG_EXAMPLE_SCHED_HTTPD_PRIORITY=5"
+                config="$config;CONFIG_EXAMPLE_SCHED_WORKER_CORE=0;CONFIG_EXAMPLE_SCHED_READER_CORE=0"
+                config="$config;CONFIG_EXAMPLE_SCHED_READER_PRIORITY=5" ;;
+        *) echo "Unknown profile $profile" >&2; exit 2 ;;
+    esac
+    dir="$BUILD_DIR/sched-$profile"
+    cmake -S "$BENCH_DIR" -B "$dir" -DCMAKE_BUILD_TYPE=RelWithDebInfo "-DBENCH_SDKCONFIG=$config" >&2
+    cmake --build "$dir" -j"$(nproc)" >&2
+    printf '%s\n' "$sep"
+    "$dir/rest_bench" --label "profile=$profile" --scenarios static,aps,large --concurrency 4 \
+                      --duration 3 --cores 2 --nodelay "$@"
+    sep=','
+done
+printf ']\n'
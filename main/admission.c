@@ -0,0 +1,244 @@
+/* Admission control
+
+   Load is shed where it is cheapest, before a handler opens a file or builds a
+   document:
+   - connections: at most CONFIG_EXAMPLE_ADMISSION_MAX_CONNECTIONS in total and
+     CONFIG_EXAMPLE_ADMISSION_CLIENT_CONNECTIONS per client IP. The server gets one
+     socket more than the global limit, so a connection over a limit is accepted
+     and answered with a canned 503 right in open_fn instead of waiting in the
+     listen backlog while the sockets are taken. Under HTTPS (https.c runs this
+   open_fn before the handshake) it is closed without an answer;
+   - requests: every client IP has a token bucket refilled at
+     CONFIG_EXAMPLE_ADMISSION_RATE per second up to CONFIG_EXAMPLE_ADMISSION_BURST.
+     A request without a token gets 503 with the seconds until the next token in
+     Retry-After.
+   A phone polling /aps in a loop then only spends its own budget, and the single
+   HTTP server task keeps time for the other clients.
+
+   open_fn, close_fn and the handlers all run in the HTTP server task, so the
+   tables need no lock; only the drop counters are read from elsewhere.
+*/
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "admission.h"
+
+#if CONFIG_EXAMPLE_ADMISSION
+
+#define ADMISSION_CLIENTS (8)
+#define ADMISSION_MAX_SOCKETS (CONFIG_EXAMPLE_ADMISSION_MAX_CONNECTIONS + 1)
+/* Tokens are kept in thousandths */
+#define TOKEN (1000)
+
+static const char *TAG = "admission";
+
+static const char s_busy_resp[] = "HTTP/1.1 503 Service Unavailable\r\n"
+                                  "Retry-After: 1\r\n"
+                                  "Content-Length: 0\r\n"
+                                  "Connection: close\r\n\r\n";
+
+typedef struct
+{
+    uint8_t addr[16]; /* IPv6, IPv4 as mapped address */
+    uint32_t tokens;
+    int64_t refill_us;
+    uint8_t connections;
+    bool used;
+} client_t;
+
+typedef struct
+{
+    int fd;
+    int8_t client; /* -1: not tracked */
+} conn_t;
+
+static client_t s_clients[ADMISSION_CLIENTS];
+static conn_t s_conns[ADMISSION_MAX_SOCKETS];
+static uint32_t s_conn_count;
+static admission_stats_t s_stats;
+
+static bool peer_addr(int fd, uint8_t addr[16])
+{
+    struct sockaddr_storage ss;
+    socklen_t len = sizeof(ss);
+    if (getpeername(fd, (struct sockaddr *)&ss, &len) != 0)
+    {
+        return false;
+    }
+    if (ss.ss_family == AF_INET6)
+    {
+        memcpy(addr, &((struct sockaddr_in6 *)&ss)->sin6_addr, 16);
+        return true;
+    }
+    if (ss.ss_family == AF_INET)
+    {
+        static const uint8_t mapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+        memcpy(addr, mapped, sizeof(mapped));
+        memcpy(addr + 12, &((struct sockaddr_in *)&ss)->sin_addr, 4);
+        return true;
+    }
+    return false;
+}
+
+/* Slot of addr, a new one with a full bucket if unknown. A client without open
+ * connections is dropped when the table is full, the one refilled longest ago
+ * first; -1 if every slot holds a connected client. */
+static int client_find(const uint8_t addr[16])
+{
+    int victim = -1;
+    for (int i = 0; i < ADMISSION_CLIENTS; i++)
+    {
+        client_t *c = &s_clients[i];
+        if (!c->used)
+        {
+            if (victim < 0 || s_clients[victim].used)
+            {
+                victim = i;
+            }
+            continue;
+        }
+        if (!memcmp(c->addr, addr, sizeof(c->addr)))
+        {
+            return i;
+        }
+        if (!c->connections && (victim < 0 || (s_clients[victim].used && c->refill_us < s_clients[victim].refill_us)))
+        {
+            victim = i;
+        }
+    }
+    if (victim >= 0)
+    {
+        client_t *c = &s_clients[victim];
+        memcpy(c->addr, addr, sizeof(c->addr));
+        c->tokens = CONFIG_EXAMPLE_ADMISSION_BURST * TOKEN;
+        c->refill_us = esp_timer_get_time();
+        c->connections = 0;
+        c->used = true;
+    }
+    return victim;
+}
+
+static conn_t *conn_find(int fd)
+{
+    for (int i = 0; i < ADMISSION_MAX_SOCKETS; i++)
+    {
+        if (s_conns[i].fd == fd)
+        {
+            return &s_conns[i];
+        }
+    }
+    return NULL;
+}
+
+static esp_err_t reject_conn(int fd, uint32_t *counter)
+{
+    __atomic_add_fetch(counter, 1, __ATOMIC_RELAXED);
+#if !CONFIG_EXAMPLE_HTTPS
+    send(fd, s_busy_resp, sizeof(s_busy_resp) - 1, MSG_DONTWAIT);
+#endif
+    return ESP_FAIL;
+}
+
+static esp_err_t admission_open(httpd_handle_t hd, int fd)
+{
+    uint8_t addr[16];
+    int client = peer_addr(fd, addr) ? client_find(addr) : -1;
+
+    if (s_conn_count >= CONFIG_EXAMPLE_ADMISSION_MAX_CONNECTIONS)
+    {
+        return reject_conn(fd, &s_stats.busy);
+    }
+    if (client >= 0 && s_clients[client].connections >= CONFIG_EXAMPLE_ADMISSION_CLIENT_CONNECTIONS)
+    {
+        return reject_conn(fd, &s_stats.client_connections);
+    }
+    conn_t *conn = conn_find(-1);
+    if (!conn)
+    {
+        return reject_conn(fd, &s_stats.busy);
+    }
+    conn->fd = fd;
+    conn->client = client;
+    s_conn_count++;
+    if (client >= 0)
+    {
+        s_clients[client].connections++;
+    }
+    return ESP_OK;
+}
+
+/* Also called for connections admission_open() turned away */
+static void admission_close(httpd_handle_t hd, int fd)
+{
+    conn_t *conn = conn_find(fd);
+    if (conn)
+    {
+        if (conn->client >= 0)
+        {
+            s_clients[conn->client].connections--;
+        }
+        conn->fd = -1;
+        s_conn_count--;
+    }
+    close(fd);
+}
+
+void admission_configure(httpd_config_t *config)
+{
+    for (int i = 0; i < ADMISSION_MAX_SOCKETS; i++)
+    {
+        s_conns[i].fd = -1;
+    }
+    config->max_open_sockets = ADMISSION_MAX_SOCKETS;
+    config->open_fn = admission_open;
+    config->close_fn = admission_close;
+}
+
+bool admission_admit(httpd_req_t *req)
+{
+    static char retry_after[12]; /* sent before the handler returns */
+    conn_t *conn = conn_find(httpd_req_to_sockfd(req));
+    if (!conn || conn->client < 0)
+    {
+        return true;
+    }
+    client_t *c = &s_clients[conn->client];
+    int64_t now = esp_timer_get_time();
+    uint64_t refill = (uint64_t)(now - c->refill_us) * CONFIG_EXAMPLE_ADMISSION_RATE * TOKEN / 1000000;
+    if (refill)
+    {
+        uint64_t tokens = c->tokens + refill;
+        c->tokens = tokens < CONFIG_EXAMPLE_ADMISSION_BURST * TOKEN ? tokens : CONFIG_EXAMPLE_ADMISSION_BURST * TOKEN;
+        c->refill_us = now;
+    }
+    if (c->tokens >= TOKEN)
+    {
+        c->tokens -= TOKEN;
+        return true;
+    }
+
+    __atomic_add_fetch(&s_stats.rate_limited, 1, __ATOMIC_RELAXED);
+    uint32_t rate = CONFIG_EXAMPLE_ADMISSION_RATE * TOKEN;
+    uint32_t wait_s = ((TOKEN - c->tokens) + rate - 1) / rate;
+    snprintf(retry_after, sizeof(retry_after), "%" PRIu32, wait_s ? wait_s : 1);
+    ESP_LOGD(TAG, "Rate limited socket %d", conn->fd);
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_set_hdr(req, "Retry-After", retry_after);
+    httpd_resp_send(req, NULL, 0);
+    return false;
+}
+
+void admission_get_stats(admission_stats_t *stats)
+{
+    stats->rate_limited = __atomic_load_n(&s_stats.rate_limited, __ATOMIC_RELAXED);
+    stats->client_connections = __atomic_load_n(&s_stats.client_connections, __ATOMIC_RELAXED);
+    stats->busy = __atomic_load_n(&s_stats.busy, __ATOMIC_RELAXED);
+}
+
+#endif
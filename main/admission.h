@@ -0,0 +1,42 @@
+// admission.h
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+typedef struct
+{
+    uint32_t rate_limited;       /* requests over a client's token bucket */
+    uint32_t client_connections; /* connections over the per-client limit */
+    uint32_t busy;               /* connections over the global limit */
+} admission_stats_t;
+
+#if CONFIG_EXAMPLE_ADMISSION
+/* Take over the open_fn/close_fn of config and size max_open_sockets so one
+ * socket is always left to turn connections over the limits away with a 503.
+ * Call before httpd_start(). */
+void admission_configure(httpd_config_t *config);
+
+/* Charge the request to its client's token bucket. false: a 503 with Retry-After
+ * has been sent and the handler must not run. */
+bool admission_admit(httpd_req_t *req);
+
+void admission_get_stats(admission_stats_t *stats);
+#else
+static inline void admission_configure(httpd_config_t *config)
+{
+}
+
+static inline bool admission_admit(httpd_req_t *req)
+{
+    return true;
+}
+
+static inline void admission_get_stats(admission_stats_t *stats)
+{
+    *stats = (admission_stats_t){0};
+}
+#endif
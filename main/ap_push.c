@@ -0,0 +1,337 @@
+/* WebSocket push of the AP list
+
+   Clients of AP_PUSH_URI get the whole list once and then only what a scan
+   changed: networks that appeared or disappeared and RSSI that moved at least
+   CONFIG_EXAMPLE_AP_PUSH_RSSI_DELTA dB away from the value last pushed. The delta
+   is computed and serialized once in the scanner task (ap_scan listener), and a
+   single work item in the HTTP server task sends that frame to every client, so
+   more dashboards cost one send each instead of one /aps request per poll.
+
+   The client table is only touched from the HTTP server task (handshakes and the
+   fan-out work item); the scanner task only reads the client count.
+*/
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "ap_scan.h"
+#include "json_stream.h"
+#include "ap_push.h"
+
+#if CONFIG_EXAMPLE_AP_PUSH
+
+/* Stream buffer of the serializer, larger deltas are grown on the heap */
+#define AP_PUSH_STREAM_BUF_SIZE (256)
+/* Clients don't talk, whatever they send is read up to this size and dropped */
+#define AP_PUSH_RX_MAX (128)
+
+/* One serialized message, shared by all clients it is sent to */
+typedef struct
+{
+    size_t len;
+    char data[];
+} ap_push_frame_t;
+
+static const char *TAG = "ap_push";
+
+static httpd_handle_t s_server;
+static int s_clients[CONFIG_EXAMPLE_AP_PUSH_MAX_CLIENTS];
+static uint32_t s_client_count;
+/* What the clients were told so far: the last list with the RSSI last pushed per network */
+static ap_snapshot_t s_pushed;
+
+static esp_err_t frame_sink(json_stream_t *js, const char *data, size_t len, bool last)
+{
+    ap_push_frame_t **frame = js->ctx;
+    size_t used = *frame ? (*frame)->len : 0;
+    if (!len)
+    {
+        return ESP_OK;
+    }
+    ap_push_frame_t *grown = realloc(*frame, sizeof(ap_push_frame_t) + used + len);
+    if (!grown)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(grown->data + used, data, len);
+    grown->len = used + len;
+    *frame = grown;
+    return ESP_OK;
+}
+
+static const ap_record_t *find_ap(const ap_snapshot_t *snap, const char *ssid)
+{
+    for (uint16_t i = 0; i < snap->count; i++)
+    {
+        if (!strcmp(snap->aps[i].ssid, ssid))
+        {
+            return &snap->aps[i];
+        }
+    }
+    return NULL;
+}
+
+static bool rssi_moved(const ap_record_t *from, const ap_record_t *to)
+{
+    return abs(to->rssi - from->rssi) >= CONFIG_EXAMPLE_AP_PUSH_RSSI_DELTA;
+}
+
+static void put_ap(json_stream_t *js, const ap_record_t *ap)
+{
+    json_stream_obj_begin(js, NULL);
+    json_stream_str(js, "ssid", ap->ssid);
+    json_stream_int(js, "rssi", ap->rssi);
+    json_stream_obj_end(js);
+}
+
+/* Serialize the way from "from" (NULL: the client knows nothing yet) to "to".
+ * Returns NULL if nothing worth pushing changed or on allocation failure. */
+static ap_push_frame_t *ap_push_serialize(const ap_snapshot_t *from, const ap_snapshot_t *to)
+{
+    char buf[AP_PUSH_STREAM_BUF_SIZE];
+    json_stream_t js;
+    ap_push_frame_t *frame = NULL;
+    bool any = false;
+
+    json_stream_init(&js, buf, sizeof(buf), frame_sink, &frame);
+    json_stream_obj_begin(&js, NULL);
+    json_stream_int(&js, "gen", to->generation);
+    if (!from)
+    {
+        json_stream_bool(&js, "full", true);
+        any = true;
+    }
+
+    bool open = false;
+    for (uint16_t i = 0; i < to->count; i++)
+    {
+        if (from && find_ap(from, to->aps[i].ssid))
+        {
+            continue;
+        }
+        if (!open)
+        {
+            json_stream_arr_begin(&js, "added");
+            open = any = true;
+        }
+        put_ap(&js, &to->aps[i]);
+    }
+    if (open)
+    {
+        json_stream_arr_end(&js);
+    }
+
+    if (from)
+    {
+        open = false;
+        for (uint16_t i = 0; i < to->count; i++)
+        {
+            const ap_record_t *was = find_ap(from, to->aps[i].ssid);
+            if (!was || !rssi_moved(was, &to->aps[i]))
+            {
+                continue;
+            }
+            if (!open)
+            {
+                json_stream_arr_begin(&js, "changed");
+                open = any = true;
+            }
+            put_ap(&js, &to->aps[i]);
+        }
+        if (open)
+        {
+            json_stream_arr_end(&js);
+        }
+
+        open = false;
+        for (uint16_t i = 0; i < from->count; i++)
+        {
+            if (find_ap(to, from->aps[i].ssid))
+            {
+                continue;
+            }
+            if (!open)
+            {
+                json_stream_arr_begin(&js, "removed");
+                open = any = true;
+            }
+            json_stream_str(&js, NULL, from->aps[i].ssid);
+        }
+        if (open)
+        {
+            json_stream_arr_end(&js);
+        }
+    }
+    json_stream_obj_end(&js);
+
+    if (json_stream_finish(&js) != ESP_OK || !any)
+    {
+        free(frame);
+        return NULL;
+    }
+    return frame;
+}
+
+/* New baseline after a push: the list of to, keeping the old RSSI of networks
+ * whose change stayed under the threshold so slow drifts add up */
+static void ap_push_update_baseline(const ap_snapshot_t *to)
+{
+    ap_snapshot_t *pushed = &s_pushed;
+    uint16_t count = to->count;
+    int8_t rssi[CONFIG_EXAMPLE_AP_LIST_SIZE];
+
+    for (uint16_t i = 0; i < count; i++)
+    {
+        const ap_record_t *was = find_ap(pushed, to->aps[i].ssid);
+        rssi[i] = was && !rssi_moved(was, &to->aps[i]) ? was->rssi : to->aps[i].rssi;
+    }
+    memcpy(pushed->aps, to->aps, count * sizeof(ap_record_t));
+    for (uint16_t i = 0; i < count; i++)
+    {
+        pushed->aps[i].rssi = rssi[i];
+    }
+    pushed->count = count;
+    pushed->generation = to->generation;
+}
+
+static void client_remove(int slot)
+{
+    s_clients[slot] = -1;
+    __atomic_sub_fetch(&s_client_count, 1, __ATOMIC_RELAXED);
+}
+
+static esp_err_t send_frame(int fd, const ap_push_frame_t *frame)
+{
+    httpd_ws_frame_t ws = {
+        .final = true,
+        .type = HTTPD_WS_TYPE_TEXT,
+        .payload = (uint8_t *)frame->data,
+        .len = frame->len};
+    return httpd_ws_send_frame_async(s_server, fd, &ws);
+}
+
+/* HTTP server task: the same frame to every client */
+static void ap_push_fan_out(void *arg)
+{
+    ap_push_frame_t *frame = arg;
+    for (int i = 0; i < CONFIG_EXAMPLE_AP_PUSH_MAX_CLIENTS; i++)
+    {
+        int fd = s_clients[i];
+        if (fd < 0)
+        {
+            continue;
+        }
+        /* A closed session's descriptor may have been reused by a plain HTTP client */
+        if (httpd_ws_get_fd_info(s_server, fd) != HTTPD_WS_CLIENT_WEBSOCKET)
+        {
+            client_remove(i);
+            continue;
+        }
+        if (send_frame(fd, frame) != ESP_OK)
+        {
+            ESP_LOGW(TAG, "Push to socket %d failed, closing it", fd);
+            client_remove(i);
+            httpd_sess_trigger_close(s_server, fd);
+        }
+    }
+    free(frame);
+}
+
+/* Scanner task */
+static void ap_push_on_scan(const ap_snapshot_t *snap)
+{
+    if (__atomic_load_n(&s_client_count, __ATOMIC_RELAXED))
+    {
+        ap_push_frame_t *frame = ap_push_serialize(&s_pushed, snap);
+        if (frame && httpd_queue_work(s_server, ap_push_fan_out, frame) != ESP_OK)
+        {
+            ESP_LOGW(TAG, "Failed to queue push of scan %" PRIu32, snap->generation);
+            free(frame);
+        }
+    }
+    /* Without clients too: whoever connects next starts from the full list anyway */
+    ap_push_update_baseline(snap);
+}
+
+static esp_err_t client_add(httpd_req_t *req)
+{
+    int fd = httpd_req_to_sockfd(req);
+    int free_slot = -1;
+    for (int i = 0; i < CONFIG_EXAMPLE_AP_PUSH_MAX_CLIENTS; i++)
+    {
+        if (s_clients[i] == fd)
+        {
+            return ESP_OK; /* descriptor of a closed client, reused */
+        }
+        if (s_clients[i] < 0 && free_slot < 0)
+        {
+            free_slot = i;
+        }
+    }
+    if (free_slot < 0)
+    {
+        ESP_LOGW(TAG, "No room for another client, closing socket %d", fd);
+        return ESP_FAIL;
+    }
+    s_clients[free_slot] = fd;
+    __atomic_add_fetch(&s_client_count, 1, __ATOMIC_RELAXED);
+    return ESP_OK;
+}
+
+static esp_err_t ap_push_ws_handler(httpd_req_t *req)
+{
+    if (req->method == HTTP_GET)
+    {
+        /* Handshake done: register and send the current list */
+        if (client_add(req) != ESP_OK)
+        {
+            return ESP_FAIL;
+        }
+        ap_snapshot_t snap;
+        ap_scan_read(&snap);
+        ap_push_frame_t *frame = ap_push_serialize(NULL, &snap);
+        if (!frame)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+        esp_err_t err = send_frame(httpd_req_to_sockfd(req), frame);
+        free(frame);
+        return err;
+    }
+
+    uint8_t rx[AP_PUSH_RX_MAX];
+    httpd_ws_frame_t ws = {.payload = rx};
+    esp_err_t err = httpd_ws_recv_frame(req, &ws, 0);
+    if (err != ESP_OK || ws.len > sizeof(rx))
+    {
+        return ESP_FAIL;
+    }
+    return ws.len ? httpd_ws_recv_frame(req, &ws, sizeof(rx)) : ESP_OK;
+}
+
+esp_err_t ap_push_register(httpd_handle_t server)
+{
+    for (int i = 0; i < CONFIG_EXAMPLE_AP_PUSH_MAX_CLIENTS; i++)
+    {
+        s_clients[i] = -1;
+    }
+    s_server = server;
+
+    /* Not through metrics_register_uri_handler: frames are no HTTP responses */
+    httpd_uri_t ws_uri = {
+        .uri = AP_PUSH_URI,
+        .method = HTTP_GET,
+        .handler = ap_push_ws_handler,
+        .user_ctx = NULL,
+        .is_websocket = true};
+    esp_err_t err = httpd_register_uri_handler(server, &ws_uri);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to register %s: %s", AP_PUSH_URI, esp_err_to_name(err));
+        return err;
+    }
+    return ap_scan_add_listener(ap_push_on_scan);
+}
+
+#endif
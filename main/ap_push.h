@@ -0,0 +1,18 @@
+// ap_push.h
+#pragma once
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+/* URI of the WebSocket that pushes AP list changes */
+#define AP_PUSH_URI "/ws"
+
+/* Register the AP_PUSH_URI WebSocket on server and start listening to the scanner.
+ *
+ * A client first gets the whole current list, then after every scan only the
+ * changes, as one text frame each:
+ *   {"gen":7,"full":true,"added":[{"ssid":"a","rssi":-52},...]}
+ *   {"gen":8,"added":[...],"changed":[{"ssid":"a","rssi":-60}],"removed":["b"]}
+ * Empty arrays are left out. A delta whose gen is not newer than the full list a
+ * client got is already contained in it. */
+esp_err_t ap_push_register(httpd_handle_t server);
@@ -0,0 +1,270 @@
+/* Background Wi-Fi scanner
+
+   A task rescans every CONFIG_EXAMPLE_AP_SCAN_INTERVAL_S while the provisioning
+   SoftAP runs in APSTA mode. Results are deduplicated by SSID (keeping the
+   strongest BSSID), sorted by signal and published through two buffers guarded by
+   per-buffer sequence counters: the scanner always fills the buffer readers are
+   not pointed at, so /aps copies the current one without taking any lock.
+   Listeners (WebSocket push, RSSI history) are told about every new list from the
+   scanner task.
+
+   A station connect can't run during a scan, so the provisioning code pauses the
+   scanner around its attempts and stops it once the device is a station.
+*/
+#include <inttypes.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "ap_scan.h"
+
+/* Listeners run on this stack, the WebSocket push serializes its delta here */
+#define AP_SCAN_TASK_STACK_SIZE (3584)
+#define AP_SCAN_TASK_PRIORITY (2)
+/* Raw records fetched from the driver per scan, before deduplication */
+#define AP_SCAN_RAW_MAX (CONFIG_EXAMPLE_AP_LIST_SIZE * 2)
+
+typedef struct
+{
+    uint32_t seq;        /* odd while the scanner rewrites the buffer */
+    ap_snapshot_t snap;
+} ap_buffer_t;
+
+static const char *TAG = "ap_scan";
+
+static ap_buffer_t s_buffers[2];
+static uint32_t s_current;  /* index of the buffer readers use */
+static uint32_t s_generation;
+static wifi_ap_record_t s_raw[AP_SCAN_RAW_MAX];
+static TaskHandle_t s_scan_task;
+static SemaphoreHandle_t s_scan_lock; /* held for every scan and by ap_scan_pause() */
+static bool s_stop;
+static ap_scan_listener_t s_listeners[AP_SCAN_MAX_LISTENERS];
+static uint32_t s_listener_count;
+
+static void ap_scan_publish(const wifi_ap_record_t *raw, uint16_t raw_count)
+{
+    ap_buffer_t *buf = &s_buffers[!__atomic_load_n(&s_current, __ATOMIC_RELAXED)];
+    ap_snapshot_t *snap = &buf->snap;
+
+    __atomic_store_n(&buf->seq, buf->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    snap->count = 0;
+    for (uint16_t i = 0; i < raw_count; i++)
+    {
+        const wifi_ap_record_t *rec = &raw[i];
+        if (rec->ssid[0] == '\0')
+        {
+            continue; /* hidden network */
+        }
+        int slot = 0;
+        while (slot < snap->count && strcmp(snap->aps[slot].ssid, (const char *)rec->ssid))
+        {
+            slot++;
+        }
+        if (slot < snap->count)
+        {
+            if (rec->rssi <= snap->aps[slot].rssi)
+            {
+                continue;
+            }
+            /* Stronger BSSID of a known SSID: drop the old entry, reinsert below */
+            memmove(&snap->aps[slot], &snap->aps[slot + 1], (snap->count - slot - 1) * sizeof(ap_record_t));
+            snap->count--;
+        }
+        /* Insertion sort, strongest first; the weakest falls off a full list */
+        int pos = snap->count;
+        while (pos > 0 && snap->aps[pos - 1].rssi < rec->rssi)
+        {
+            pos--;
+        }
+        if (pos >= CONFIG_EXAMPLE_AP_LIST_SIZE)
+        {
+            continue;
+        }
+        int tail = snap->count - pos;
+        if (snap->count == CONFIG_EXAMPLE_AP_LIST_SIZE)
+        {
+            tail--;
+        }
+        else
+        {
+            snap->count++;
+        }
+        memmove(&snap->aps[pos + 1], &snap->aps[pos], tail * sizeof(ap_record_t));
+        ap_record_t *ap = &snap->aps[pos];
+        strlcpy(ap->ssid, (const char *)rec->ssid, sizeof(ap->ssid));
+        memcpy(ap->bssid, rec->bssid, sizeof(ap->bssid));
+        ap->rssi = rec->rssi;
+        ap->channel = rec->primary;
+        ap->authmode = rec->authmode;
+    }
+    snap->generation = ++s_generation;
+
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&buf->seq, buf->seq + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&s_current, (uint32_t)(buf - s_buffers), __ATOMIC_RELEASE);
+}
+
+void ap_scan_read(ap_snapshot_t *snap)
+{
+    for (;;)
+    {
+        const ap_buffer_t *buf = &s_buffers[__atomic_load_n(&s_current, __ATOMIC_ACQUIRE)];
+        uint32_t seq = __atomic_load_n(&buf->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+        {
+            continue; /* overtaken by two publications, s_current has moved on */
+        }
+        /* Copy only the used part of the list */
+        uint16_t count = buf->snap.count;
+        if (count > CONFIG_EXAMPLE_AP_LIST_SIZE)
+        {
+            count = CONFIG_EXAMPLE_AP_LIST_SIZE;
+        }
+        snap->generation = buf->snap.generation;
+        snap->count = count;
+        memcpy(snap->aps, buf->snap.aps, count * sizeof(ap_record_t));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&buf->seq, __ATOMIC_RELAXED) == seq)
+        {
+            return;
+        }
+    }
+}
+
+bool ap_scan_find(const char *ssid, ap_record_t *record)
+{
+    ap_snapshot_t snap;
+    ap_scan_read(&snap);
+    for (uint16_t i = 0; i < snap.count; i++)
+    {
+        if (!strcmp(snap.aps[i].ssid, ssid))
+        {
+            *record = snap.aps[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+static esp_err_t ap_scan_once(void)
+{
+    uint16_t raw_count = AP_SCAN_RAW_MAX;
+    int64_t start = esp_timer_get_time();
+
+    esp_err_t err = esp_wifi_scan_start(NULL, true);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    err = esp_wifi_scan_get_ap_records(&raw_count, s_raw);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    ap_scan_publish(s_raw, raw_count);
+    /* Only this task writes the buffers, the published one stays put meanwhile */
+    const ap_snapshot_t *snap = &s_buffers[s_current].snap;
+    ESP_LOGI(TAG, "Scan %" PRIu32 ": %u records, %u networks in %" PRId64 " ms", s_generation, raw_count,
+             snap->count, (esp_timer_get_time() - start) / 1000);
+    uint32_t listeners = __atomic_load_n(&s_listener_count, __ATOMIC_ACQUIRE);
+    for (uint32_t i = 0; i < listeners; i++)
+    {
+        s_listeners[i](snap);
+    }
+    return ESP_OK;
+}
+
+/* Listeners are added during startup, from one task at a time */
+esp_err_t ap_scan_add_listener(ap_scan_listener_t listener)
+{
+    uint32_t count = __atomic_load_n(&s_listener_count, __ATOMIC_RELAXED);
+    if (count == AP_SCAN_MAX_LISTENERS)
+    {
+        ESP_LOGE(TAG, "No room for another scan listener");
+        return ESP_ERR_NO_MEM;
+    }
+    s_listeners[count] = listener;
+    __atomic_store_n(&s_listener_count, count + 1, __ATOMIC_RELEASE);
+    return ESP_OK;
+}
+
+static void ap_scan_task(void *arg)
+{
+    for (;;)
+    {
+        xSemaphoreTake(s_scan_lock, portMAX_DELAY);
+        if (__atomic_load_n(&s_stop, __ATOMIC_RELAXED))
+        {
+            xSemaphoreGive(s_scan_lock);
+            break;
+        }
+        esp_err_t err = ap_scan_once();
+        xSemaphoreGive(s_scan_lock);
+        if (err != ESP_OK)
+        {
+            ESP_LOGW(TAG, "Scan failed: %s", esp_err_to_name(err));
+        }
+#if CONFIG_EXAMPLE_AP_SCAN_INTERVAL_S
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_EXAMPLE_AP_SCAN_INTERVAL_S * 1000));
+#else
+        if (err == ESP_OK)
+        {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(1000));
+#endif
+    }
+    s_scan_task = NULL;
+    vTaskDelete(NULL);
+}
+
+esp_err_t ap_scan_start(void)
+{
+    __atomic_store_n(&s_stop, false, __ATOMIC_RELAXED);
+    if (s_scan_task)
+    {
+        return ESP_OK;
+    }
+    if (!s_scan_lock)
+    {
+        s_scan_lock = xSemaphoreCreateMutex();
+        if (!s_scan_lock)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    if (xTaskCreate(ap_scan_task, "ap_scan", AP_SCAN_TASK_STACK_SIZE, NULL,
+                    AP_SCAN_TASK_PRIORITY, &s_scan_task) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to create scan task");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void ap_scan_pause(void)
+{
+    if (s_scan_lock)
+    {
+        xSemaphoreTake(s_scan_lock, portMAX_DELAY);
+    }
+}
+
+void ap_scan_resume(void)
+{
+    if (s_scan_lock)
+    {
+        xSemaphoreGive(s_scan_lock);
+    }
+}
+
+void ap_scan_stop(void)
+{
+    __atomic_store_n(&s_stop, true, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,56 @@
+// ap_scan.h
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+
+#define AP_SSID_MAX_LEN (32)
+
+/* One network of the scan list, the strongest BSSID seen for its SSID */
+typedef struct
+{
+    char ssid[AP_SSID_MAX_LEN + 1];
+    uint8_t bssid[6];
+    int8_t rssi;
+    uint8_t channel;
+    uint8_t authmode;   /* wifi_auth_mode_t */
+} ap_record_t;
+
+typedef struct
+{
+    uint32_t generation; /* number of scans published so far, 0 before the first one */
+    uint16_t count;
+    ap_record_t aps[CONFIG_EXAMPLE_AP_LIST_SIZE]; /* strongest first */
+} ap_snapshot_t;
+
+/* Called in the scanner task right after a new list was published. snap stays
+ * valid and unchanged until the callback returns. */
+typedef void (*ap_scan_listener_t)(const ap_snapshot_t *snap);
+
+/* Start the background scanner. Wi-Fi must already run in STA or APSTA mode.
+ * The first scan starts right away, then every CONFIG_EXAMPLE_AP_SCAN_INTERVAL_S. */
+esp_err_t ap_scan_start(void);
+
+/* Wait for a running scan to finish and hold off the next ones until
+ * ap_scan_resume(), called from the same task */
+void ap_scan_pause(void);
+void ap_scan_resume(void);
+
+/* Let the scanner task exit instead of starting its next scan. The last list stays
+ * readable; ap_scan_start() brings the scanner back. */
+void ap_scan_stop(void);
+
+/* Copy the latest published list. Never blocks: a reader that races with two
+ * consecutive publications simply retries. */
+void ap_scan_read(ap_snapshot_t *snap);
+
+/* Look a network up by SSID in the latest list */
+bool ap_scan_find(const char *ssid, ap_record_t *record);
+
+/* Most listeners ap_scan_add_listener() takes */
+#define AP_SCAN_MAX_LISTENERS (4)
+
+/* Have listener notified of every publication from now on */
+esp_err_t ap_scan_add_listener(ap_scan_listener_t listener);
@@ -0,0 +1,124 @@
+/* Memory mapped website bundle
+
+   The www partition holds a flat image produced by tools/bundle_pack.py. It is
+   mapped into the data address space once, and responses are sent straight from
+   the mapped flash: no VFS, no open()/read() and no copy into a buffer.
+*/
+#include <string.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_spi_flash.h"
+#include "asset_bundle.h"
+
+static const char *TAG = "asset_bundle";
+
+asset_bundle_t www_bundle;
+
+esp_err_t asset_bundle_open(asset_bundle_t *bundle, const void *image, size_t size)
+{
+    const bundle_header_t *header = image;
+    if (size < sizeof(bundle_header_t) || header->magic != BUNDLE_MAGIC)
+    {
+        ESP_LOGE(TAG, "No website bundle found");
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (header->version != BUNDLE_VERSION || header->entry_size != sizeof(bundle_entry_t) ||
+        header->image_size > size || header->index_offset % 4 != 0 ||
+        header->index_offset + (uint64_t)header->entry_count * sizeof(bundle_entry_t) > header->image_size)
+    {
+        ESP_LOGE(TAG, "Website bundle version %d is corrupt or incompatible", header->version);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    const bundle_entry_t *entries = (const bundle_entry_t *)((const uint8_t *)image + header->index_offset);
+    for (uint32_t i = 0; i < header->entry_count; i++)
+    {
+        const bundle_entry_t *entry = &entries[i];
+        if (entry->path_offset + (uint64_t)entry->path_len >= header->image_size)
+        {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        for (int blob = 0; blob < BUNDLE_BLOB_MAX; blob++)
+        {
+            if (entry->offset[blob] + (uint64_t)entry->size[blob] > header->image_size)
+            {
+                return ESP_ERR_INVALID_SIZE;
+            }
+        }
+    }
+    bundle->image = image;
+    bundle->size = header->image_size;
+    bundle->header = header;
+    bundle->entries = entries;
+    return ESP_OK;
+}
+
+esp_err_t asset_bundle_mount(asset_bundle_t *bundle, const char *partition_label)
+{
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                                           partition_label);
+    if (!part)
+    {
+        ESP_LOGE(TAG, "Failed to find partition %s", partition_label);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    /* Map only as much as the image needs, the MMU data window is limited */
+    bundle_header_t header;
+    esp_err_t ret = esp_partition_read(part, 0, &header, sizeof(header));
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    if (header.magic != BUNDLE_MAGIC || header.image_size > part->size)
+    {
+        ESP_LOGE(TAG, "Partition %s doesn't hold a website bundle", partition_label);
+        return ESP_ERR_NOT_FOUND;
+    }
+    const void *image;
+    spi_flash_mmap_handle_t handle;
+    ret = esp_partition_mmap(part, 0, header.image_size, SPI_FLASH_MMAP_DATA, &image, &handle);
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to map partition %s (%s)", partition_label, esp_err_to_name(ret));
+        return ret;
+    }
+    ret = asset_bundle_open(bundle, image, header.image_size);
+    if (ret != ESP_OK)
+    {
+        spi_flash_munmap(handle);
+        return ret;
+    }
+    ESP_LOGI(TAG, "Mapped %" PRIu32 " files, %zu bytes from partition %s", bundle->header->entry_count, bundle->size,
+             partition_label);
+    return ESP_OK;
+}
+
+const bundle_entry_t *asset_bundle_find(const asset_bundle_t *bundle, const char *path, size_t path_len)
+{
+    size_t lo = 0, hi = bundle->header->entry_count;
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        const bundle_entry_t *entry = &bundle->entries[mid];
+        size_t n = entry->path_len < path_len ? entry->path_len : path_len;
+        int cmp = memcmp(asset_bundle_path(bundle, entry), path, n);
+        if (cmp == 0)
+        {
+            cmp = (entry->path_len > path_len) - (entry->path_len < path_len);
+        }
+        if (cmp == 0)
+        {
+            return entry;
+        }
+        if (cmp < 0)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
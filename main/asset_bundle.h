@@ -0,0 +1,78 @@
+// asset_bundle.h
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+/* Read-only website bundle flashed to the www partition by tools/bundle_pack.py.
+ *
+ * Layout, all integers little endian, every blob 4 byte aligned:
+ *   bundle_header_t
+ *   bundle_entry_t[entry_count], sorted by path (bytewise)
+ *   path strings, NUL terminated
+ *   file blobs
+ */
+#define BUNDLE_MAGIC 0x444E4257 /* "WBND" */
+#define BUNDLE_VERSION 1
+#define BUNDLE_ETAG_LEN 16
+
+/* Blob slots of an entry: the file itself and its precompressed sidecars */
+typedef enum
+{
+    BUNDLE_BLOB_IDENTITY = 0,
+    BUNDLE_BLOB_GZIP,
+    BUNDLE_BLOB_BR,
+    BUNDLE_BLOB_MAX
+} bundle_blob_t;
+
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t entry_size;
+    uint32_t entry_count;
+    uint32_t index_offset;
+    uint32_t image_size;
+    uint32_t reserved;
+} bundle_header_t;
+
+typedef struct
+{
+    uint32_t path_offset;
+    uint16_t path_len;
+    uint16_t reserved;
+    char etag[BUNDLE_ETAG_LEN]; /* hex digits, not NUL terminated */
+    uint32_t offset[BUNDLE_BLOB_MAX];
+    uint32_t size[BUNDLE_BLOB_MAX]; /* 0 when the sidecar is absent */
+} bundle_entry_t;
+
+typedef struct
+{
+    const uint8_t *image;
+    size_t size;
+    const bundle_header_t *header;
+    const bundle_entry_t *entries;
+} asset_bundle_t;
+
+/* Bundle mapped from the www partition by init_fs() */
+extern asset_bundle_t www_bundle;
+
+/* Validate an image already in memory, no flash access */
+esp_err_t asset_bundle_open(asset_bundle_t *bundle, const void *image, size_t size);
+
+/* Map the bundle stored in the named data partition */
+esp_err_t asset_bundle_mount(asset_bundle_t *bundle, const char *partition_label);
+
+/* Find an entry by path ("/prod/index.html"), NULL if it isn't in the bundle */
+const bundle_entry_t *asset_bundle_find(const asset_bundle_t *bundle, const char *path, size_t path_len);
+
+static inline const char *asset_bundle_path(const asset_bundle_t *bundle, const bundle_entry_t *entry)
+{
+    return (const char *)bundle->image + entry->path_offset;
+}
+
+static inline const uint8_t *asset_bundle_blob(const asset_bundle_t *bundle, const bundle_entry_t *entry, bundle_blob_t blob)
+{
+    return bundle->image + entry->offset[blob];
+}
@@ -0,0 +1,67 @@
+/* Compile-time asset index lookup
+
+   The tables come from tools/gen_asset_index.py (asset_index_data.c in the build
+   directory). A two level minimal perfect hash turns the request URI into a table
+   slot without any string building or filesystem probe, one comparison confirms it.
+*/
+#include <string.h>
+#include "asset_index.h"
+
+/* Seeded FNV-1a, must stay in sync with fnv() in tools/gen_asset_index.py. The final
+   shift folds the high bits down: the low bits of plain FNV-1a only depend on the low
+   bits of the input bytes, which leaves small tables without a perfect hash seed. */
+static uint32_t asset_index_hash(const char *data, size_t len, uint32_t seed)
+{
+    uint32_t hash = 2166136261u ^ seed;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash = (hash ^ (uint8_t)data[i]) * 16777619u;
+    }
+    return hash ^ (hash >> 16);
+}
+
+const asset_site_t *asset_index_site(const char *base_path)
+{
+    const char *name = strrchr(base_path, '/');
+    name = name ? name + 1 : base_path;
+    for (size_t i = 0; i < asset_site_count; i++)
+    {
+        if (asset_sites[i].count > 0 && strcmp(asset_sites[i].name, name) == 0)
+        {
+            return &asset_sites[i];
+        }
+    }
+    return NULL;
+}
+
+const asset_index_entry_t *asset_index_lookup(const asset_site_t *site, const char *uri, size_t uri_len)
+{
+    uint32_t bucket = asset_index_hash(uri, uri_len, 0) % site->bucket_count;
+    uint32_t slot = asset_index_hash(uri, uri_len, site->seeds[bucket]) % site->count;
+    const asset_index_entry_t *entry = &site->entries[slot];
+    if (entry->uri_len == uri_len && memcmp(entry->uri, uri, uri_len) == 0)
+    {
+        return entry;
+    }
+    return NULL;
+}
+
+bool asset_index_matches(const asset_site_t *site, const asset_manifest_t *manifest)
+{
+    if (!manifest)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < site->count; i++)
+    {
+        const asset_index_entry_t *entry = &site->entries[i];
+        const asset_entry_t *asset = asset_manifest_find(manifest, entry->uri, entry->uri_len);
+        /* The identity tag is the quoted manifest hash */
+        if (!asset || asset->codings != entry->codings ||
+            strncmp(entry->rep[ASSET_REP_IDENTITY].etag + 1, asset->etag, ASSET_ETAG_LEN) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,59 @@
+// asset_index.h
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "asset_manifest.h"
+
+/* Compile-time index of the website files, generated by tools/gen_asset_index.py */
+
+/* Representation slots of an entry */
+typedef enum
+{
+    ASSET_REP_IDENTITY = 0,
+    ASSET_REP_GZIP,
+    ASSET_REP_BR,
+    ASSET_REP_MAX
+} asset_rep_slot_t;
+
+typedef struct
+{
+    const char *path; /* file relative to the site root, NULL if the representation doesn't exist */
+    uint32_t size;
+    const char *etag; /* quoted entity tag */
+    const char *head; /* complete "HTTP/1.1 200 OK" response head incl. Content-Length */
+    uint16_t head_len;
+} asset_rep_t;
+
+typedef struct
+{
+    const char *uri;
+    uint16_t uri_len;
+    const char *content_type;
+    const char *cache_control;
+    uint8_t codings; /* ASSET_CODING_* sidecars */
+    asset_rep_t rep[ASSET_REP_MAX];
+} asset_index_entry_t;
+
+typedef struct
+{
+    const char *name; /* directory below the mount point, e.g. "prod" */
+    const asset_index_entry_t *entries;
+    uint16_t count;
+    const uint16_t *seeds;
+    uint16_t bucket_count;
+    int16_t fallback; /* entry served for extension-less SPA routes, -1 if none */
+} asset_site_t;
+
+extern const asset_site_t asset_sites[];
+extern const size_t asset_site_count;
+
+/* Indexed site served from base_path ("/www/prod" -> "prod"), NULL if the build didn't index it */
+const asset_site_t *asset_index_site(const char *base_path);
+
+/* Look a URI path up in O(1), NULL if the site has no such file */
+const asset_index_entry_t *asset_index_lookup(const asset_site_t *site, const char *uri, size_t uri_len);
+
+/* Whether every file the build indexed is listed in manifest with the same hash and
+ * sidecars, i.e. the files on the filesystem are the ones the build saw */
+bool asset_index_matches(const asset_site_t *site, const asset_manifest_t *manifest);
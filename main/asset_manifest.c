@@ -0,0 +1,185 @@
+/* Build-time asset manifest
+
+   Each dist folder carries asset-manifest.txt generated by tools/asset_manifest.cmake,
+   one line per file:  <etag> <codings> <path>
+   where <codings> is "-" or a comma separated list of "gz"/"br" sidecars.
+   The manifest is read once when the server starts so conditional GETs can be
+   answered without touching the filesystem.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "esp_log.h"
+#include "esp_vfs.h"
+#include "asset_manifest.h"
+
+#define MANIFEST_LINE_MAX (ESP_VFS_PATH_MAX + 128)
+
+static const char *TAG = "asset_manifest";
+
+struct asset_manifest
+{
+    size_t count;
+    asset_entry_t *entries; /* sorted by path */
+    char *paths;            /* storage for all entry paths */
+};
+
+static int entry_cmp(const void *a, const void *b)
+{
+    return strcmp(((const asset_entry_t *)a)->path, ((const asset_entry_t *)b)->path);
+}
+
+static bool parse_line(char *line, asset_entry_t *entry, char **path)
+{
+    char *etag = strtok(line, " ");
+    char *codings = strtok(NULL, " ");
+    char *p = strtok(NULL, "\r\n");
+    if (!etag || !codings || !p || strlen(etag) != ASSET_ETAG_LEN || p[0] != '/')
+    {
+        return false;
+    }
+    strlcpy(entry->etag, etag, sizeof(entry->etag));
+    entry->codings = 0;
+    if (strstr(codings, "gz"))
+    {
+        entry->codings |= ASSET_CODING_GZIP;
+    }
+    if (strstr(codings, "br"))
+    {
+        entry->codings |= ASSET_CODING_BR;
+    }
+    *path = p;
+    return true;
+}
+
+asset_manifest_t *asset_manifest_load(const char *base_path)
+{
+    char line[MANIFEST_LINE_MAX];
+    strlcpy(line, base_path, sizeof(line));
+    strlcat(line, ASSET_MANIFEST_FILE, sizeof(line));
+    FILE *fd = fopen(line, "r");
+    if (!fd)
+    {
+        ESP_LOGW(TAG, "No manifest at %s, conditional GET disabled", line);
+        return NULL;
+    }
+
+    /* First pass sizes the tables, second pass fills them */
+    size_t count = 0, paths_size = 0;
+    asset_entry_t entry;
+    char *path;
+    while (fgets(line, sizeof(line), fd))
+    {
+        if (parse_line(line, &entry, &path))
+        {
+            count++;
+            paths_size += strlen(path) + 1;
+        }
+    }
+
+    asset_manifest_t *manifest = calloc(1, sizeof(asset_manifest_t));
+    if (manifest)
+    {
+        manifest->entries = calloc(count ? count : 1, sizeof(asset_entry_t));
+        manifest->paths = malloc(paths_size ? paths_size : 1);
+    }
+    if (!manifest || !manifest->entries || !manifest->paths)
+    {
+        ESP_LOGE(TAG, "No memory for %zu manifest entries", count);
+        fclose(fd);
+        asset_manifest_free(manifest);
+        return NULL;
+    }
+
+    rewind(fd);
+    char *dst = manifest->paths;
+    while (manifest->count < count && fgets(line, sizeof(line), fd))
+    {
+        if (parse_line(line, &entry, &path))
+        {
+            size_t len = strlen(path) + 1;
+            memcpy(dst, path, len);
+            entry.path = dst;
+            dst += len;
+            manifest->entries[manifest->count++] = entry;
+        }
+    }
+    fclose(fd);
+
+    qsort(manifest->entries, manifest->count, sizeof(asset_entry_t), entry_cmp);
+    ESP_LOGI(TAG, "Loaded %zu assets from %s", manifest->count, base_path);
+    return manifest;
+}
+
+void asset_manifest_free(asset_manifest_t *manifest)
+{
+    if (manifest)
+    {
+        free(manifest->entries);
+        free(manifest->paths);
+        free(manifest);
+    }
+}
+
+const asset_entry_t *asset_manifest_find(const asset_manifest_t *manifest, const char *path, size_t path_len)
+{
+    if (!manifest)
+    {
+        return NULL;
+    }
+    size_t lo = 0, hi = manifest->count;
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        const char *candidate = manifest->entries[mid].path;
+        int cmp = strncmp(candidate, path, path_len);
+        if (cmp == 0 && candidate[path_len] != '\0')
+        {
+            cmp = 1;
+        }
+        if (cmp == 0)
+        {
+            return &manifest->entries[mid];
+        }
+        if (cmp < 0)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+bool asset_path_is_hashed(const char *path, size_t path_len)
+{
+    /* Look for ".xxxxxxxx." right before the extension */
+    const char *ext = NULL;
+    for (const char *p = path + path_len; p > path; p--)
+    {
+        if (p[-1] == '/')
+        {
+            break;
+        }
+        if (p[-1] == '.')
+        {
+            ext = p - 1;
+            break;
+        }
+    }
+    if (!ext || ext - path < 9 || ext[-9] != '.')
+    {
+        return false;
+    }
+    for (const char *p = ext - 8; p < ext; p++)
+    {
+        if (!isxdigit((unsigned char)*p))
+        {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,33 @@
+// asset_manifest.h
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Name of the manifest written into every dist folder by the build (see main/CMakeLists.txt) */
+#define ASSET_MANIFEST_FILE "/asset-manifest.txt"
+#define ASSET_ETAG_LEN 16
+
+/* Precompressed sidecars recorded for an asset */
+#define ASSET_CODING_GZIP (1 << 0)
+#define ASSET_CODING_BR (1 << 1)
+
+typedef struct
+{
+    const char *path;               /* URI path relative to the site root, e.g. "/js/app.1a2b3c4d.js" */
+    char etag[ASSET_ETAG_LEN + 1];  /* truncated SHA-256 of the uncompressed file */
+    uint8_t codings;                /* ASSET_CODING_* bits */
+} asset_entry_t;
+
+typedef struct asset_manifest asset_manifest_t;
+
+/* Load <base_path>/asset-manifest.txt, returns NULL if the site has none */
+asset_manifest_t *asset_manifest_load(const char *base_path);
+void asset_manifest_free(asset_manifest_t *manifest);
+
+/* Find the entry for a URI path of the given length, NULL if the asset is unknown */
+const asset_entry_t *asset_manifest_find(const asset_manifest_t *manifest, const char *path, size_t path_len);
+
+/* Vue CLI names long-term cacheable files as <name>.<8 hex digits>.<ext> */
+bool asset_path_is_hashed(const char *path, size_t path_len);
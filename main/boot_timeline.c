@@ -0,0 +1,90 @@
+/* Boot timeline
+
+   app_main runs the boot phases as concurrent tasks; each one records when it
+   started and finished so cold-start-to-first-byte can be measured and shrunk.
+   The timeline is logged once the site is up and served as JSON by the REST server.
+*/
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "boot_timeline.h"
+
+static const char *TAG = "boot";
+
+static const char *const s_phase_names[BOOT_PHASE_COUNT] = {
+    [BOOT_PHASE_NVS] = "nvs",
+    [BOOT_PHASE_NETIF] = "netif",
+    [BOOT_PHASE_HTTP_SERVER] = "http_server",
+    [BOOT_PHASE_NAME_SERVICES] = "name_services",
+    [BOOT_PHASE_FS_MOUNT] = "fs_mount",
+    [BOOT_PHASE_WIFI_DRIVER] = "wifi_driver",
+    [BOOT_PHASE_CREDENTIALS] = "credentials",
+    [BOOT_PHASE_WIFI_CONNECT] = "wifi_connect",
+    [BOOT_PHASE_SOFTAP] = "softap",
+    [BOOT_PHASE_SITE_READY] = "site_ready",
+    [BOOT_PHASE_FIRST_RESPONSE] = "first_response",
+};
+
+static boot_phase_record_t s_timeline[BOOT_PHASE_COUNT];
+static uint32_t s_marked; /* bit per phase already recorded by boot_phase_mark() */
+
+void boot_phase_begin(boot_phase_t phase)
+{
+    s_timeline[phase].start_us = esp_timer_get_time();
+}
+
+void boot_phase_end(boot_phase_t phase)
+{
+    s_timeline[phase].end_us = esp_timer_get_time();
+    ESP_LOGD(TAG, "%s took %" PRId64 " ms", s_phase_names[phase],
+             (s_timeline[phase].end_us - s_timeline[phase].start_us) / 1000);
+}
+
+void boot_phase_mark(boot_phase_t phase)
+{
+    uint32_t bit = 1u << phase;
+    if (__atomic_load_n(&s_marked, __ATOMIC_RELAXED) & bit ||
+        __atomic_fetch_or(&s_marked, bit, __ATOMIC_RELAXED) & bit)
+    {
+        return;
+    }
+    s_timeline[phase].start_us = s_timeline[phase].end_us = esp_timer_get_time();
+    ESP_LOGI(TAG, "%s at %" PRId64 " ms", s_phase_names[phase], s_timeline[phase].end_us / 1000);
+}
+
+const char *boot_phase_name(boot_phase_t phase)
+{
+    return s_phase_names[phase];
+}
+
+const boot_phase_record_t *boot_timeline_get(void)
+{
+    return s_timeline;
+}
+
+void boot_timeline_log(void)
+{
+    uint8_t order[BOOT_PHASE_COUNT];
+    int count = 0;
+
+    for (int i = 0; i < BOOT_PHASE_COUNT; i++)
+    {
+        if (!s_timeline[i].end_us)
+        {
+            continue;
+        }
+        int pos = count++;
+        while (pos > 0 && s_timeline[order[pos - 1]].start_us > s_timeline[i].start_us)
+        {
+            order[pos] = order[pos - 1];
+            pos--;
+        }
+        order[pos] = i;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        const boot_phase_record_t *rec = &s_timeline[order[i]];
+        ESP_LOGI(TAG, "%-14s %6" PRId64 " .. %6" PRId64 " ms", s_phase_names[order[i]],
+                 rec->start_us / 1000, rec->end_us / 1000);
+    }
+}
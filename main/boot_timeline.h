@@ -0,0 +1,40 @@
+// boot_timeline.h
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef enum
+{
+    BOOT_PHASE_NVS,
+    BOOT_PHASE_NETIF,
+    BOOT_PHASE_HTTP_SERVER,
+    BOOT_PHASE_NAME_SERVICES, /* mDNS and NetBIOS */
+    BOOT_PHASE_FS_MOUNT,
+    BOOT_PHASE_WIFI_DRIVER,
+    BOOT_PHASE_CREDENTIALS,
+    BOOT_PHASE_WIFI_CONNECT,
+    BOOT_PHASE_SOFTAP,
+    BOOT_PHASE_SITE_READY,    /* static files can be served */
+    BOOT_PHASE_FIRST_RESPONSE,
+    BOOT_PHASE_COUNT
+} boot_phase_t;
+
+typedef struct
+{
+    int64_t start_us; /* since boot, 0 if the phase didn't run (yet) */
+    int64_t end_us;
+} boot_phase_record_t;
+
+/* Phases may run concurrently in different tasks, each one records only its own slot */
+void boot_phase_begin(boot_phase_t phase);
+void boot_phase_end(boot_phase_t phase);
+
+/* Zero-length phase, only the first call counts */
+void boot_phase_mark(boot_phase_t phase);
+
+const char *boot_phase_name(boot_phase_t phase);
+const boot_phase_record_t *boot_timeline_get(void);
+
+/* Log every finished phase ordered by start time */
+void boot_timeline_log(void);
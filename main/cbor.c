@@ -0,0 +1,192 @@
+/* Minimal CBOR decoder for request bodies
+
+   Enough of RFC 8949 to read the flat maps the API accepts: the document is walked
+   in place, every item of an unknown key is skipped (including nested containers
+   and indefinite lengths) and only integers and definite text strings are handed
+   out. Nothing is allocated, strings point into the request buffer.
+*/
+#include <string.h>
+#include "cbor.h"
+
+/* Containers nested deeper than this inside a skipped value make the document invalid */
+#define CBOR_MAX_DEPTH (8)
+
+typedef struct
+{
+    const uint8_t *pos;
+    const uint8_t *end;
+} cbor_reader_t;
+
+static bool cbor_read_head(cbor_reader_t *r, cbor_item_t *item)
+{
+    if (r->pos >= r->end)
+    {
+        return false;
+    }
+    uint8_t initial = *r->pos++;
+    uint8_t info = initial & 0x1f;
+    item->major = initial >> 5;
+    item->indefinite = false;
+    item->value = info;
+    item->data = NULL;
+
+    if (info == CBOR_INDEFINITE)
+    {
+        /* Break (major 7) or the start of an indefinite string or container */
+        item->indefinite = true;
+        return item->major != CBOR_MAJOR_UINT && item->major != CBOR_MAJOR_NEGINT &&
+               item->major != CBOR_MAJOR_TAG;
+    }
+    if (info >= 24)
+    {
+        if (info > 27)
+        {
+            return false; /* reserved */
+        }
+        size_t n = 1u << (info - 24);
+        if (r->end - r->pos < n)
+        {
+            return false;
+        }
+        item->value = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            item->value = item->value << 8 | *r->pos++;
+        }
+    }
+    if (item->major == CBOR_MAJOR_BYTES || item->major == CBOR_MAJOR_TEXT)
+    {
+        if (r->end - r->pos < item->value)
+        {
+            return false;
+        }
+        item->data = r->pos;
+        r->pos += item->value;
+    }
+    return true;
+}
+
+static bool cbor_is_break(const cbor_item_t *item)
+{
+    return item->major == CBOR_MAJOR_SIMPLE && item->indefinite;
+}
+
+/* Skip the rest of an item whose head has been read */
+static bool cbor_skip_body(cbor_reader_t *r, const cbor_item_t *item, int depth)
+{
+    cbor_item_t child;
+
+    if (cbor_is_break(item) || depth > CBOR_MAX_DEPTH)
+    {
+        return false;
+    }
+    switch (item->major)
+    {
+    case CBOR_MAJOR_BYTES:
+    case CBOR_MAJOR_TEXT:
+        /* An indefinite string is a series of definite chunks */
+        while (item->indefinite)
+        {
+            if (!cbor_read_head(r, &child))
+            {
+                return false;
+            }
+            if (cbor_is_break(&child))
+            {
+                break;
+            }
+            if (child.major != item->major || child.indefinite)
+            {
+                return false;
+            }
+        }
+        return true;
+    case CBOR_MAJOR_ARRAY:
+    case CBOR_MAJOR_MAP:
+    {
+        uint64_t count = item->major == CBOR_MAJOR_MAP ? item->value * 2 : item->value;
+        for (uint64_t i = 0; item->indefinite || i < count; i++)
+        {
+            if (!cbor_read_head(r, &child))
+            {
+                return false;
+            }
+            if (item->indefinite && cbor_is_break(&child))
+            {
+                /* A map needs a value for every key */
+                return item->major != CBOR_MAJOR_MAP || i % 2 == 0;
+            }
+            if (!cbor_skip_body(r, &child, depth + 1))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    case CBOR_MAJOR_TAG:
+        return cbor_read_head(r, &child) && cbor_skip_body(r, &child, depth + 1);
+    default:
+        return true;
+    }
+}
+
+bool cbor_map_get(const uint8_t *doc, size_t len, const char *key, cbor_item_t *item)
+{
+    cbor_reader_t r = {.pos = doc, .end = doc + len};
+    cbor_item_t map;
+    size_t key_len = strlen(key);
+
+    if (!cbor_read_head(&r, &map) || map.major != CBOR_MAJOR_MAP)
+    {
+        return false;
+    }
+    for (uint64_t i = 0; map.indefinite || i < map.value; i++)
+    {
+        cbor_item_t k;
+        if (!cbor_read_head(&r, &k) || (map.indefinite && cbor_is_break(&k)))
+        {
+            return false;
+        }
+        bool match = k.major == CBOR_MAJOR_TEXT && !k.indefinite && k.value == key_len &&
+                     !memcmp(k.data, key, key_len);
+        if (!cbor_skip_body(&r, &k, 1) || !cbor_read_head(&r, item))
+        {
+            return false;
+        }
+        if (match)
+        {
+            return !cbor_is_break(item);
+        }
+        if (!cbor_skip_body(&r, item, 1))
+        {
+            return false;
+        }
+    }
+    return false;
+}
+
+bool cbor_item_int(const cbor_item_t *item, int32_t *value)
+{
+    if (item->major == CBOR_MAJOR_UINT && item->value <= INT32_MAX)
+    {
+        *value = item->value;
+        return true;
+    }
+    if (item->major == CBOR_MAJOR_NEGINT && item->value <= INT32_MAX)
+    {
+        *value = -1 - (int32_t)item->value;
+        return true;
+    }
+    return false;
+}
+
+bool cbor_item_text(const cbor_item_t *item, char *buf, size_t size)
+{
+    if (item->major != CBOR_MAJOR_TEXT || item->indefinite || item->value >= size)
+    {
+        return false;
+    }
+    memcpy(buf, item->data, item->value);
+    buf[item->value] = '\0';
+    return true;
+}
@@ -0,0 +1,42 @@
+// cbor.h
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Major types and simple values of RFC 8949 */
+#define CBOR_MAJOR_UINT (0)
+#define CBOR_MAJOR_NEGINT (1)
+#define CBOR_MAJOR_BYTES (2)
+#define CBOR_MAJOR_TEXT (3)
+#define CBOR_MAJOR_ARRAY (4)
+#define CBOR_MAJOR_MAP (5)
+#define CBOR_MAJOR_TAG (6)
+#define CBOR_MAJOR_SIMPLE (7)
+
+#define CBOR_INDEFINITE (31)
+#define CBOR_FALSE (0xf4)
+#define CBOR_TRUE (0xf5)
+#define CBOR_NULL (0xf6)
+#define CBOR_BREAK (0xff)
+
+/* One decoded data item. Strings point into the document and aren't terminated. */
+typedef struct
+{
+    uint8_t major;
+    bool indefinite;     /* strings, arrays and maps of unknown length */
+    uint64_t value;      /* integer argument: the number, a length or a count */
+    const uint8_t *data; /* definite strings: their bytes */
+} cbor_item_t;
+
+/* Look up a text key in the map that makes up the whole document. Values of any
+ * type are skipped over, nesting up to a few levels. False if the document isn't
+ * a well-formed map or doesn't have the key. */
+bool cbor_map_get(const uint8_t *doc, size_t len, const char *key, cbor_item_t *item);
+
+/* Integer value that fits an int32_t */
+bool cbor_item_int(const cbor_item_t *item, int32_t *value);
+
+/* Copy a definite text string into buf and terminate it, false if it doesn't fit */
+bool cbor_item_text(const cbor_item_t *item, char *buf, size_t size);
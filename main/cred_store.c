@@ -0,0 +1,169 @@
+/* Station credential store
+
+   The SSID and password the provisioning page posts live in NVS as one fixed
+   size binary record, so boot reads them with a single nvs_get_blob before the
+   SD card is even mounted, and an update is one NVS write that a power loss
+   can't tear. credentials.txt on the card is kept as an exchange format only:
+   it is imported while NVS is still empty and, with EXAMPLE_CRED_EXPORT_SD,
+   rewritten after every update.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "nvs.h"
+#include "cJSON.h"
+#include "json_stream.h"
+#include "cred_store.h"
+
+#define CRED_STORE_NVS_NAMESPACE "cred"
+#define CRED_STORE_NVS_KEY "sta"
+#define CRED_STORE_VERSION (1)
+/* Largest credentials.txt imported */
+#define CRED_FILE_MAX (512)
+#define CRED_TMP_SUFFIX ".tmp"
+
+static const char *TAG = "cred_store";
+
+esp_err_t cred_store_load(cred_record_t *cred)
+{
+    nvs_handle_t nvs;
+    size_t len = sizeof(*cred);
+
+    esp_err_t err = nvs_open(CRED_STORE_NVS_NAMESPACE, NVS_READONLY, &nvs);
+    if (err != ESP_OK)
+    {
+        return err == ESP_ERR_NVS_NOT_FOUND ? ESP_ERR_NOT_FOUND : err;
+    }
+    err = nvs_get_blob(nvs, CRED_STORE_NVS_KEY, cred, &len);
+    nvs_close(nvs);
+    if (err == ESP_ERR_NVS_NOT_FOUND)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    if (len != sizeof(*cred) || cred->version != CRED_STORE_VERSION || !cred->ssid[0])
+    {
+        ESP_LOGW(TAG, "Ignoring stored credentials of version %u, %zu bytes", cred->version, len);
+        return ESP_ERR_NOT_FOUND;
+    }
+    /* Terminated whatever was stored */
+    cred->ssid[sizeof(cred->ssid) - 1] = '\0';
+    cred->password[sizeof(cred->password) - 1] = '\0';
+    return ESP_OK;
+}
+
+esp_err_t cred_store_save(const char *ssid, const char *password)
+{
+    cred_record_t cred = {.version = CRED_STORE_VERSION};
+    nvs_handle_t nvs;
+
+    if (!ssid[0] || strlen(ssid) >= sizeof(cred.ssid) || strlen(password) >= sizeof(cred.password))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    strlcpy(cred.ssid, ssid, sizeof(cred.ssid));
+    strlcpy(cred.password, password, sizeof(cred.password));
+
+    esp_err_t err = nvs_open(CRED_STORE_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
+        return err;
+    }
+    err = nvs_set_blob(nvs, CRED_STORE_NVS_KEY, &cred, sizeof(cred));
+    if (err == ESP_OK)
+    {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to store credentials: %s", esp_err_to_name(err));
+        return err;
+    }
+    ESP_LOGI(TAG, "Stored credentials for %s", ssid);
+    return ESP_OK;
+}
+
+esp_err_t cred_store_import(const char *path, cred_record_t *cred)
+{
+    char buf[CRED_FILE_MAX];
+    FILE *f = fopen(path, "r");
+    if (!f)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    size_t len = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[len] = '\0';
+
+    cJSON *root = cJSON_Parse(buf);
+    cJSON *ssid_json = cJSON_GetObjectItemCaseSensitive(root, "ssid");
+    cJSON *pass_json = cJSON_GetObjectItemCaseSensitive(root, "password");
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    if (cJSON_IsString(ssid_json) && cJSON_IsString(pass_json))
+    {
+        err = cred_store_save(ssid_json->valuestring, pass_json->valuestring);
+    }
+    cJSON_Delete(root);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "%s isn't valid, not imported", path);
+        return err;
+    }
+    ESP_LOGI(TAG, "Imported %s", path);
+    return cred_store_load(cred);
+}
+
+static esp_err_t file_sink(json_stream_t *js, const char *data, size_t len, bool last)
+{
+    return fwrite(data, 1, len, js->ctx) == len ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t cred_store_export(const char *path)
+{
+    cred_record_t cred;
+    char tmp[64];
+    char buf[128];
+    json_stream_t js;
+
+    esp_err_t err = cred_store_load(&cred);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    if (snprintf(tmp, sizeof(tmp), "%s" CRED_TMP_SUFFIX, path) >= sizeof(tmp))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    FILE *f = fopen(tmp, "w");
+    if (!f)
+    {
+        ESP_LOGE(TAG, "Failed to create %s", tmp);
+        return ESP_FAIL;
+    }
+    json_stream_init(&js, buf, sizeof(buf), file_sink, f);
+    json_stream_obj_begin(&js, NULL);
+    json_stream_str(&js, "ssid", cred.ssid);
+    json_stream_str(&js, "password", cred.password);
+    json_stream_obj_end(&js);
+    err = json_stream_finish(&js);
+    if (err == ESP_OK && (fflush(f) != 0 || fsync(fileno(f)) != 0))
+    {
+        err = ESP_FAIL;
+    }
+    fclose(f);
+    /* FAT can't rename over an existing file; until the rename the complete
+       copy is in the temporary file and NVS stays the reference anyway */
+    if (err != ESP_OK || (unlink(path) != 0 && access(path, F_OK) == 0) || rename(tmp, path) != 0)
+    {
+        ESP_LOGE(TAG, "Failed to export credentials to %s", path);
+        unlink(tmp);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
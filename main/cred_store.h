@@ -0,0 +1,34 @@
+// cred_store.h
+#pragma once
+
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "ap_scan.h"
+
+/* wifi_sta_config_t.password */
+#define CRED_PASSWORD_MAX_LEN (64)
+/* Import/export format on the card: {"ssid":"...","password":"..."} */
+#define CRED_STORE_FILE CONFIG_EXAMPLE_WEB_MOUNT_POINT "/credentials.txt"
+
+/* Station credentials as stored in NVS, one fixed size blob */
+typedef struct
+{
+    uint16_t version;
+    char ssid[AP_SSID_MAX_LEN + 1];
+    char password[CRED_PASSWORD_MAX_LEN + 1];
+} cred_record_t;
+
+/* ESP_ERR_NOT_FOUND if nothing (or an incompatible record) is stored */
+esp_err_t cred_store_load(cred_record_t *cred);
+
+/* Replace the stored credentials. NVS writes the blob atomically: after a power
+ * loss the old or the new record is found, never a mix. */
+esp_err_t cred_store_save(const char *ssid, const char *password);
+
+/* Take a credentials.txt over into NVS and return what was stored */
+esp_err_t cred_store_import(const char *path, cred_record_t *cred);
+
+/* Write the stored credentials to path as credentials.txt JSON: into a temporary
+ * file first, synced, then renamed over path */
+esp_err_t cred_store_export(const char *path);
@@ -8,6 +8,9 @@
 */
 
 #include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
 #include "driver/gpio.h"
 #include "esp_vfs_semihost.h"
 #include "esp_vfs_fat.h"
@@ -21,15 +24,29 @@
 #include "lwip/apps/netbiosns.h"
 #include "protocol_examples_common.h"
 #include "wifi.h"
-#include "cJSON.h"
+#include "cred_store.h"
+#include "provision.h"
+#include "json_bench.h"
+#include "boot_timeline.h"
 #if CONFIG_EXAMPLE_WEB_DEPLOY_SD
 #include "driver/sdmmc_host.h"
 #endif
+#if CONFIG_EXAMPLE_WEB_DEPLOY_BUNDLE
+#include "asset_bundle.h"
+#endif
 
 #define MDNS_INSTANCE "esp home web server"
 static const char *TAG = "example";
 
 esp_err_t start_rest_server(const char *base_path);
+esp_err_t rest_server_set_base_path(const char *base_path);
+
+#define BOOT_TASK_STACK_SIZE (4096)
+#define BOOT_TASK_PRIORITY (5)
+#define BOOT_FS_DONE (1 << 0)
+
+static EventGroupHandle_t s_boot_events;
+static esp_err_t s_fs_result;
 
 static void initialise_mdns(void)
 {
@@ -41,8 +58,14 @@ static void initialise_mdns(void)
         {"board", "esp32"},
         {"path", "/"}};
 
+#if CONFIG_EXAMPLE_HTTPS
+    /* Port 80 at most redirects, the site itself is only served over TLS */
+    ESP_ERROR_CHECK(mdns_service_add("ESP32-WebServer", "_https", "_tcp", CONFIG_EXAMPLE_HTTPS_PORT, serviceTxtData,
+                                     sizeof(serviceTxtData) / sizeof(serviceTxtData[0])));
+#else
     ESP_ERROR_CHECK(mdns_service_add("ESP32-WebServer", "_http", "_tcp", 80, serviceTxtData,
                                      sizeof(serviceTxtData) / sizeof(serviceTxtData[0])));
+#endif
 }
 
 #if CONFIG_EXAMPLE_WEB_DEPLOY_SD
@@ -117,79 +140,132 @@ esp_err_t init_fs(void)
     }
     else
     {
-        ESP_LOGI(TAG, "Partition size: total: %d, used: %d", total, used);
+        ESP_LOGI(TAG, "Partition size: total: %zu, used: %zu", total, used);
     }
     return ESP_OK;
 }
 #endif
 
+#if CONFIG_EXAMPLE_WEB_DEPLOY_BUNDLE
+/* The site is served from the mapped bundle, there is no filesystem to mount */
+esp_err_t init_fs(void)
+{
+    return asset_bundle_mount(&www_bundle, "www");
+}
+#endif
+
 void scan_and_start_softAP(void)
 {
-    wifi_station_deinit();
-    wifi_scan();
     wifi_station_deinit();
     wifi_init_softap();
 }
 
-void app_main(void)
+static void boot_name_services_task(void *arg)
 {
-    ESP_ERROR_CHECK(nvs_flash_init());
-    ESP_ERROR_CHECK(esp_netif_init());
-    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    boot_phase_begin(BOOT_PHASE_NAME_SERVICES);
     initialise_mdns();
     netbiosns_init();
     netbiosns_set_name(CONFIG_EXAMPLE_MDNS_HOST_NAME);
-    ESP_ERROR_CHECK(init_fs());
-
-    //read name of wifi and password from credentials.txt and try to connect to wifi AP (router)
-    FILE *fd = NULL;
-    esp_err_t result = ESP_OK;
-    char file_buf[1024];
-    size_t chunksize = 0;
-    fd = fopen("/www/credentials.txt", "r");
-    if (!fd)
+    boot_phase_end(BOOT_PHASE_NAME_SERVICES);
+    vTaskDelete(NULL);
+}
+
+static void boot_fs_task(void *arg)
+{
+    boot_phase_begin(BOOT_PHASE_FS_MOUNT);
+    s_fs_result = init_fs();
+    boot_phase_end(BOOT_PHASE_FS_MOUNT);
+    xEventGroupSetBits(s_boot_events, BOOT_FS_DONE);
+    vTaskDelete(NULL);
+}
+
+static void boot_start_task(TaskFunction_t task, const char *name)
+{
+    if (xTaskCreate(task, name, BOOT_TASK_STACK_SIZE, NULL, BOOT_TASK_PRIORITY, NULL) != pdPASS)
     {
-        ESP_LOGE(TAG, "Failed to open credentials.txt");
-        result = ESP_FAIL;
+        ESP_LOGE(TAG, "Failed to create %s task", name);
+        ESP_ERROR_CHECK(ESP_ERR_NO_MEM);
     }
-    else
+}
+
+/* The filesystem is mounted in parallel with the Wi-Fi driver init */
+static void boot_wait_fs(void)
+{
+    xEventGroupWaitBits(s_boot_events, BOOT_FS_DONE, pdFALSE, pdTRUE, portMAX_DELAY);
+    ESP_ERROR_CHECK(s_fs_result);
+}
+
+void app_main(void)
+{
+    /* Boot pipeline: NVS and netif first, then name services, filesystem mount and
+     * Wi-Fi driver init run concurrently while the HTTP server already accepts
+     * connections (static files get 503 until the site is picked) */
+    boot_phase_begin(BOOT_PHASE_NVS);
+    ESP_ERROR_CHECK(nvs_flash_init());
+    boot_phase_end(BOOT_PHASE_NVS);
+    boot_phase_begin(BOOT_PHASE_NETIF);
+    ESP_ERROR_CHECK(esp_netif_init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    boot_phase_end(BOOT_PHASE_NETIF);
+
+    s_boot_events = xEventGroupCreate();
+    boot_start_task(boot_fs_task, "boot_fs");
+    boot_start_task(boot_name_services_task, "boot_names");
+
+#if CONFIG_EXAMPLE_JSON_BENCH
+    /* Swaps the cJSON hooks, so it has to be done before the server installs the
+     * request arena ones */
+    json_bench_run();
+#endif
+    boot_phase_begin(BOOT_PHASE_HTTP_SERVER);
+    ESP_ERROR_CHECK(start_rest_server(NULL));
+    boot_phase_end(BOOT_PHASE_HTTP_SERVER);
+
+    boot_phase_begin(BOOT_PHASE_WIFI_DRIVER);
+    wifi_prepare_sta();
+    boot_phase_end(BOOT_PHASE_WIFI_DRIVER);
+
+    /* Credentials come from NVS, so connecting doesn't wait for the card. It is only
+     * needed here once, to take an old credentials.txt over into NVS */
+    boot_phase_begin(BOOT_PHASE_CREDENTIALS);
+    static cred_record_t cred;
+    esp_err_t result = cred_store_load(&cred);
+#if !CONFIG_EXAMPLE_WEB_DEPLOY_BUNDLE
+    if (result == ESP_ERR_NOT_FOUND)
     {
-        chunksize = fread(file_buf, 1, 1024, fd);
-        if (chunksize == 0)
-        {
-            ESP_LOGE(TAG, "Failed to read credentials.txt");
-            result = ESP_FAIL;
-        }
+        boot_wait_fs();
+        result = cred_store_import(CRED_STORE_FILE, &cred);
     }
-    ESP_ERROR_CHECK(result);
-    ESP_LOGI(TAG, "Read from SD (credentials.txt) %s, size %d", file_buf, chunksize);
-    cJSON *root = cJSON_Parse(file_buf);
-    cJSON *ssid_json = cJSON_GetObjectItemCaseSensitive(root, "ssid");
-    cJSON *pass_json = cJSON_GetObjectItemCaseSensitive(root, "password");
-    if (!cJSON_IsString(ssid_json) && (ssid_json->valuestring == NULL))
+#endif
+    boot_phase_end(BOOT_PHASE_CREDENTIALS);
+
+    if (result == ESP_OK)
     {
-        ESP_LOGE(TAG, "SD Card JSON isn't valid. ssid field error.");
-        result = ESP_FAIL;
+        ssid = cred.ssid;
+        password = cred.password;
+        boot_phase_begin(BOOT_PHASE_WIFI_CONNECT);
+        result = wifi_init_sta(ssid, password);
+        boot_phase_end(BOOT_PHASE_WIFI_CONNECT);
     }
-    else if (!cJSON_IsString(pass_json) && (pass_json->valuestring == NULL))
+    else
     {
-        ESP_LOGE(TAG, "SD Card JSON isn't valid. password field error.");
-        result = ESP_FAIL;
+        ESP_LOGW(TAG, "No stored credentials");
     }
-    ESP_ERROR_CHECK(result);
-    ssid = ssid_json->valuestring;
-    password = pass_json->valuestring;
-
-    if (wifi_init_sta(ssid, password) == ESP_OK)
+    boot_wait_fs();
+    if (result == ESP_OK)
     {
         ESP_LOGI(TAG, "Connected to WiFi in Station mode");
-        ESP_ERROR_CHECK(start_rest_server("/www/prod"));
+        ESP_ERROR_CHECK(rest_server_set_base_path("/www/prod"));
     }
     else
     {
         ESP_LOGE(TAG, "Attempt to connect WiFi in Station mode FAILED, setup SoftAP mode");
+        boot_phase_begin(BOOT_PHASE_SOFTAP);
         scan_and_start_softAP();
-        ESP_ERROR_CHECK(start_rest_server("/www/softap"));
+        boot_phase_end(BOOT_PHASE_SOFTAP);
+        ESP_ERROR_CHECK(rest_server_set_base_path("/www/softap"));
+        /* Posted credentials are tried without a reboot */
+        ESP_ERROR_CHECK(provision_start());
     }
-    cJSON_Delete(root);
+    boot_timeline_log();
 }
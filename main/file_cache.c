@@ -0,0 +1,289 @@
+/* LRU cache for hot static files
+
+   Small, frequently requested files (index.html, the Vue bundles) are kept in RAM
+   (PSRAM when available) so repeated requests don't touch the SD card. Entries are
+   revalidated against the file size and mtime at most every
+   CONFIG_EXAMPLE_FILE_CACHE_REVALIDATE_MS, and the least recently used ones are
+   evicted once the byte budget is exceeded. A miss reserves its bytes in the
+   budget before the file is read, so a file that can't fit is never loaded.
+*/
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "file_cache.h"
+#include "metrics.h"
+
+#if CONFIG_EXAMPLE_FILE_CACHE_USE_PSRAM
+#define FILE_CACHE_CAPS (MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT)
+#else
+#define FILE_CACHE_CAPS (MALLOC_CAP_8BIT)
+#endif
+
+static const char *TAG = "file_cache";
+
+static xSemaphoreHandle s_cache_lock;
+static file_cache_entry_t *s_lru_head, *s_lru_tail;
+static size_t s_cache_used; /* linked entries plus the reservations of loads in flight */
+
+static uint32_t path_hash(const char *path)
+{
+    /* FNV-1a */
+    uint32_t hash = 2166136261u;
+    while (*path)
+    {
+        hash = (hash ^ (uint8_t)*path++) * 16777619u;
+    }
+    return hash;
+}
+
+static void entry_free(file_cache_entry_t *entry)
+{
+    heap_caps_free(entry->data);
+    free(entry->path);
+    free(entry);
+}
+
+static void lru_unlink(file_cache_entry_t *entry)
+{
+    if (entry->prev)
+    {
+        entry->prev->next = entry->next;
+    }
+    else
+    {
+        s_lru_head = entry->next;
+    }
+    if (entry->next)
+    {
+        entry->next->prev = entry->prev;
+    }
+    else
+    {
+        s_lru_tail = entry->prev;
+    }
+    entry->prev = entry->next = NULL;
+    entry->linked = false;
+    s_cache_used -= entry->size;
+}
+
+static void lru_push_front(file_cache_entry_t *entry)
+{
+    entry->prev = NULL;
+    entry->next = s_lru_head;
+    if (s_lru_head)
+    {
+        s_lru_head->prev = entry;
+    }
+    s_lru_head = entry;
+    if (!s_lru_tail)
+    {
+        s_lru_tail = entry;
+    }
+    entry->linked = true;
+    s_cache_used += entry->size;
+}
+
+/* Drop an entry from the cache, it is freed now or by its last reader */
+static void lru_remove(file_cache_entry_t *entry)
+{
+    lru_unlink(entry);
+    if (entry->refs == 0)
+    {
+        entry_free(entry);
+    }
+}
+
+static file_cache_entry_t *lru_find(const char *path, uint32_t hash)
+{
+    for (file_cache_entry_t *entry = s_lru_head; entry; entry = entry->next)
+    {
+        if (entry->hash == hash && strcmp(entry->path, path) == 0)
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/* Evict unreferenced entries from the tail until size more bytes fit */
+static bool lru_make_room(size_t size)
+{
+    file_cache_entry_t *entry = s_lru_tail;
+    while (entry && s_cache_used + size > CONFIG_EXAMPLE_FILE_CACHE_SIZE)
+    {
+        file_cache_entry_t *prev = entry->prev;
+        if (entry->refs == 0)
+        {
+            ESP_LOGD(TAG, "Evict %s (%zu bytes)", entry->path, entry->size);
+            lru_remove(entry);
+        }
+        entry = prev;
+    }
+    return s_cache_used + size <= CONFIG_EXAMPLE_FILE_CACHE_SIZE;
+}
+
+static file_cache_entry_t *entry_load(const char *path, uint32_t hash, const struct stat *st)
+{
+    file_cache_entry_t *entry = calloc(1, sizeof(file_cache_entry_t));
+    if (!entry)
+    {
+        return NULL;
+    }
+    entry->path = strdup(path);
+    entry->data = heap_caps_malloc(st->st_size ? st->st_size : 1, FILE_CACHE_CAPS);
+    int fd = open(path, O_RDONLY, 0);
+    if (!entry->path || !entry->data || fd == -1)
+    {
+        ESP_LOGW(TAG, "Can't cache %s", path);
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        entry_free(entry);
+        return NULL;
+    }
+    size_t total = 0;
+    while (total < st->st_size)
+    {
+        ssize_t read_bytes = metrics_read(fd, entry->data + total, st->st_size - total);
+        if (read_bytes <= 0)
+        {
+            break;
+        }
+        total += read_bytes;
+    }
+    close(fd);
+    if (total != st->st_size)
+    {
+        ESP_LOGE(TAG, "Failed to read file : %s", path);
+        entry_free(entry);
+        return NULL;
+    }
+    entry->hash = hash;
+    entry->size = total;
+    entry->mtime = st->st_mtime;
+    entry->checked_us = esp_timer_get_time();
+    entry->refs = 1;
+    return entry;
+}
+
+esp_err_t file_cache_init(void)
+{
+    if (CONFIG_EXAMPLE_FILE_CACHE_SIZE == 0)
+    {
+        ESP_LOGI(TAG, "Static file cache disabled");
+        return ESP_OK;
+    }
+    if (s_cache_lock)
+    {
+        return ESP_OK;
+    }
+    s_cache_lock = xSemaphoreCreateMutex();
+    if (!s_cache_lock)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Static file cache: %d bytes, files up to %d bytes", CONFIG_EXAMPLE_FILE_CACHE_SIZE,
+             CONFIG_EXAMPLE_FILE_CACHE_MAX_FILE);
+    return ESP_OK;
+}
+
+file_cache_entry_t *file_cache_get(const char *path)
+{
+    if (!s_cache_lock)
+    {
+        return NULL;
+    }
+    uint32_t hash = path_hash(path);
+    int64_t now = esp_timer_get_time();
+
+    xSemaphoreTake(s_cache_lock, portMAX_DELAY);
+    file_cache_entry_t *entry = lru_find(path, hash);
+    if (entry && now - entry->checked_us < CONFIG_EXAMPLE_FILE_CACHE_REVALIDATE_MS * 1000LL)
+    {
+        /* Fresh hit, no filesystem access at all */
+        entry->refs++;
+        lru_unlink(entry);
+        lru_push_front(entry);
+        xSemaphoreGive(s_cache_lock);
+        return entry;
+    }
+    xSemaphoreGive(s_cache_lock);
+
+    struct stat st;
+    if (stat(path, &st) != 0 || st.st_size > CONFIG_EXAMPLE_FILE_CACHE_MAX_FILE)
+    {
+        /* Gone or grown too large; entry may have been freed since the lock was dropped */
+        xSemaphoreTake(s_cache_lock, portMAX_DELAY);
+        entry = lru_find(path, hash);
+        if (entry)
+        {
+            lru_remove(entry);
+        }
+        xSemaphoreGive(s_cache_lock);
+        return NULL;
+    }
+
+    xSemaphoreTake(s_cache_lock, portMAX_DELAY);
+    entry = lru_find(path, hash);
+    if (entry && entry->size == st.st_size && entry->mtime == st.st_mtime)
+    {
+        entry->checked_us = now;
+        entry->refs++;
+        lru_unlink(entry);
+        lru_push_front(entry);
+        xSemaphoreGive(s_cache_lock);
+        return entry;
+    }
+    if (entry)
+    {
+        ESP_LOGI(TAG, "%s changed, reload", path);
+        lru_remove(entry);
+    }
+    /* Miss: reserve the room first, a file that doesn't fit is streamed by the caller */
+    size_t size = st.st_size;
+    bool reserved = lru_make_room(size);
+    if (reserved)
+    {
+        s_cache_used += size;
+    }
+    xSemaphoreGive(s_cache_lock);
+    if (!reserved)
+    {
+        return NULL;
+    }
+
+    /* Read the file without holding the lock, then publish it */
+    entry = entry_load(path, hash, &st);
+    xSemaphoreTake(s_cache_lock, portMAX_DELAY);
+    s_cache_used -= size;
+    if (entry)
+    {
+        file_cache_entry_t *raced = lru_find(path, hash);
+        if (raced)
+        {
+            lru_remove(raced);
+        }
+        lru_push_front(entry);
+    }
+    xSemaphoreGive(s_cache_lock);
+    return entry;
+}
+
+void file_cache_release(file_cache_entry_t *entry)
+{
+    xSemaphoreTake(s_cache_lock, portMAX_DELAY);
+    bool drop = (--entry->refs == 0 && !entry->linked);
+    xSemaphoreGive(s_cache_lock);
+    if (drop)
+    {
+        entry_free(entry);
+    }
+}
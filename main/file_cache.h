@@ -0,0 +1,30 @@
+// file_cache.h
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include "esp_err.h"
+
+typedef struct file_cache_entry
+{
+    struct file_cache_entry *prev, *next; /* LRU list, most recently used first */
+    uint32_t hash;
+    char *path;
+    uint8_t *data;
+    size_t size;
+    time_t mtime;
+    int64_t checked_us; /* last time size/mtime were compared with the filesystem */
+    int refs;
+    bool linked;        /* false once evicted or invalidated, freed by the last release */
+} file_cache_entry_t;
+
+/* Set up the cache with the byte budget from Kconfig, a zero budget disables it */
+esp_err_t file_cache_init(void);
+
+/* Return the cached contents of a file, loading it on a miss.
+ * NULL if the cache is disabled, the file is too large for it, there is no room
+ * for it right now (every entry in use) or it can't be read.
+ * Every returned entry must be handed back with file_cache_release(). */
+file_cache_entry_t *file_cache_get(const char *path);
+void file_cache_release(file_cache_entry_t *entry);
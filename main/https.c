@@ -0,0 +1,465 @@
+/* HTTPS
+
+   TLS for the REST server, on mbedtls directly rather than through
+   esp_https_server, so that resumption can be measured and admission control
+   still sees connections first:
+   - a full handshake (ECDHE, with an ECDSA P-256 key as in the README) costs
+     the ESP32 a few hundred milliseconds of the HTTP server task. Clients coming
+     back resume instead: from a session ticket (the encrypted session state kept
+     by the client, no server memory per client) or from a small session cache
+     for clients without ticket support. A resumed handshake is one round trip and
+     a few symmetric operations;
+   - connections stay open between requests (HTTP keep-alive), so a page and its
+     assets load over one or two handshakes;
+   - open_fn runs admission control and only sets the session up, so a
+     connection over a limit costs no cryptography. It is closed without the
+     canned 503, which a TLS client couldn't read anyway;
+   - the handshake runs in the recv override, the first time httpd finds the
+     socket readable, i.e. once the ClientHello arrives. A client that connects
+     and stays silent costs nothing. Reads until the first request has arrived
+     share a deadline of HTTPS_HANDSHAKE_TIMEOUT_US, so a client that stalls or
+     trickles mid-handshake holds the HTTP server task for that long at most.
+
+   Ticket keys are random per boot and rotate every
+   CONFIG_EXAMPLE_HTTPS_SESSION_LIFETIME_S, so resumption survives reconnects but
+   not a reboot. Handshake counts and times by kind are counted for /metrics.
+
+   A file worker sends on a session while the HTTP server task may read from it,
+   and an mbedtls context isn't safe for that: every session has a lock around
+   its reads and writes.
+*/
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "https.h"
+
+#if CONFIG_EXAMPLE_HTTPS
+
+#include "mbedtls/ssl.h"
+#include "mbedtls/ssl_cache.h"
+#include "mbedtls/ssl_ticket.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/x509_crt.h"
+#include "mbedtls/pk.h"
+
+/* mbedtls needs a deeper stack than plain HTTP, same as esp_https_server */
+#define HTTPS_STACK_SIZE (10240)
+#define HTTPS_HANDSHAKE_TIMEOUT_US (1500 * 1000)
+#define HTTPS_REDIRECT_STACK_SIZE (3072)
+#define HTTPS_HOST_MAX (64)
+
+static const char *TAG = "https";
+
+extern const unsigned char servercert_pem_start[] asm("_binary_servercert_pem_start");
+extern const unsigned char servercert_pem_end[] asm("_binary_servercert_pem_end");
+extern const unsigned char prvtkey_pem_start[] asm("_binary_prvtkey_pem_start");
+extern const unsigned char prvtkey_pem_end[] asm("_binary_prvtkey_pem_end");
+
+/* ECDSA suites first: with an ECDSA key the handshake signs with P-256 instead of
+   an RSA private key operation. AES-GCM runs on the AES peripheral. */
+static const int s_ciphersuites[] = {
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256,
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_256_GCM_SHA384,
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_CBC_SHA256,
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_CBC_SHA,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_AES_256_GCM_SHA384,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_CBC_SHA256,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_CBC_SHA,
+    0,
+};
+
+static const char *const s_handshake_names[HTTPS_HANDSHAKE_TYPES] = {
+    [HTTPS_HANDSHAKE_FULL] = "full",
+    [HTTPS_HANDSHAKE_TICKET] = "ticket",
+    [HTTPS_HANDSHAKE_CACHE] = "cache",
+    [HTTPS_HANDSHAKE_FAILED] = "failed",
+};
+
+typedef struct
+{
+    mbedtls_ssl_context ssl;
+    mbedtls_net_context net;
+    SemaphoreHandle_t lock;
+    int64_t deadline_us; /* 0 until the handshake starts */
+    bool established;    /* handshake done and the first request bytes read */
+} https_session_t;
+
+static mbedtls_entropy_context s_entropy;
+static mbedtls_ctr_drbg_context s_drbg;
+static mbedtls_x509_crt s_cert;
+static mbedtls_pk_context s_key;
+static mbedtls_ssl_config s_conf;
+#if defined(MBEDTLS_SSL_CACHE_C)
+static mbedtls_ssl_cache_context s_cache;
+#endif
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+static mbedtls_ssl_ticket_context s_ticket;
+#endif
+static bool s_ready;
+static httpd_open_func_t s_lower_open;
+static httpd_close_func_t s_lower_close;
+/* Kind of the handshake in progress; handshakes only run in the HTTP server task */
+static https_handshake_t s_handshake;
+static https_stats_t s_stats;
+
+#if defined(MBEDTLS_SSL_CACHE_C)
+static int cache_get(void *data, mbedtls_ssl_session *session)
+{
+    int ret = mbedtls_ssl_cache_get(data, session);
+    if (ret == 0)
+    {
+        s_handshake = HTTPS_HANDSHAKE_CACHE;
+    }
+    return ret;
+}
+#endif
+
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+static int ticket_parse(void *p_ticket, mbedtls_ssl_session *session, unsigned char *buf, size_t len)
+{
+    int ret = mbedtls_ssl_ticket_parse(p_ticket, session, buf, len);
+    if (ret == 0)
+    {
+        s_handshake = HTTPS_HANDSHAKE_TICKET;
+    }
+    return ret;
+}
+#endif
+
+static int tls_result(int ret)
+{
+    if (ret >= 0)
+    {
+        return ret;
+    }
+    if (ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY)
+    {
+        return 0;
+    }
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE)
+    {
+        return HTTPD_SOCK_ERR_TIMEOUT;
+    }
+    ESP_LOGD(TAG, "TLS error -0x%04x", -ret);
+    return HTTPD_SOCK_ERR_FAIL;
+}
+
+int https_send(httpd_handle_t hd, int sockfd, const char *buf, size_t buf_len, int flags)
+{
+    https_session_t *sess = httpd_sess_get_transport_ctx(hd, sockfd);
+    if (!sess || !buf)
+    {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+    xSemaphoreTake(sess->lock, portMAX_DELAY);
+    int ret = mbedtls_ssl_write(&sess->ssl, (const unsigned char *)buf, buf_len);
+    xSemaphoreGive(sess->lock);
+    return tls_result(ret);
+}
+
+static void record(https_handshake_t type, int64_t us)
+{
+    __atomic_add_fetch(&s_stats.count[type], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&s_stats.us[type], us, __ATOMIC_RELAXED);
+}
+
+static int bio_send(void *ctx, const unsigned char *buf, size_t len)
+{
+    return mbedtls_net_send(&((https_session_t *)ctx)->net, buf, len);
+}
+
+static int bio_recv(void *ctx, unsigned char *buf, size_t len)
+{
+    return mbedtls_net_recv(&((https_session_t *)ctx)->net, buf, len);
+}
+
+/* Until the session is established every read waits at most until its deadline */
+static int bio_recv_deadline(void *ctx, unsigned char *buf, size_t len, uint32_t timeout_ms)
+{
+    https_session_t *sess = ctx;
+    int64_t left_us = sess->deadline_us - esp_timer_get_time();
+    if (left_us <= 0)
+    {
+        return MBEDTLS_ERR_SSL_TIMEOUT;
+    }
+    return mbedtls_net_recv_timeout(&sess->net, buf, len, left_us / 1000 + 1);
+}
+
+/* Called with the session locked when the ClientHello is readable */
+static int session_handshake(https_session_t *sess, int sockfd)
+{
+    s_handshake = HTTPS_HANDSHAKE_FULL;
+    int64_t start = esp_timer_get_time();
+    sess->deadline_us = start + HTTPS_HANDSHAKE_TIMEOUT_US;
+    int ret = mbedtls_ssl_handshake(&sess->ssl);
+    int64_t elapsed_us = esp_timer_get_time() - start;
+    if (ret != 0)
+    {
+        ESP_LOGD(TAG, "Handshake on socket %d failed: -0x%04x", sockfd, -ret);
+        record(HTTPS_HANDSHAKE_FAILED, elapsed_us);
+        return ret;
+    }
+    record(s_handshake, elapsed_us);
+    ESP_LOGD(TAG, "%s handshake on socket %d in %" PRId64 " ms", s_handshake_names[s_handshake], sockfd,
+             elapsed_us / 1000);
+    return 0;
+}
+
+static int https_recv(httpd_handle_t hd, int sockfd, char *buf, size_t buf_len, int flags)
+{
+    https_session_t *sess = httpd_sess_get_transport_ctx(hd, sockfd);
+    if (!sess || !buf)
+    {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+    xSemaphoreTake(sess->lock, portMAX_DELAY);
+    int ret = 0;
+    if (!sess->deadline_us)
+    {
+        ret = session_handshake(sess, sockfd);
+    }
+    if (ret == 0)
+    {
+        ret = mbedtls_ssl_read(&sess->ssl, (unsigned char *)buf, buf_len);
+    }
+    if (ret > 0 && !sess->established)
+    {
+        /* From the first request on reads block on the socket's receive timeout,
+           as for plain HTTP, where httpd only reads sockets that are readable */
+        mbedtls_ssl_set_bio(&sess->ssl, sess, bio_send, bio_recv, NULL);
+        sess->established = true;
+    }
+    xSemaphoreGive(sess->lock);
+    if (ret == MBEDTLS_ERR_SSL_TIMEOUT || ret == MBEDTLS_ERR_SSL_WANT_READ)
+    {
+        return sess->established ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+    }
+    return tls_result(ret);
+}
+
+/* Decrypted bytes left over from the last record don't make the socket readable */
+static int https_pending(httpd_handle_t hd, int sockfd)
+{
+    https_session_t *sess = httpd_sess_get_transport_ctx(hd, sockfd);
+    return sess ? mbedtls_ssl_get_bytes_avail(&sess->ssl) : 0;
+}
+
+static void session_free(void *ctx)
+{
+    https_session_t *sess = ctx;
+    mbedtls_ssl_free(&sess->ssl);
+    if (sess->lock)
+    {
+        vSemaphoreDelete(sess->lock);
+    }
+    free(sess);
+}
+
+static esp_err_t https_open(httpd_handle_t hd, int fd)
+{
+    if (s_lower_open && s_lower_open(hd, fd) != ESP_OK)
+    {
+        return ESP_FAIL;
+    }
+    https_session_t *sess = calloc(1, sizeof(https_session_t));
+    if (!sess)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    mbedtls_ssl_init(&sess->ssl);
+    sess->net.fd = fd;
+    sess->lock = xSemaphoreCreateMutex();
+    if (!sess->lock || mbedtls_ssl_setup(&sess->ssl, &s_conf) != 0)
+    {
+        ESP_LOGE(TAG, "No memory for a TLS session");
+        session_free(sess);
+        return ESP_ERR_NO_MEM;
+    }
+    /* The handshake waits for the ClientHello, see https_recv() */
+    mbedtls_ssl_set_bio(&sess->ssl, sess, bio_send, NULL, bio_recv_deadline);
+
+    httpd_sess_set_transport_ctx(hd, fd, sess, session_free);
+    httpd_sess_set_send_override(hd, fd, https_send);
+    httpd_sess_set_recv_override(hd, fd, https_recv);
+    httpd_sess_set_pending_override(hd, fd, https_pending);
+    return ESP_OK;
+}
+
+/* Also called for connections https_open() turned away, the session (if any) is
+   freed by httpd as the transport context */
+static void https_close(httpd_handle_t hd, int fd)
+{
+    if (s_lower_close)
+    {
+        s_lower_close(hd, fd);
+    }
+    else
+    {
+        close(fd);
+    }
+}
+
+static esp_err_t https_init(void)
+{
+    int ret;
+
+    mbedtls_entropy_init(&s_entropy);
+    mbedtls_ctr_drbg_init(&s_drbg);
+    mbedtls_x509_crt_init(&s_cert);
+    mbedtls_pk_init(&s_key);
+    mbedtls_ssl_config_init(&s_conf);
+
+    if ((ret = mbedtls_ctr_drbg_seed(&s_drbg, mbedtls_entropy_func, &s_entropy, (const unsigned char *)TAG,
+                                     strlen(TAG))) != 0)
+    {
+        ESP_LOGE(TAG, "Failed to seed the DRBG: -0x%04x", -ret);
+        return ESP_FAIL;
+    }
+    /* Both are embedded as text, the length includes the terminating NUL mbedtls wants */
+    if ((ret = mbedtls_x509_crt_parse(&s_cert, servercert_pem_start, servercert_pem_end - servercert_pem_start)) != 0 ||
+        (ret = mbedtls_pk_parse_key(&s_key, prvtkey_pem_start, prvtkey_pem_end - prvtkey_pem_start, NULL, 0)) != 0)
+    {
+        ESP_LOGE(TAG, "Failed to load the certificate or key: -0x%04x", -ret);
+        return ESP_FAIL;
+    }
+    if ((ret = mbedtls_ssl_config_defaults(&s_conf, MBEDTLS_SSL_IS_SERVER, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                           MBEDTLS_SSL_PRESET_DEFAULT)) != 0 ||
+        (ret = mbedtls_ssl_conf_own_cert(&s_conf, &s_cert, &s_key)) != 0)
+    {
+        ESP_LOGE(TAG, "Failed to set up TLS: -0x%04x", -ret);
+        return ESP_FAIL;
+    }
+    mbedtls_ssl_conf_rng(&s_conf, mbedtls_ctr_drbg_random, &s_drbg);
+    mbedtls_ssl_conf_ciphersuites(&s_conf, s_ciphersuites);
+
+#if defined(MBEDTLS_SSL_CACHE_C)
+    if (CONFIG_EXAMPLE_HTTPS_SESSION_CACHE > 0)
+    {
+        mbedtls_ssl_cache_init(&s_cache);
+        mbedtls_ssl_cache_set_max_entries(&s_cache, CONFIG_EXAMPLE_HTTPS_SESSION_CACHE);
+        mbedtls_ssl_cache_set_timeout(&s_cache, CONFIG_EXAMPLE_HTTPS_SESSION_LIFETIME_S);
+        mbedtls_ssl_conf_session_cache(&s_conf, &s_cache, cache_get, mbedtls_ssl_cache_set);
+    }
+#else
+    ESP_LOGW(TAG, "mbedtls is built without MBEDTLS_SSL_CACHE_C, no session cache");
+#endif
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    if ((ret = mbedtls_ssl_ticket_setup(&s_ticket, mbedtls_ctr_drbg_random, &s_drbg, MBEDTLS_CIPHER_AES_128_GCM,
+                                        CONFIG_EXAMPLE_HTTPS_SESSION_LIFETIME_S)) != 0)
+    {
+        ESP_LOGE(TAG, "Failed to set up session tickets: -0x%04x", -ret);
+        return ESP_FAIL;
+    }
+    mbedtls_ssl_conf_session_tickets_cb(&s_conf, mbedtls_ssl_ticket_write, ticket_parse, &s_ticket);
+#else
+    ESP_LOGW(TAG, "mbedtls is built without session tickets (MBEDTLS_SERVER_SSL_SESSION_TICKETS)");
+#endif
+    ESP_LOGI(TAG, "%s key, %d cached sessions, tickets valid %d s", mbedtls_pk_get_name(&s_key),
+             CONFIG_EXAMPLE_HTTPS_SESSION_CACHE, CONFIG_EXAMPLE_HTTPS_SESSION_LIFETIME_S);
+    return ESP_OK;
+}
+
+esp_err_t https_configure(httpd_config_t *config)
+{
+    if (!s_ready)
+    {
+        if (https_init() != ESP_OK)
+        {
+            return ESP_FAIL;
+        }
+        s_ready = true;
+    }
+    s_lower_open = config->open_fn;
+    s_lower_close = config->close_fn;
+    config->open_fn = https_open;
+    config->close_fn = https_close;
+    config->server_port = CONFIG_EXAMPLE_HTTPS_PORT;
+    if (config->stack_size < HTTPS_STACK_SIZE)
+    {
+        config->stack_size = HTTPS_STACK_SIZE;
+    }
+    return ESP_OK;
+}
+
+#if CONFIG_EXAMPLE_HTTPS_REDIRECT
+static esp_err_t redirect_get_handler(httpd_req_t *req)
+{
+    char host[HTTPS_HOST_MAX];
+    char location[sizeof(host) + CONFIG_HTTPD_MAX_URI_LEN + 16];
+
+    if (httpd_req_get_hdr_value_str(req, "Host", host, sizeof(host)) != ESP_OK)
+    {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Host header missing");
+    }
+    /* Drop the port, not the colons of an IPv6 literal */
+    char *port = strrchr(host, ':');
+    if (port && !strchr(port, ']'))
+    {
+        *port = '\0';
+    }
+#if CONFIG_EXAMPLE_HTTPS_PORT == 443
+    snprintf(location, sizeof(location), "https://%s%s", host, req->uri);
+#else
+    snprintf(location, sizeof(location), "https://%s:%d%s", host, CONFIG_EXAMPLE_HTTPS_PORT, req->uri);
+#endif
+    /* Not 301: browsers would keep going to https after HTTPS is turned off */
+    httpd_resp_set_status(req, "302 Found");
+    httpd_resp_set_hdr(req, "Location", location);
+    return httpd_resp_send(req, NULL, 0);
+}
+#endif
+
+esp_err_t https_start_redirect(void)
+{
+#if CONFIG_EXAMPLE_HTTPS_REDIRECT
+    httpd_handle_t server = NULL;
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.uri_match_fn = httpd_uri_match_wildcard;
+    config.stack_size = HTTPS_REDIRECT_STACK_SIZE;
+    config.ctrl_port = config.ctrl_port + 1;
+    config.max_open_sockets = 2;
+    config.max_uri_handlers = 1;
+    config.lru_purge_enable = true;
+    esp_err_t err = httpd_start(&server, &config);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to start the redirect server: %s", esp_err_to_name(err));
+        return err;
+    }
+    /* Only GET: a body posted over plain HTTP has been exposed already */
+    httpd_uri_t redirect_uri = {
+        .uri = "/*",
+        .method = HTTP_GET,
+        .handler = redirect_get_handler,
+        .user_ctx = NULL};
+    return httpd_register_uri_handler(server, &redirect_uri);
+#else
+    return ESP_OK;
+#endif
+}
+
+void https_get_stats(https_stats_t *stats)
+{
+    for (int i = 0; i < HTTPS_HANDSHAKE_TYPES; i++)
+    {
+        stats->count[i] = __atomic_load_n(&s_stats.count[i], __ATOMIC_RELAXED);
+        stats->us[i] = __atomic_load_n(&s_stats.us[i], __ATOMIC_RELAXED);
+    }
+}
+
+const char *https_handshake_name(https_handshake_t type)
+{
+    return type < HTTPS_HANDSHAKE_TYPES ? s_handshake_names[type] : "unknown";
+}
+
+#endif
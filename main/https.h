@@ -0,0 +1,49 @@
+// https.h
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+typedef enum
+{
+    HTTPS_HANDSHAKE_FULL,   /* certificate and key exchange */
+    HTTPS_HANDSHAKE_TICKET, /* resumed from a session ticket the client kept */
+    HTTPS_HANDSHAKE_CACHE,  /* resumed from the server session cache */
+    HTTPS_HANDSHAKE_FAILED,
+    HTTPS_HANDSHAKE_TYPES,
+} https_handshake_t;
+
+typedef struct
+{
+    uint32_t count[HTTPS_HANDSHAKE_TYPES];
+    uint64_t us[HTTPS_HANDSHAKE_TYPES];
+} https_stats_t;
+
+#if CONFIG_EXAMPLE_HTTPS
+/* Load the certificate and key, set up the session cache and ticket keys, and make
+ * config a TLS server: port, stack, and open_fn/close_fn wrapping whatever config
+ * already has (admission control) around the handshake. Call before httpd_start(). */
+esp_err_t https_configure(httpd_config_t *config);
+
+/* Send function of the TLS sessions, for send overrides that account on top of it */
+int https_send(httpd_handle_t hd, int sockfd, const char *buf, size_t buf_len, int flags);
+
+/* Plain HTTP server answering every GET with a redirect to the HTTPS port */
+esp_err_t https_start_redirect(void);
+
+void https_get_stats(https_stats_t *stats);
+const char *https_handshake_name(https_handshake_t type);
+#else
+static inline esp_err_t https_configure(httpd_config_t *config)
+{
+    return ESP_OK;
+}
+
+static inline esp_err_t https_start_redirect(void)
+{
+    return ESP_OK;
+}
+#endif
@@ -0,0 +1,137 @@
+/* JSON response benchmark
+
+   Renders an /aps style access point list the way the handlers used to (cJSON tree
+   plus cJSON_Print) and with json_stream, and logs heap allocations, allocated
+   bytes, payload size and time per request for both. cJSON allocations are counted
+   through cJSON_InitHooks; json_stream has no allocation path at all.
+   Enabled with CONFIG_EXAMPLE_JSON_BENCH, runs once at boot before the HTTP server
+   starts: the counting hooks replace whatever was installed and the default ones
+   are restored afterwards, which would drop the request arena hooks.
+*/
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "cJSON.h"
+#include "json_stream.h"
+#include "json_bench.h"
+
+#define BENCH_AP_COUNT (20)
+
+static const char *TAG = "json_bench";
+
+typedef struct
+{
+    char ssid[33];
+    int8_t rssi;
+} bench_ap_t;
+
+typedef struct
+{
+    uint32_t allocs;
+    size_t alloc_bytes;
+    size_t payload_bytes;
+    int64_t elapsed_us;
+} bench_result_t;
+
+static bench_ap_t s_aps[BENCH_AP_COUNT];
+static uint32_t s_allocs;
+static size_t s_alloc_bytes;
+
+static void *counting_malloc(size_t size)
+{
+    s_allocs++;
+    s_alloc_bytes += size;
+    return malloc(size);
+}
+
+static void bench_cjson(bench_result_t *res)
+{
+    cJSON *root = cJSON_CreateObject();
+    cJSON *wifi_list = cJSON_AddArrayToObject(root, "aps");
+    for (int i = 0; i < BENCH_AP_COUNT; i++)
+    {
+        cJSON *item = cJSON_CreateObject();
+        cJSON_AddNumberToObject(item, "id", i);
+        cJSON_AddStringToObject(item, "ssid", s_aps[i].ssid);
+        cJSON_AddNumberToObject(item, "rssi", s_aps[i].rssi);
+        cJSON_AddItemToArray(wifi_list, item);
+    }
+    char *out = cJSON_Print(root);
+    res->payload_bytes += strlen(out);
+    cJSON_free(out);
+    cJSON_Delete(root);
+}
+
+static esp_err_t null_sink(json_stream_t *js, const char *data, size_t len, bool last)
+{
+    return ESP_OK;
+}
+
+static void bench_stream(bench_result_t *res)
+{
+    char buf[512];
+    json_stream_t js;
+
+    json_stream_init(&js, buf, sizeof(buf), null_sink, NULL);
+    json_stream_obj_begin(&js, NULL);
+    json_stream_arr_begin(&js, "aps");
+    for (int i = 0; i < BENCH_AP_COUNT; i++)
+    {
+        json_stream_obj_begin(&js, NULL);
+        json_stream_int(&js, "id", i);
+        json_stream_str(&js, "ssid", s_aps[i].ssid);
+        json_stream_int(&js, "rssi", s_aps[i].rssi);
+        json_stream_obj_end(&js);
+    }
+    json_stream_arr_end(&js);
+    json_stream_obj_end(&js);
+    json_stream_finish(&js);
+    res->payload_bytes += js.total;
+}
+
+static void bench_run(const char *name, void (*render)(bench_result_t *res))
+{
+    const int iterations = CONFIG_EXAMPLE_JSON_BENCH_ITERATIONS;
+    bench_result_t res = {0};
+    size_t heap_before = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+
+    s_allocs = 0;
+    s_alloc_bytes = 0;
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++)
+    {
+        render(&res);
+    }
+    res.elapsed_us = esp_timer_get_time() - start;
+    res.allocs = s_allocs;
+    res.alloc_bytes = s_alloc_bytes;
+
+    ESP_LOGI(TAG, "%-7s allocs/req %" PRIu32 ", alloc bytes/req %zu, payload bytes/req %zu, us/req %u, heap delta %d",
+             name, res.allocs / iterations, res.alloc_bytes / iterations,
+             res.payload_bytes / iterations, (unsigned)(res.elapsed_us / iterations),
+             (int)(heap_caps_get_free_size(MALLOC_CAP_8BIT) - heap_before));
+}
+
+void json_bench_run(void)
+{
+    cJSON_Hooks hooks = {
+        .malloc_fn = counting_malloc,
+        .free_fn = free,
+    };
+
+    for (int i = 0; i < BENCH_AP_COUNT; i++)
+    {
+        snprintf(s_aps[i].ssid, sizeof(s_aps[i].ssid), "network-%02d", i);
+        s_aps[i].rssi = -40 - i * 2;
+    }
+    ESP_LOGI(TAG, "%d APs, %d iterations", BENCH_AP_COUNT, CONFIG_EXAMPLE_JSON_BENCH_ITERATIONS);
+    cJSON_InitHooks(&hooks);
+    bench_run("cjson", bench_cjson);
+    bench_run("stream", bench_stream);
+    cJSON_InitHooks(NULL);
+}
@@ -0,0 +1,5 @@
+// json_bench.h
+#pragma once
+
+/* Compare cJSON and json_stream rendering of an /aps response and log the numbers */
+void json_bench_run(void);
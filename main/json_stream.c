@@ -0,0 +1,362 @@
+/* Allocation-free streaming JSON writer
+
+   Compact JSON is written into a caller provided buffer (normally on the handler
+   stack) and handed to a sink whenever the buffer fills up, so an API response is
+   produced without building a cJSON tree and without touching the heap.
+
+   The same calls can write CBOR instead: objects and arrays become indefinite
+   length maps and arrays, integers take 1 to 5 bytes and no quoting or escaping is
+   needed. The HTTP sink picks it from the request's Accept header.
+*/
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "cbor.h"
+#include "json_stream.h"
+
+static const char *TAG = "json_stream";
+
+static esp_err_t json_stream_flush(json_stream_t *js, bool last)
+{
+    if (js->err == ESP_OK && (js->len || last))
+    {
+        js->err = js->sink(js, js->buf, js->len, last);
+        js->flushed = true;
+    }
+    js->len = 0;
+    return js->err;
+}
+
+static void json_stream_put(json_stream_t *js, const char *data, size_t len)
+{
+    js->total += len;
+    while (len)
+    {
+        if (js->len == js->size && json_stream_flush(js, false) != ESP_OK)
+        {
+            return;
+        }
+        size_t n = js->size - js->len;
+        if (n > len)
+        {
+            n = len;
+        }
+        memcpy(js->buf + js->len, data, n);
+        js->len += n;
+        data += n;
+        len -= n;
+    }
+}
+
+static inline void json_stream_putc(json_stream_t *js, char c)
+{
+    json_stream_put(js, &c, 1);
+}
+
+static void json_stream_escaped(json_stream_t *js, const char *s, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    const char *run = s;
+
+    json_stream_putc(js, '"');
+    for (const char *end = s + len; s < end; s++)
+    {
+        uint8_t c = (uint8_t)*s;
+        if (c >= 0x20 && c != '"' && c != '\\')
+        {
+            continue;
+        }
+        json_stream_put(js, run, s - run);
+        run = s + 1;
+        switch (c)
+        {
+        case '"': json_stream_put(js, "\\\"", 2); break;
+        case '\\': json_stream_put(js, "\\\\", 2); break;
+        case '\n': json_stream_put(js, "\\n", 2); break;
+        case '\r': json_stream_put(js, "\\r", 2); break;
+        case '\t': json_stream_put(js, "\\t", 2); break;
+        default:
+        {
+            char u[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+            json_stream_put(js, u, sizeof(u));
+            break;
+        }
+        }
+    }
+    json_stream_put(js, run, s - run);
+    json_stream_putc(js, '"');
+}
+
+/* CBOR initial byte of major type with its argument, shortest form */
+static void cbor_head(json_stream_t *js, uint8_t major, uint32_t value)
+{
+    uint8_t head[5];
+    size_t len;
+
+    if (value < 24)
+    {
+        head[0] = major << 5 | value;
+        len = 1;
+    }
+    else if (value <= 0xff)
+    {
+        head[0] = major << 5 | 24;
+        head[1] = value;
+        len = 2;
+    }
+    else if (value <= 0xffff)
+    {
+        head[0] = major << 5 | 25;
+        head[1] = value >> 8;
+        head[2] = value;
+        len = 3;
+    }
+    else
+    {
+        head[0] = major << 5 | 26;
+        head[1] = value >> 24;
+        head[2] = value >> 16;
+        head[3] = value >> 8;
+        head[4] = value;
+        len = 5;
+    }
+    json_stream_put(js, (const char *)head, len);
+}
+
+static void cbor_text(json_stream_t *js, const char *s, size_t len)
+{
+    cbor_head(js, CBOR_MAJOR_TEXT, len);
+    json_stream_put(js, s, len);
+}
+
+/* Separator and member name in front of every value */
+static void json_stream_member(json_stream_t *js, const char *key)
+{
+    if (js->cbor)
+    {
+        if (key)
+        {
+            cbor_text(js, key, strlen(key));
+        }
+        return;
+    }
+    uint32_t bit = 1u << js->depth;
+    if (js->has_items & bit)
+    {
+        json_stream_putc(js, ',');
+    }
+    js->has_items |= bit;
+    if (key)
+    {
+        json_stream_escaped(js, key, strlen(key));
+        json_stream_putc(js, ':');
+    }
+}
+
+static void json_stream_open(json_stream_t *js, const char *key, char c, uint8_t cbor_major)
+{
+    json_stream_member(js, key);
+    json_stream_putc(js, js->cbor ? cbor_major << 5 | CBOR_INDEFINITE : c);
+    if (js->depth + 1 >= JSON_STREAM_MAX_DEPTH)
+    {
+        ESP_LOGE(TAG, "Nesting deeper than %d", JSON_STREAM_MAX_DEPTH);
+        js->err = ESP_ERR_INVALID_STATE;
+        return;
+    }
+    js->depth++;
+    js->has_items &= ~(1u << js->depth);
+}
+
+static void json_stream_close(json_stream_t *js, char c)
+{
+    if (js->depth)
+    {
+        js->depth--;
+    }
+    json_stream_putc(js, js->cbor ? CBOR_BREAK : c);
+}
+
+void json_stream_init(json_stream_t *js, char *buf, size_t size, json_sink_t sink, void *ctx)
+{
+    memset(js, 0, sizeof(*js));
+    js->buf = buf;
+    js->size = size;
+    js->sink = sink;
+    js->ctx = ctx;
+}
+
+/* Status line and headers of a document that fits in one buffer */
+#define HTTPD_HEAD_FMT "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: %u\r\nVary: Accept\r\n\r\n"
+#define ACCEPT_HDR_MAX (128)
+
+static esp_err_t httpd_send_all(httpd_req_t *req, const char *data, size_t len)
+{
+    while (len)
+    {
+        int sent = httpd_send(req, data, len);
+        if (sent <= 0)
+        {
+            return ESP_FAIL;
+        }
+        data += sent;
+        len -= sent;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t httpd_sink(json_stream_t *js, const char *data, size_t len, bool last)
+{
+    httpd_req_t *req = js->ctx;
+    if (last && !js->flushed)
+    {
+        /* Whole document in one buffer: the head goes into the room reserved in front
+           of it and everything leaves in one send with a Content-Length */
+        char head[JSON_STREAM_HTTPD_HEAD];
+        int head_len = snprintf(head, sizeof(head), HTTPD_HEAD_FMT,
+                                js->cbor ? JSON_STREAM_TYPE_CBOR : HTTPD_TYPE_JSON, (unsigned)len);
+        if (head_len <= 0 || head_len >= sizeof(head))
+        {
+            return httpd_resp_send(req, data, len);
+        }
+        char *start = (char *)data - head_len;
+        memcpy(start, head, head_len);
+        return httpd_send_all(req, start, head_len + len);
+    }
+    if (len)
+    {
+        esp_err_t err = httpd_resp_send_chunk(req, data, len);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+    }
+    return last ? httpd_resp_send_chunk(req, NULL, 0) : ESP_OK;
+}
+
+/* Whether the client lists application/cbor in Accept, without weighing q values */
+static bool httpd_accepts_cbor(httpd_req_t *req)
+{
+    char accept[ACCEPT_HDR_MAX];
+    size_t len = httpd_req_get_hdr_value_len(req, "Accept");
+    if (!len || len >= sizeof(accept) ||
+        httpd_req_get_hdr_value_str(req, "Accept", accept, sizeof(accept)) != ESP_OK)
+    {
+        return false;
+    }
+    return strcasestr(accept, JSON_STREAM_TYPE_CBOR) != NULL;
+}
+
+void json_stream_init_httpd(json_stream_t *js, httpd_req_t *req, char *buf, size_t size)
+{
+    json_stream_init(js, buf + JSON_STREAM_HTTPD_HEAD, size - JSON_STREAM_HTTPD_HEAD, httpd_sink, req);
+    js->cbor = httpd_accepts_cbor(req);
+    httpd_resp_set_type(req, js->cbor ? JSON_STREAM_TYPE_CBOR : HTTPD_TYPE_JSON);
+    httpd_resp_set_hdr(req, "Vary", "Accept");
+}
+
+void json_stream_obj_begin(json_stream_t *js, const char *key)
+{
+    json_stream_open(js, key, '{', CBOR_MAJOR_MAP);
+}
+
+void json_stream_obj_end(json_stream_t *js)
+{
+    json_stream_close(js, '}');
+}
+
+void json_stream_arr_begin(json_stream_t *js, const char *key)
+{
+    json_stream_open(js, key, '[', CBOR_MAJOR_ARRAY);
+}
+
+void json_stream_arr_end(json_stream_t *js)
+{
+    json_stream_close(js, ']');
+}
+
+void json_stream_strn(json_stream_t *js, const char *key, const char *value, size_t len)
+{
+    json_stream_member(js, key);
+    if (js->cbor)
+    {
+        cbor_text(js, value, len);
+        return;
+    }
+    json_stream_escaped(js, value, len);
+}
+
+void json_stream_str(json_stream_t *js, const char *key, const char *value)
+{
+    if (!value)
+    {
+        json_stream_member(js, key);
+        if (js->cbor)
+        {
+            json_stream_putc(js, CBOR_NULL);
+            return;
+        }
+        json_stream_put(js, "null", 4);
+        return;
+    }
+    json_stream_strn(js, key, value, strlen(value));
+}
+
+void json_stream_int(json_stream_t *js, const char *key, int32_t value)
+{
+    if (js->cbor)
+    {
+        json_stream_member(js, key);
+        if (value < 0)
+        {
+            cbor_head(js, CBOR_MAJOR_NEGINT, -(value + 1));
+        }
+        else
+        {
+            cbor_head(js, CBOR_MAJOR_UINT, value);
+        }
+        return;
+    }
+    char digits[11];
+    char *p = digits + sizeof(digits);
+    uint32_t v = value < 0 ? -(uint32_t)value : (uint32_t)value;
+
+    do
+    {
+        *--p = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    json_stream_member(js, key);
+    if (value < 0)
+    {
+        json_stream_putc(js, '-');
+    }
+    json_stream_put(js, p, digits + sizeof(digits) - p);
+}
+
+void json_stream_bool(json_stream_t *js, const char *key, bool value)
+{
+    json_stream_member(js, key);
+    if (js->cbor)
+    {
+        json_stream_putc(js, value ? CBOR_TRUE : CBOR_FALSE);
+        return;
+    }
+    if (value)
+    {
+        json_stream_put(js, "true", 4);
+    }
+    else
+    {
+        json_stream_put(js, "false", 5);
+    }
+}
+
+esp_err_t json_stream_finish(json_stream_t *js)
+{
+    if (js->depth && js->err == ESP_OK)
+    {
+        ESP_LOGE(TAG, "Document finished with %d open containers", js->depth);
+        js->err = ESP_ERR_INVALID_STATE;
+    }
+    return json_stream_flush(js, true);
+}
@@ -0,0 +1,59 @@
+// json_stream.h
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+/* Deepest object/array nesting a stream can track */
+#define JSON_STREAM_MAX_DEPTH (16)
+
+typedef struct json_stream json_stream_t;
+
+/* Receives the buffered output whenever the buffer fills up and once more with
+ * last = true from json_stream_finish(). len may be 0 on the last call. */
+typedef esp_err_t (*json_sink_t)(json_stream_t *js, const char *data, size_t len, bool last);
+
+struct json_stream
+{
+    char *buf;           /* caller provided, usually on the handler stack */
+    size_t size;
+    size_t len;          /* bytes buffered and not handed to the sink yet */
+    size_t total;        /* bytes emitted so far */
+    json_sink_t sink;
+    void *ctx;
+    uint32_t has_items;  /* bit n: the container at depth n already has a member */
+    uint8_t depth;
+    bool flushed;        /* the sink has been called at least once */
+    bool cbor;           /* write CBOR (RFC 8949) instead of JSON text, set after init */
+    esp_err_t err;       /* first sink error, later writes are dropped */
+};
+
+/* Generic stream, output goes to sink(ctx) */
+void json_stream_init(json_stream_t *js, char *buf, size_t size, json_sink_t sink, void *ctx);
+
+/* Room json_stream_init_httpd() keeps at the start of buf for the response head */
+#define JSON_STREAM_HTTPD_HEAD (96)
+
+#define JSON_STREAM_TYPE_CBOR "application/cbor"
+
+/* Stream a document into an HTTP response: application/cbor if the request's Accept
+ * header asks for it, application/json otherwise. A document that fits in buf goes
+ * out with its head and a Content-Length in a single send, a larger one as chunks.
+ * buf must be larger than JSON_STREAM_HTTPD_HEAD. */
+void json_stream_init_httpd(json_stream_t *js, httpd_req_t *req, char *buf, size_t size);
+
+/* key is the member name inside an object and NULL inside an array or at the top level */
+void json_stream_obj_begin(json_stream_t *js, const char *key);
+void json_stream_obj_end(json_stream_t *js);
+void json_stream_arr_begin(json_stream_t *js, const char *key);
+void json_stream_arr_end(json_stream_t *js);
+void json_stream_str(json_stream_t *js, const char *key, const char *value);
+void json_stream_strn(json_stream_t *js, const char *key, const char *value, size_t len);
+void json_stream_int(json_stream_t *js, const char *key, int32_t value);
+void json_stream_bool(json_stream_t *js, const char *key, bool value);
+
+/* Flush the rest of the document, returns the first error the sink reported */
+esp_err_t json_stream_finish(json_stream_t *js);
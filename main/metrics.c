@@ -0,0 +1,487 @@
+/* Request metrics
+
+   Every URI handler registered through metrics_register_uri_handler() runs behind a
+   wrapper that records request count, status class, bytes sent and a fixed-bucket
+   latency histogram. Counters live in one slot per CPU core and are only bumped
+   with atomic adds, so recording never takes a lock; /metrics sums the cores up.
+
+   Status and bytes are taken from the socket: the wrapper installs a send override
+   on the session that counts everything written while the handler runs and reads
+   the status code from the response status line. The override also holds back
+   sends while a file worker still streams an earlier response on the socket
+   (req_pool.c), so pipelined responses keep their order.
+
+   The wrapper also charges the request to its client (admission.c), so a request
+   over the client's rate is answered with 503 before the handler runs, and runs
+   the handler inside the request arena (req_arena.c), recording how much of it
+   every request used. It keeps the radio awake for the request (wifi_ps.c) and
+   accounts the latency to the power save mode the request arrived in.
+
+   Under HTTPS the send override sits on top of the TLS session's (https.c), so
+   bytes are counted as the handler wrote them, before encryption.
+*/
+#include <stdio.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "req_arena.h"
+#include "admission.h"
+#include "wifi_ps.h"
+#include "https.h"
+#include "req_pool.h"
+#include "metrics.h"
+
+#define METRICS_STATUS_CLASSES (5)
+#define METRICS_OUT_BUF_SIZE (512)
+
+static const char *TAG = "metrics";
+
+/* Upper bounds of the latency histogram buckets, the last bucket is +Inf */
+static const uint32_t s_latency_bounds_us[] = {1000, 5000, 10000, 25000, 50000, 100000,
+                                               250000, 500000, 1000000, 2500000};
+#define METRICS_LATENCY_BUCKETS (sizeof(s_latency_bounds_us) / sizeof(s_latency_bounds_us[0]) + 1)
+
+typedef struct
+{
+    uint32_t status[METRICS_STATUS_CLASSES]; /* 1xx .. 5xx, requests = their sum */
+    uint32_t errors;                         /* handler returned something else than ESP_OK */
+    uint32_t latency[METRICS_LATENCY_BUCKETS];
+    uint64_t latency_sum_us;
+    uint64_t bytes;
+    uint64_t arena_sum; /* request arena bytes, summed over requests */
+    uint32_t arena_max; /* largest arena use of a single request */
+} handler_stats_t;
+
+typedef struct
+{
+    uint64_t bytes;
+    uint64_t us;
+} fs_stats_t;
+
+typedef struct
+{
+    const char *uri;
+    httpd_method_t method;
+    esp_err_t (*handler)(httpd_req_t *r);
+    void *user_ctx;
+} handler_info_t;
+
+/* The request being handled; handlers only run in the HTTP server task */
+typedef struct
+{
+    TaskHandle_t task;
+    int status;
+    size_t bytes;
+} current_req_t;
+
+static handler_info_t s_handlers[METRICS_MAX_HANDLERS];
+static size_t s_handler_count;
+static handler_stats_t s_stats[portNUM_PROCESSORS][METRICS_MAX_HANDLERS];
+static fs_stats_t s_fs_stats[portNUM_PROCESSORS];
+static current_req_t s_current;
+
+static inline void counter_add32(uint32_t *counter, uint32_t value)
+{
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static inline void counter_add64(uint64_t *counter, uint64_t value)
+{
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static inline void counter_max32(uint32_t *counter, uint32_t value)
+{
+    uint32_t seen = __atomic_load_n(counter, __ATOMIC_RELAXED);
+    while (value > seen && !__atomic_compare_exchange_n(counter, &seen, value, true,
+                                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+    }
+}
+
+/* "HTTP/1.1 404 Not Found" -> 404, 0 if buf doesn't start with a status line */
+static int parse_status(const char *buf, size_t len)
+{
+    if (len < 12 || memcmp(buf, "HTTP/1.", 7) != 0)
+    {
+        return 0;
+    }
+    int status = 0;
+    for (int i = 9; i < 12; i++)
+    {
+        if (buf[i] < '0' || buf[i] > '9')
+        {
+            return 0;
+        }
+        status = status * 10 + buf[i] - '0';
+    }
+    return status;
+}
+
+static bool in_request(void)
+{
+    return s_current.task && s_current.task == xTaskGetCurrentTaskHandle();
+}
+
+static void account_sent(const char *buf, size_t len)
+{
+    if (!s_current.status)
+    {
+        s_current.status = parse_status(buf, len);
+    }
+    s_current.bytes += len;
+}
+
+/* Same as the default httpd send function (or the TLS one), plus accounting */
+static int metrics_send(httpd_handle_t hd, int sockfd, const char *buf, size_t buf_len, int flags)
+{
+    if (buf == NULL)
+    {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+    /* Never into the middle of a file a worker still streams on this socket */
+    req_pool_wait_session(hd, sockfd);
+#if CONFIG_EXAMPLE_HTTPS
+    int ret = https_send(hd, sockfd, buf, buf_len, flags);
+    if (ret < 0)
+    {
+        return ret;
+    }
+#else
+    int ret = send(sockfd, buf, buf_len, flags);
+    if (ret < 0)
+    {
+        ESP_LOGD(TAG, "send error %d on socket %d", errno, sockfd);
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+    }
+#endif
+    if (in_request())
+    {
+        account_sent(buf, ret);
+    }
+    return ret;
+}
+
+void metrics_request_handoff(const char *head, size_t head_len, size_t body_len)
+{
+    if (in_request())
+    {
+        account_sent(head, head_len);
+        s_current.bytes += body_len;
+    }
+}
+
+static void record(size_t index, esp_err_t ret, int64_t elapsed_us, size_t arena)
+{
+    handler_stats_t *stats = &s_stats[xPortGetCoreID()][index];
+    int status = s_current.status ? s_current.status : (ret == ESP_OK ? 200 : 500);
+    int status_class = status / 100 - 1;
+    if (status_class < 0 || status_class >= METRICS_STATUS_CLASSES)
+    {
+        status_class = METRICS_STATUS_CLASSES - 1;
+    }
+    size_t bucket = 0;
+    while (bucket < METRICS_LATENCY_BUCKETS - 1 && elapsed_us > s_latency_bounds_us[bucket])
+    {
+        bucket++;
+    }
+    counter_add32(&stats->status[status_class], 1);
+    if (ret != ESP_OK)
+    {
+        counter_add32(&stats->errors, 1);
+    }
+    counter_add32(&stats->latency[bucket], 1);
+    counter_add64(&stats->latency_sum_us, elapsed_us);
+    counter_add64(&stats->bytes, s_current.bytes);
+    counter_add64(&stats->arena_sum, arena);
+    counter_max32(&stats->arena_max, arena);
+}
+
+static esp_err_t metrics_handler(httpd_req_t *req)
+{
+    size_t index = (handler_info_t *)req->user_ctx - s_handlers;
+    const handler_info_t *info = &s_handlers[index];
+
+    httpd_sess_set_send_override(req->handle, httpd_req_to_sockfd(req), metrics_send);
+    s_current.task = xTaskGetCurrentTaskHandle();
+    s_current.status = 0;
+    s_current.bytes = 0;
+    req->user_ctx = info->user_ctx;
+    int64_t start = esp_timer_get_time();
+    wifi_ps_type_t ps = wifi_ps_busy_begin();
+    esp_err_t ret = ESP_OK;
+    size_t arena = 0;
+    if (admission_admit(req))
+    {
+        req_arena_begin();
+        ret = info->handler(req);
+        arena = req_arena_end();
+    }
+    int64_t elapsed_us = esp_timer_get_time() - start;
+    wifi_ps_busy_end();
+    wifi_ps_record(ps, elapsed_us);
+    req->user_ctx = (void *)info;
+    record(index, ret, elapsed_us, arena);
+    s_current.task = NULL;
+    return ret;
+}
+
+esp_err_t metrics_register_uri_handler(httpd_handle_t server, const httpd_uri_t *uri)
+{
+    if (s_handler_count == METRICS_MAX_HANDLERS)
+    {
+        ESP_LOGW(TAG, "No metrics slot for %s", uri->uri);
+        return httpd_register_uri_handler(server, uri);
+    }
+    handler_info_t *info = &s_handlers[s_handler_count];
+    info->uri = uri->uri;
+    info->method = uri->method;
+    info->handler = uri->handler;
+    info->user_ctx = uri->user_ctx;
+
+    httpd_uri_t wrapped = *uri;
+    wrapped.handler = metrics_handler;
+    wrapped.user_ctx = info;
+    esp_err_t err = httpd_register_uri_handler(server, &wrapped);
+    if (err == ESP_OK)
+    {
+        s_handler_count++;
+    }
+    return err;
+}
+
+ssize_t metrics_read(int fd, void *buf, size_t len)
+{
+    int64_t start = esp_timer_get_time();
+    ssize_t ret = read(fd, buf, len);
+    fs_stats_t *stats = &s_fs_stats[xPortGetCoreID()];
+    counter_add64(&stats->us, esp_timer_get_time() - start);
+    if (ret > 0)
+    {
+        counter_add64(&stats->bytes, ret);
+    }
+    return ret;
+}
+
+/* Buffered text output for /metrics, sent as chunks */
+typedef struct
+{
+    httpd_req_t *req;
+    char buf[METRICS_OUT_BUF_SIZE];
+    size_t len;
+    esp_err_t err;
+} metrics_out_t;
+
+static void out_flush(metrics_out_t *out)
+{
+    if (out->len && out->err == ESP_OK)
+    {
+        out->err = httpd_resp_send_chunk(out->req, out->buf, out->len);
+    }
+    out->len = 0;
+}
+
+static void out_printf(metrics_out_t *out, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void out_printf(metrics_out_t *out, const char *fmt, ...)
+{
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        va_list args;
+        va_start(args, fmt);
+        int n = vsnprintf(out->buf + out->len, sizeof(out->buf) - out->len, fmt, args);
+        va_end(args);
+        if (n >= 0 && out->len + n < sizeof(out->buf))
+        {
+            out->len += n;
+            return;
+        }
+        out_flush(out);
+    }
+    ESP_LOGW(TAG, "Metrics line too long, dropped");
+}
+
+static void sum_stats(size_t index, handler_stats_t *sum)
+{
+    memset(sum, 0, sizeof(*sum));
+    for (int core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        const handler_stats_t *stats = &s_stats[core][index];
+        for (int i = 0; i < METRICS_STATUS_CLASSES; i++)
+        {
+            sum->status[i] += __atomic_load_n(&stats->status[i], __ATOMIC_RELAXED);
+        }
+        for (int i = 0; i < METRICS_LATENCY_BUCKETS; i++)
+        {
+            sum->latency[i] += __atomic_load_n(&stats->latency[i], __ATOMIC_RELAXED);
+        }
+        sum->errors += __atomic_load_n(&stats->errors, __ATOMIC_RELAXED);
+        sum->latency_sum_us += __atomic_load_n(&stats->latency_sum_us, __ATOMIC_RELAXED);
+        sum->bytes += __atomic_load_n(&stats->bytes, __ATOMIC_RELAXED);
+        sum->arena_sum += __atomic_load_n(&stats->arena_sum, __ATOMIC_RELAXED);
+        uint32_t arena_max = __atomic_load_n(&stats->arena_max, __ATOMIC_RELAXED);
+        if (arena_max > sum->arena_max)
+        {
+            sum->arena_max = arena_max;
+        }
+    }
+}
+
+static const char *method_name(httpd_method_t method)
+{
+    return http_method_str((enum http_method)method);
+}
+
+esp_err_t metrics_get_handler(httpd_req_t *req)
+{
+    static metrics_out_t out; /* only used from the HTTP server task */
+    handler_stats_t stats;
+
+    out.req = req;
+    out.len = 0;
+    out.err = ESP_OK;
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+
+    out_printf(&out, "# TYPE http_requests_total counter\n");
+    for (size_t h = 0; h < s_handler_count; h++)
+    {
+        sum_stats(h, &stats);
+        for (int i = 0; i < METRICS_STATUS_CLASSES; i++)
+        {
+            out_printf(&out, "http_requests_total{handler=\"%s\",method=\"%s\",code=\"%dxx\"} %" PRIu32 "\n",
+                       s_handlers[h].uri, method_name(s_handlers[h].method), i + 1, stats.status[i]);
+        }
+    }
+    out_printf(&out, "# TYPE http_handler_errors_total counter\n");
+    for (size_t h = 0; h < s_handler_count; h++)
+    {
+        sum_stats(h, &stats);
+        out_printf(&out, "http_handler_errors_total{handler=\"%s\",method=\"%s\"} %" PRIu32 "\n",
+                   s_handlers[h].uri, method_name(s_handlers[h].method), stats.errors);
+    }
+    out_printf(&out, "# TYPE http_response_bytes_total counter\n");
+    for (size_t h = 0; h < s_handler_count; h++)
+    {
+        sum_stats(h, &stats);
+        out_printf(&out, "http_response_bytes_total{handler=\"%s\",method=\"%s\"} %" PRIu64 "\n",
+                   s_handlers[h].uri, method_name(s_handlers[h].method), stats.bytes);
+    }
+    out_printf(&out, "# TYPE http_request_duration_seconds histogram\n");
+    for (size_t h = 0; h < s_handler_count; h++)
+    {
+        const char *uri = s_handlers[h].uri;
+        const char *method = method_name(s_handlers[h].method);
+        uint32_t cumulative = 0;
+        sum_stats(h, &stats);
+        for (int i = 0; i < METRICS_LATENCY_BUCKETS; i++)
+        {
+            cumulative += stats.latency[i];
+            if (i < METRICS_LATENCY_BUCKETS - 1)
+            {
+                out_printf(&out, "http_request_duration_seconds_bucket{handler=\"%s\",method=\"%s\",le=\"%" PRIu32 ".%06" PRIu32 "\"} %" PRIu32 "\n",
+                           uri, method, s_latency_bounds_us[i] / 1000000, s_latency_bounds_us[i] % 1000000, cumulative);
+            }
+            else
+            {
+                out_printf(&out, "http_request_duration_seconds_bucket{handler=\"%s\",method=\"%s\",le=\"+Inf\"} %" PRIu32 "\n",
+                           uri, method, cumulative);
+            }
+        }
+        out_printf(&out, "http_request_duration_seconds_sum{handler=\"%s\",method=\"%s\"} %" PRIu64 ".%06" PRIu64 "\n",
+                   uri, method, stats.latency_sum_us / 1000000, stats.latency_sum_us % 1000000);
+        out_printf(&out, "http_request_duration_seconds_count{handler=\"%s\",method=\"%s\"} %" PRIu32 "\n",
+                   uri, method, cumulative);
+    }
+    out_printf(&out, "# TYPE http_request_arena_bytes summary\n");
+    for (size_t h = 0; h < s_handler_count; h++)
+    {
+        const char *uri = s_handlers[h].uri;
+        const char *method = method_name(s_handlers[h].method);
+        uint32_t requests = 0;
+        sum_stats(h, &stats);
+        for (int i = 0; i < METRICS_STATUS_CLASSES; i++)
+        {
+            requests += stats.status[i];
+        }
+        out_printf(&out, "http_request_arena_bytes_sum{handler=\"%s\",method=\"%s\"} %" PRIu64 "\n",
+                   uri, method, stats.arena_sum);
+        out_printf(&out, "http_request_arena_bytes_count{handler=\"%s\",method=\"%s\"} %" PRIu32 "\n",
+                   uri, method, requests);
+    }
+    out_printf(&out, "# TYPE http_request_arena_peak_bytes gauge\n");
+    for (size_t h = 0; h < s_handler_count; h++)
+    {
+        sum_stats(h, &stats);
+        out_printf(&out, "http_request_arena_peak_bytes{handler=\"%s\",method=\"%s\"} %" PRIu32 "\n",
+                   s_handlers[h].uri, method_name(s_handlers[h].method), stats.arena_max);
+    }
+    out_printf(&out, "# TYPE req_arena_size_bytes gauge\nreq_arena_size_bytes %d\n", CONFIG_EXAMPLE_REQ_ARENA_SIZE);
+    out_printf(&out, "# TYPE req_arena_overflows_total counter\nreq_arena_overflows_total %" PRIu32 "\n",
+               req_arena_overflows());
+#if CONFIG_EXAMPLE_ADMISSION
+    admission_stats_t rejected;
+    admission_get_stats(&rejected);
+    out_printf(&out, "# TYPE http_admission_rejected_total counter\n"
+                     "http_admission_rejected_total{reason=\"rate\"} %" PRIu32 "\n"
+                     "http_admission_rejected_total{reason=\"client_connections\"} %" PRIu32 "\n"
+                     "http_admission_rejected_total{reason=\"busy\"} %" PRIu32 "\n",
+               rejected.rate_limited, rejected.client_connections, rejected.busy);
+#endif
+
+    wifi_ps_stats_t ps;
+    wifi_ps_get_stats(&ps);
+    out_printf(&out, "# TYPE wifi_ps_request_duration_seconds summary\n");
+    for (int mode = 0; mode < WIFI_PS_MODES; mode++)
+    {
+        out_printf(&out, "wifi_ps_request_duration_seconds_sum{mode=\"%s\"} %" PRIu64 ".%06" PRIu64 "\n",
+                   wifi_ps_mode_name(mode), ps.request_us[mode] / 1000000, ps.request_us[mode] % 1000000);
+        out_printf(&out, "wifi_ps_request_duration_seconds_count{mode=\"%s\"} %" PRIu32 "\n",
+                   wifi_ps_mode_name(mode), ps.requests[mode]);
+    }
+    out_printf(&out, "# TYPE wifi_ps_wakeups_total counter\nwifi_ps_wakeups_total %" PRIu32 "\n", ps.wakeups);
+
+#if CONFIG_EXAMPLE_HTTPS
+    /* Resumption hit rate = (ticket + cache) / all successful handshakes */
+    https_stats_t tls;
+    https_get_stats(&tls);
+    out_printf(&out, "# TYPE https_handshake_seconds summary\n");
+    for (int type = 0; type < HTTPS_HANDSHAKE_TYPES; type++)
+    {
+        out_printf(&out, "https_handshake_seconds_sum{type=\"%s\"} %" PRIu64 ".%06" PRIu64 "\n",
+                   https_handshake_name(type), tls.us[type] / 1000000, tls.us[type] % 1000000);
+        out_printf(&out, "https_handshake_seconds_count{type=\"%s\"} %" PRIu32 "\n",
+                   https_handshake_name(type), tls.count[type]);
+    }
+#endif
+
+    uint64_t fs_bytes = 0, fs_us = 0;
+    for (int core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        fs_bytes += __atomic_load_n(&s_fs_stats[core].bytes, __ATOMIC_RELAXED);
+        fs_us += __atomic_load_n(&s_fs_stats[core].us, __ATOMIC_RELAXED);
+    }
+    out_printf(&out, "# TYPE fs_read_bytes_total counter\nfs_read_bytes_total %" PRIu64 "\n", fs_bytes);
+    out_printf(&out, "# TYPE fs_read_seconds_total counter\nfs_read_seconds_total %" PRIu64 ".%06" PRIu64 "\n",
+               fs_us / 1000000, fs_us % 1000000);
+    out_printf(&out, "# TYPE heap_free_bytes gauge\nheap_free_bytes %zu\n",
+               heap_caps_get_free_size(MALLOC_CAP_8BIT));
+    out_printf(&out, "# TYPE heap_min_free_bytes gauge\nheap_min_free_bytes %zu\n",
+               heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT));
+    out_printf(&out, "# TYPE heap_largest_free_block_bytes gauge\nheap_largest_free_block_bytes %zu\n",
+               heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+
+    out_flush(&out);
+    if (out.err == ESP_OK)
+    {
+        out.err = httpd_resp_send_chunk(req, NULL, 0);
+    }
+    return out.err;
+}
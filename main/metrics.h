@@ -0,0 +1,24 @@
+// metrics.h
+#pragma once
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+/* Most URI handlers that can be registered through metrics_register_uri_handler() */
+#define METRICS_MAX_HANDLERS (16)
+
+/* Register uri with a wrapper that counts requests, status classes, bytes sent and
+ * latency for it. The wrapped handler sees its own user_ctx as usual. */
+esp_err_t metrics_register_uri_handler(httpd_handle_t server, const httpd_uri_t *uri);
+
+/* The handler handed the response over to another task (see req_pool_send_file):
+ * account head_len + body_len bytes and the status from head to the current request */
+void metrics_request_handoff(const char *head, size_t head_len, size_t body_len);
+
+/* read() that feeds the filesystem throughput counters */
+ssize_t metrics_read(int fd, void *buf, size_t len);
+
+/* GET handler for /metrics, Prometheus text format */
+esp_err_t metrics_get_handler(httpd_req_t *req);
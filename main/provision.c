@@ -0,0 +1,194 @@
+/* SoftAP to station provisioning without a reboot
+
+   While the provisioning SoftAP runs, credentials posted to /updpassword are
+   tried right away on the station side of the APSTA mode; the SoftAP and the page
+   served from it stay up, and the page polls /provision for the outcome. Only
+   credentials that connected are stored. On success the running server swaps its
+   root from the softap site to the prod site (rest_server_set_base_path, applied
+   between requests in the HTTP server task), the background scanner stops, and
+   after CONFIG_EXAMPLE_PROVISION_SOFTAP_LINGER_S the SoftAP is dropped so the
+   device ends up where a boot with stored credentials would have put it.
+
+   The station adopts the channel of the AP it joins, so SoftAP clients on another
+   channel see a short drop while an attempt runs.
+*/
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "wifi.h"
+#include "json_stream.h"
+#include "provision.h"
+
+#define PROVISION_TASK_STACK_SIZE (4096)
+#define PROVISION_TASK_PRIORITY (3)
+#define PROVISION_RESP_BUF_SIZE (192 + JSON_STREAM_HTTPD_HEAD)
+
+esp_err_t rest_server_set_base_path(const char *base_path);
+
+static const char *TAG = "provision";
+
+static const char *const s_state_names[] = {
+    [PROVISION_OFF] = "off",
+    [PROVISION_SOFTAP] = "softap",
+    [PROVISION_CONNECTING] = "connecting",
+    [PROVISION_FAILED] = "failed",
+    [PROVISION_CONNECTED] = "connected",
+};
+
+static SemaphoreHandle_t s_lock;
+static TaskHandle_t s_task;
+static provision_status_t s_status;
+/* Credentials of the current attempt, only written while no attempt runs */
+static char s_ssid[AP_SSID_MAX_LEN + 1];
+static char s_password[CRED_PASSWORD_MAX_LEN + 1];
+
+static void provision_set(provision_state_t state, bool softap)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_status.state = state;
+    s_status.softap = softap;
+    if (state == PROVISION_CONNECTED)
+    {
+        wifi_sta_stats_t stats;
+        wifi_get_sta_stats(&stats);
+        s_status.ip = stats.ip;
+    }
+    xSemaphoreGive(s_lock);
+}
+
+static void provision_task(void *arg)
+{
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        /* Connecting and scanning exclude each other */
+        ap_scan_pause();
+        if (wifi_connect_apsta(s_ssid, s_password) == ESP_OK)
+        {
+            break;
+        }
+        ap_scan_resume();
+        ESP_LOGW(TAG, "%s didn't connect, SoftAP stays up", s_ssid);
+        provision_set(PROVISION_FAILED, true);
+    }
+
+    if (cred_store_save(s_ssid, s_password) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Connected, but the next boot won't know %s", s_ssid);
+    }
+#if CONFIG_EXAMPLE_CRED_EXPORT_SD
+    cred_store_export(CRED_STORE_FILE);
+#endif
+    ssid = s_ssid;
+    password = s_password;
+    /* A station doesn't scan in the background, same as after a normal boot */
+    ap_scan_stop();
+    ap_scan_resume();
+    if (rest_server_set_base_path("/www/prod") != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to switch to the prod site");
+    }
+    provision_set(PROVISION_CONNECTED, true);
+    ESP_LOGI(TAG, "Connected to %s, SoftAP stops in %d s", s_ssid, CONFIG_EXAMPLE_PROVISION_SOFTAP_LINGER_S);
+
+    /* Give the page time to read the new address over the SoftAP */
+    vTaskDelay(pdMS_TO_TICKS(CONFIG_EXAMPLE_PROVISION_SOFTAP_LINGER_S * 1000));
+    wifi_stop_softap();
+    provision_set(PROVISION_CONNECTED, false);
+    s_task = NULL;
+    vTaskDelete(NULL);
+}
+
+esp_err_t provision_start(void)
+{
+    if (s_task)
+    {
+        return ESP_OK;
+    }
+    if (!s_lock)
+    {
+        s_lock = xSemaphoreCreateMutex();
+        if (!s_lock)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    provision_set(PROVISION_SOFTAP, true);
+    if (xTaskCreate(provision_task, "provision", PROVISION_TASK_STACK_SIZE, NULL,
+                    PROVISION_TASK_PRIORITY, &s_task) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to create provisioning task");
+        provision_set(PROVISION_OFF, false);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t provision_try(const char *ap_name, const char *ap_password)
+{
+    if (!s_lock)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!ap_name[0] || strlen(ap_name) >= sizeof(s_ssid) || strlen(ap_password) >= sizeof(s_password))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    provision_state_t state = s_status.state;
+    if (state == PROVISION_SOFTAP || state == PROVISION_FAILED)
+    {
+        strlcpy(s_ssid, ap_name, sizeof(s_ssid));
+        strlcpy(s_password, ap_password, sizeof(s_password));
+        strlcpy(s_status.ssid, ap_name, sizeof(s_status.ssid));
+        s_status.state = PROVISION_CONNECTING;
+    }
+    xSemaphoreGive(s_lock);
+    if (state != PROVISION_SOFTAP && state != PROVISION_FAILED)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    ESP_LOGI(TAG, "Trying %s", ap_name);
+    xTaskNotifyGive(s_task);
+    return ESP_OK;
+}
+
+void provision_get_status(provision_status_t *status)
+{
+    if (!s_lock)
+    {
+        memset(status, 0, sizeof(*status));
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *status = s_status;
+    xSemaphoreGive(s_lock);
+}
+
+esp_err_t provision_status_get_handler(httpd_req_t *req)
+{
+    char buf[PROVISION_RESP_BUF_SIZE];
+    char ip[16];
+    json_stream_t js;
+    provision_status_t status;
+
+    provision_get_status(&status);
+    json_stream_init_httpd(&js, req, buf, sizeof(buf));
+    json_stream_obj_begin(&js, NULL);
+    json_stream_str(&js, "state", s_state_names[status.state]);
+    json_stream_bool(&js, "softap", status.softap);
+    if (status.state != PROVISION_OFF && status.state != PROVISION_SOFTAP)
+    {
+        json_stream_str(&js, "ssid", status.ssid);
+    }
+    if (status.state == PROVISION_CONNECTED)
+    {
+        snprintf(ip, sizeof(ip), IPSTR, IP2STR(&status.ip));
+        json_stream_str(&js, "ip", ip);
+    }
+    json_stream_obj_end(&js);
+    return json_stream_finish(&js);
+}
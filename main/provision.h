@@ -0,0 +1,39 @@
+// provision.h
+#pragma once
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "esp_netif.h"
+#include "ap_scan.h"
+#include "cred_store.h"
+
+typedef enum
+{
+    PROVISION_OFF,        /* not provisioning, the device booted as a station */
+    PROVISION_SOFTAP,     /* SoftAP up, waiting for credentials */
+    PROVISION_CONNECTING, /* trying the posted credentials, SoftAP still up */
+    PROVISION_FAILED,     /* last attempt failed, SoftAP still up, credentials unchanged */
+    PROVISION_CONNECTED,  /* station connected, /prod served, SoftAP lingers a while */
+} provision_state_t;
+
+typedef struct
+{
+    provision_state_t state;
+    bool softap;                    /* the SoftAP still runs */
+    char ssid[AP_SSID_MAX_LEN + 1]; /* of the last attempt */
+    esp_ip4_addr_t ip;              /* station address once connected */
+} provision_status_t;
+
+/* Enter provisioning: the SoftAP runs and the server serves the softap site */
+esp_err_t provision_start(void);
+
+/* Try ap_name/ap_password in APSTA mode in the background; the credentials are only
+ * stored once they connect. ESP_ERR_INVALID_STATE if the device isn't
+ * provisioning or an attempt is still running. */
+esp_err_t provision_try(const char *ap_name, const char *ap_password);
+
+void provision_get_status(provision_status_t *status);
+
+/* GET handler for /provision:
+ *   {"state":"connected","softap":true,"ssid":"..","ip":"192.168.1.23"} */
+esp_err_t provision_status_get_handler(httpd_req_t *req);
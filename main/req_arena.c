@@ -0,0 +1,103 @@
+/* Request arena
+
+   One statically allocated bump arena of CONFIG_EXAMPLE_REQ_ARENA_SIZE bytes for
+   the temporaries of the request being handled: cJSON trees (through
+   cJSON_InitHooks) and req_arena_alloc() scratch. Freeing is a no-op, the whole
+   arena is reset in one step when the handler returns, so an early return can't
+   leak and request-sized allocations never fragment the heap the Wi-Fi stack
+   lives on. An allocation that doesn't fit fails instead of spilling to the heap.
+
+   cJSON is shared with code running outside of requests (credential import at
+   boot), so the hooks only use the arena for the task that owns it and fall back
+   to malloc/free for everyone else. The hooks are global: nothing may call
+   cJSON_InitHooks once the server is up, or arena pointers end up in free(). The
+   JSON benchmark installs its own hooks and therefore runs before the server.
+*/
+#include <stdint.h>
+#include <stdlib.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "cJSON.h"
+#include "req_arena.h"
+
+#define REQ_ARENA_SIZE CONFIG_EXAMPLE_REQ_ARENA_SIZE
+#define REQ_ARENA_ALIGN (8)
+
+static const char *TAG = "req_arena";
+
+static uint8_t s_arena[REQ_ARENA_SIZE] __attribute__((aligned(REQ_ARENA_ALIGN)));
+static size_t s_used;
+static TaskHandle_t s_owner;
+static uint32_t s_overflows;
+
+static bool arena_owned(void)
+{
+    TaskHandle_t owner = __atomic_load_n(&s_owner, __ATOMIC_RELAXED);
+    return owner && owner == xTaskGetCurrentTaskHandle();
+}
+
+static bool in_arena(const void *ptr)
+{
+    return (const uint8_t *)ptr >= s_arena && (const uint8_t *)ptr < s_arena + REQ_ARENA_SIZE;
+}
+
+static void *arena_take(size_t size)
+{
+    size = (size + REQ_ARENA_ALIGN - 1) & ~(size_t)(REQ_ARENA_ALIGN - 1);
+    if (size > REQ_ARENA_SIZE - s_used)
+    {
+        __atomic_add_fetch(&s_overflows, 1, __ATOMIC_RELAXED);
+        ESP_LOGW(TAG, "%zu bytes don't fit, %zu of %d in use", size, s_used, REQ_ARENA_SIZE);
+        return NULL;
+    }
+    void *ptr = s_arena + s_used;
+    s_used += size;
+    return ptr;
+}
+
+static void *cjson_malloc(size_t size)
+{
+    return arena_owned() ? arena_take(size) : malloc(size);
+}
+
+static void cjson_free(void *ptr)
+{
+    if (!in_arena(ptr))
+    {
+        free(ptr);
+    }
+}
+
+esp_err_t req_arena_init(void)
+{
+    cJSON_Hooks hooks = {.malloc_fn = cjson_malloc, .free_fn = cjson_free};
+    cJSON_InitHooks(&hooks);
+    return ESP_OK;
+}
+
+void req_arena_begin(void)
+{
+    s_used = 0;
+    __atomic_store_n(&s_owner, xTaskGetCurrentTaskHandle(), __ATOMIC_RELAXED);
+}
+
+size_t req_arena_end(void)
+{
+    /* Bump allocation: the final offset is the peak */
+    size_t peak = s_used;
+    __atomic_store_n(&s_owner, NULL, __ATOMIC_RELAXED);
+    s_used = 0;
+    return peak;
+}
+
+void *req_arena_alloc(size_t size)
+{
+    return arena_owned() ? arena_take(size) : NULL;
+}
+
+uint32_t req_arena_overflows(void)
+{
+    return __atomic_load_n(&s_overflows, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,25 @@
+// req_arena.h
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/* Install the cJSON allocation hooks. cJSON calls made by the task inside
+ * req_arena_begin()/req_arena_end() allocate from the arena, all others keep
+ * using the heap. */
+esp_err_t req_arena_init(void);
+
+/* The calling task owns the arena until req_arena_end(), which releases
+ * everything allocated meanwhile at once and returns the bytes the request used
+ * at its peak. Only one request can hold the arena: handlers run one at a time
+ * in the HTTP server task. */
+void req_arena_begin(void);
+size_t req_arena_end(void);
+
+/* Scratch memory for the current request, NULL outside a request or when the
+ * arena is full. Never freed individually. */
+void *req_arena_alloc(size_t size);
+
+/* Allocations the arena had to refuse since boot */
+uint32_t req_arena_overflows(void);
@@ -0,0 +1,488 @@
+/* Request I/O buffers and worker tasks
+
+   Handlers borrow a buffer from a fixed pool instead of sharing one scratch area,
+   and long file responses are handed to a small pool of worker tasks so the httpd
+   task can go on parsing requests from other sockets.
+
+   The worker writes to the socket with httpd_socket_send() after the handler has
+   returned. A reference counted token stored as the session context tells it when
+   httpd closes the socket, so it never writes into a descriptor that was reused
+   for a new connection.
+
+   While a worker streams, the socket is parked: a request pipelined behind the
+   file is parsed by httpd, but its handler waits for the stream to end before it
+   sends anything (req_pool_wait_session() in the send path) or hands another file
+   over. Responses leave in request order and only one task writes to the socket at
+   a time; the HTTP server task only waits for clients that pipeline.
+
+   Sockets that get a file streamed have Nagle turned off, every chunk is a full
+   write and only the partial last one would otherwise wait for a delayed ACK.
+
+   Every worker is paired with a reader task. The reader fills a ring of DMA capable
+   chunks from the file while the worker sends the chunks already read, so the SD
+   bus and the Wi-Fi TX path work at the same time instead of taking turns.
+*/
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_heap_caps.h"
+#include "req_pool.h"
+#include "metrics.h"
+#include "sched_profile.h"
+#include "wifi_ps.h"
+
+#define REQ_WORKER_STACK_SIZE (3072)
+/* Upper end of EXAMPLE_REQ_WORKERS */
+#define REQ_WORKERS_MAX (8)
+
+static const char *TAG = "req_pool";
+
+/* Session context shared by httpd and the worker sending on that socket */
+typedef struct
+{
+    xSemaphoreHandle lock;
+    xSemaphoreHandle idle; /* taken while a worker streams a response on the socket */
+    int refs;
+    bool closed;
+} req_session_t;
+
+typedef struct
+{
+    httpd_handle_t hd;
+    int sockfd;
+    req_session_t *session;
+    int fd;
+    size_t length;
+    bool cancelled; /* set by the worker when the client is gone, stops the reader */
+    size_t head_len;
+    char head[REQ_HEAD_MAX];
+} req_job_t;
+
+typedef struct
+{
+    char *data;  /* REQ_HEAD_MAX bytes of headroom in front, for the response head */
+    ssize_t len; /* bytes read, <= 0 ends the file early */
+} req_chunk_t;
+
+/* A worker and its reader task, chunks circulate between the two queues */
+typedef struct
+{
+    QueueHandle_t reads;       /* req_job_t *, file the reader should read next */
+    QueueHandle_t free_chunks; /* req_chunk_t *, empty */
+    QueueHandle_t full_chunks; /* req_chunk_t *, read, in file order */
+} req_worker_t;
+
+static QueueHandle_t s_free_bufs;
+static QueueHandle_t s_jobs;
+static int s_idle_workers;
+static TaskHandle_t s_worker_tasks[REQ_WORKERS_MAX];
+
+static void session_put(req_session_t *session)
+{
+    if (__atomic_sub_fetch(&session->refs, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        vSemaphoreDelete(session->lock);
+        vSemaphoreDelete(session->idle);
+        free(session);
+    }
+}
+
+/* Called by httpd when the socket is closed */
+static void session_free_ctx(void *ctx)
+{
+    req_session_t *session = ctx;
+    xSemaphoreTake(session->lock, portMAX_DELAY);
+    session->closed = true;
+    xSemaphoreGive(session->lock);
+    session_put(session);
+}
+
+static req_session_t *session_get(httpd_req_t *req)
+{
+    req_session_t *session = req->sess_ctx;
+    if (!session)
+    {
+        session = calloc(1, sizeof(req_session_t));
+        if (!session || !(session->lock = xSemaphoreCreateMutex()) || !(session->idle = xSemaphoreCreateBinary()))
+        {
+            if (session && session->lock)
+            {
+                vSemaphoreDelete(session->lock);
+            }
+            free(session);
+            return NULL;
+        }
+        xSemaphoreGive(session->idle);
+        /* A streamed file ends in a partial segment, with Nagle on it would wait for
+           the client's delayed ACK of the chunks before it */
+        int one = 1;
+        setsockopt(httpd_req_to_sockfd(req), IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        session->refs = 1;
+        req->sess_ctx = session;
+        req->free_ctx = session_free_ctx;
+    }
+    __atomic_add_fetch(&session->refs, 1, __ATOMIC_ACQ_REL);
+    return session;
+}
+
+/* Send the whole buffer unless httpd has closed the session meanwhile */
+static bool session_send(const req_job_t *job, const char *data, size_t len)
+{
+    bool ok = true;
+    xSemaphoreTake(job->session->lock, portMAX_DELAY);
+    while (ok && len > 0)
+    {
+        int sent = job->session->closed ? -1 : httpd_socket_send(job->hd, job->sockfd, data, len, 0);
+        ok = (sent > 0);
+        if (ok)
+        {
+            data += sent;
+            len -= sent;
+        }
+    }
+    xSemaphoreGive(job->session->lock);
+    return ok;
+}
+
+static void req_reader_task(void *arg)
+{
+    req_worker_t *worker = arg;
+    const size_t chunk_size = CONFIG_EXAMPLE_READAHEAD_CHUNK_SIZE;
+    req_job_t *job;
+    for (;;)
+    {
+        xQueueReceive(worker->reads, &job, portMAX_DELAY);
+        /* The worker frees job once it has the last chunk, keep what's needed after that */
+        int fd = job->fd;
+        size_t remaining = job->length;
+        while (remaining > 0)
+        {
+            req_chunk_t *chunk;
+            xQueueReceive(worker->free_chunks, &chunk, portMAX_DELAY);
+            ssize_t len = 0;
+            if (!__atomic_load_n(&job->cancelled, __ATOMIC_ACQUIRE))
+            {
+                len = metrics_read(fd, chunk->data, remaining < chunk_size ? remaining : chunk_size);
+            }
+            chunk->len = len;
+            xQueueSend(worker->full_chunks, &chunk, portMAX_DELAY);
+            if (len <= 0)
+            {
+                break;
+            }
+            remaining -= len;
+        }
+        close(fd);
+    }
+}
+
+static void req_worker_task(void *arg)
+{
+    req_worker_t *worker = arg;
+    req_job_t *job;
+    for (;;)
+    {
+        xQueueReceive(s_jobs, &job, portMAX_DELAY);
+        xQueueSend(worker->reads, &job, portMAX_DELAY);
+        bool ok = true;
+        bool head_sent = false;
+        /* Drain every chunk the reader produces, even after a failure, so the
+           ring is complete again before the next job */
+        size_t remaining = job->length;
+        while (remaining > 0)
+        {
+            req_chunk_t *chunk;
+            xQueueReceive(worker->full_chunks, &chunk, portMAX_DELAY);
+            ssize_t len = chunk->len;
+            if (len > 0 && ok)
+            {
+                /* The head rides in the headroom of the first chunk, one send for both */
+                const char *data = chunk->data;
+                if (!head_sent)
+                {
+                    data -= job->head_len;
+                    memcpy((char *)data, job->head, job->head_len);
+                    head_sent = true;
+                }
+                ok = session_send(job, data, chunk->data + len - data);
+                if (!ok)
+                {
+                    __atomic_store_n(&job->cancelled, true, __ATOMIC_RELEASE);
+                }
+            }
+            xQueueSend(worker->free_chunks, &chunk, portMAX_DELAY);
+            if (len <= 0)
+            {
+                if (ok)
+                {
+                    ESP_LOGE(TAG, "Failed to read file, %zu bytes left", remaining);
+                    ok = false;
+                }
+                break;
+            }
+            remaining -= len;
+        }
+        if (!ok)
+        {
+            /* Content-Length promised more than we sent, the connection can't be reused */
+            xSemaphoreTake(job->session->lock, portMAX_DELAY);
+            if (!job->session->closed)
+            {
+                httpd_sess_trigger_close(job->hd, job->sockfd);
+            }
+            xSemaphoreGive(job->session->lock);
+            ESP_LOGE(TAG, "File sending failed!");
+        }
+        xSemaphoreGive(job->session->idle);
+        session_put(job->session);
+        free(job);
+        wifi_ps_busy_end();
+        __atomic_add_fetch(&s_idle_workers, 1, __ATOMIC_RELEASE);
+    }
+}
+
+static req_buf_t *req_buf_alloc(void)
+{
+    req_buf_t *buf = malloc(sizeof(req_buf_t));
+    if (buf && !(buf->data = malloc(CONFIG_EXAMPLE_REQ_BUFFER_SIZE)))
+    {
+        free(buf);
+        return NULL;
+    }
+    if (buf)
+    {
+        buf->size = CONFIG_EXAMPLE_REQ_BUFFER_SIZE;
+    }
+    return buf;
+}
+
+/* Frees a worker that no task uses yet, with whatever chunks it got so far */
+static void req_worker_free(req_worker_t *worker)
+{
+    req_chunk_t *chunk;
+    while (worker->free_chunks && xQueueReceive(worker->free_chunks, &chunk, 0) == pdTRUE)
+    {
+        heap_caps_free(chunk->data - REQ_HEAD_MAX);
+        free(chunk);
+    }
+    if (worker->reads)
+    {
+        vQueueDelete(worker->reads);
+    }
+    if (worker->free_chunks)
+    {
+        vQueueDelete(worker->free_chunks);
+    }
+    if (worker->full_chunks)
+    {
+        vQueueDelete(worker->full_chunks);
+    }
+    free(worker);
+}
+
+static req_worker_t *req_worker_alloc(void)
+{
+    req_worker_t *worker = calloc(1, sizeof(req_worker_t));
+    if (!worker)
+    {
+        return NULL;
+    }
+    worker->reads = xQueueCreate(1, sizeof(req_job_t *));
+    worker->free_chunks = xQueueCreate(CONFIG_EXAMPLE_READAHEAD_CHUNKS, sizeof(req_chunk_t *));
+    worker->full_chunks = xQueueCreate(CONFIG_EXAMPLE_READAHEAD_CHUNKS, sizeof(req_chunk_t *));
+    if (!worker->reads || !worker->free_chunks || !worker->full_chunks)
+    {
+        req_worker_free(worker);
+        return NULL;
+    }
+    for (int i = 0; i < CONFIG_EXAMPLE_READAHEAD_CHUNKS; i++)
+    {
+        /* DMA capable so the SD driver reads straight into the chunk, no bounce buffer */
+        req_chunk_t *chunk = malloc(sizeof(req_chunk_t));
+        if (!chunk || !(chunk->data = heap_caps_malloc(REQ_HEAD_MAX + CONFIG_EXAMPLE_READAHEAD_CHUNK_SIZE, MALLOC_CAP_DMA)))
+        {
+            free(chunk);
+            req_worker_free(worker);
+            return NULL;
+        }
+        chunk->data += REQ_HEAD_MAX;
+        xQueueSend(worker->free_chunks, &chunk, 0);
+    }
+    return worker;
+}
+
+esp_err_t req_pool_init(void)
+{
+    if (s_free_bufs)
+    {
+        return ESP_OK;
+    }
+    s_free_bufs = xQueueCreate(CONFIG_EXAMPLE_REQ_BUFFER_COUNT, sizeof(req_buf_t *));
+    if (!s_free_bufs)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < CONFIG_EXAMPLE_REQ_BUFFER_COUNT; i++)
+    {
+        req_buf_t *buf = req_buf_alloc();
+        if (!buf)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+        xQueueSend(s_free_bufs, &buf, 0);
+    }
+
+    if (CONFIG_EXAMPLE_REQ_WORKERS > 0)
+    {
+        s_jobs = xQueueCreate(CONFIG_EXAMPLE_REQ_WORKERS, sizeof(req_job_t *));
+        if (!s_jobs)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    for (int i = 0; i < CONFIG_EXAMPLE_REQ_WORKERS; i++)
+    {
+        /* Workers own their chunks so they never wait on handlers for a buffer */
+        req_worker_t *worker = req_worker_alloc();
+        if (!worker)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+        if (xTaskCreatePinnedToCore(req_reader_task, "req_reader", REQ_WORKER_STACK_SIZE, worker,
+                                    SCHED_READER_PRIORITY, NULL, SCHED_READER_CORE) != pdPASS)
+        {
+            req_worker_free(worker);
+            return ESP_ERR_NO_MEM;
+        }
+        /* The reader already waits on the worker's queues, it stays allocated */
+        if (xTaskCreatePinnedToCore(req_worker_task, "req_worker", REQ_WORKER_STACK_SIZE, worker,
+                                    SCHED_WORKER_PRIORITY, &s_worker_tasks[i], SCHED_WORKER_CORE) != pdPASS)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+        __atomic_add_fetch(&s_idle_workers, 1, __ATOMIC_RELEASE);
+    }
+    ESP_LOGI(TAG, "%d request buffers of %d bytes, %d workers with %d read-ahead chunks of %d bytes",
+             CONFIG_EXAMPLE_REQ_BUFFER_COUNT, CONFIG_EXAMPLE_REQ_BUFFER_SIZE, CONFIG_EXAMPLE_REQ_WORKERS,
+             CONFIG_EXAMPLE_READAHEAD_CHUNKS, CONFIG_EXAMPLE_READAHEAD_CHUNK_SIZE);
+    return ESP_OK;
+}
+
+req_buf_t *req_buf_acquire(TickType_t wait)
+{
+    req_buf_t *buf = NULL;
+    if (xQueueReceive(s_free_bufs, &buf, wait) != pdTRUE)
+    {
+        if (wait)
+        {
+            ESP_LOGW(TAG, "All request buffers busy");
+        }
+        return NULL;
+    }
+    return buf;
+}
+
+void req_buf_release(req_buf_t *buf)
+{
+    if (buf)
+    {
+        xQueueSend(s_free_bufs, &buf, portMAX_DELAY);
+    }
+}
+
+/* Reserve an idle worker, the job queue never holds more jobs than there are workers */
+static bool worker_reserve(void)
+{
+    int idle = __atomic_load_n(&s_idle_workers, __ATOMIC_ACQUIRE);
+    do
+    {
+        if (idle <= 0)
+        {
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&s_idle_workers, &idle, idle - 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    return true;
+}
+
+static bool is_worker(void)
+{
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    for (int i = 0; i < CONFIG_EXAMPLE_REQ_WORKERS; i++)
+    {
+        if (s_worker_tasks[i] == self)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void session_wait_idle(req_session_t *session)
+{
+    xSemaphoreTake(session->idle, portMAX_DELAY);
+    xSemaphoreGive(session->idle);
+}
+
+void req_pool_wait_session(httpd_handle_t hd, int sockfd)
+{
+    if (__atomic_load_n(&s_idle_workers, __ATOMIC_ACQUIRE) == CONFIG_EXAMPLE_REQ_WORKERS || is_worker())
+    {
+        return;
+    }
+    /* Only req_pool uses the session context */
+    req_session_t *session = httpd_sess_get_ctx(hd, sockfd);
+    if (session)
+    {
+        session_wait_idle(session);
+    }
+}
+
+esp_err_t req_pool_send_file(httpd_req_t *req, int fd, size_t length, const char *head, size_t head_len)
+{
+    if (head_len > REQ_HEAD_MAX || CONFIG_EXAMPLE_REQ_WORKERS == 0)
+    {
+        return ESP_ERR_TIMEOUT;
+    }
+    req_session_t *session = session_get(req);
+    if (!session)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    /* A file pipelined behind one still streaming on this socket waits its turn */
+    xSemaphoreTake(session->idle, portMAX_DELAY);
+    if (!worker_reserve())
+    {
+        xSemaphoreGive(session->idle);
+        session_put(session);
+        return ESP_ERR_TIMEOUT;
+    }
+    req_job_t *job = malloc(sizeof(req_job_t));
+    if (!job)
+    {
+        __atomic_add_fetch(&s_idle_workers, 1, __ATOMIC_RELEASE);
+        xSemaphoreGive(session->idle);
+        session_put(session);
+        return ESP_ERR_NO_MEM;
+    }
+    job->session = session;
+    job->hd = req->handle;
+    job->sockfd = httpd_req_to_sockfd(req);
+    job->fd = fd;
+    job->length = length;
+    job->cancelled = false;
+    job->head_len = head_len;
+    memcpy(job->head, head, head_len);
+    metrics_request_handoff(head, head_len, length);
+    /* The stream keeps the radio awake after the handler returned, until the worker is done */
+    wifi_ps_busy_begin();
+    xQueueSend(s_jobs, &job, portMAX_DELAY);
+    return ESP_OK;
+}
@@ -0,0 +1,36 @@
+// req_pool.h
+#pragma once
+
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "freertos/FreeRTOS.h"
+
+/* Largest raw response head (status line and headers) a worker can send */
+#define REQ_HEAD_MAX (512)
+
+typedef struct
+{
+    char *data;
+    size_t size;
+} req_buf_t;
+
+/* Allocate the I/O buffer pool and start the worker tasks */
+esp_err_t req_pool_init(void);
+
+/* Borrow an I/O buffer for the duration of a request, NULL if none frees up in time.
+ * With wait 0 a busy pool is expected and not logged. */
+req_buf_t *req_buf_acquire(TickType_t wait);
+void req_buf_release(req_buf_t *buf);
+
+/* Hand the rest of a file response over to a worker task.
+ * head holds the complete status line and headers, the worker sends it followed by
+ * length bytes read from fd. On ESP_OK the worker owns fd and the handler must
+ * return without sending anything else. Fails with ESP_ERR_TIMEOUT when all
+ * workers are busy, the caller then serves the file itself. */
+esp_err_t req_pool_send_file(httpd_req_t *req, int fd, size_t length, const char *head, size_t head_len);
+
+/* Block until the file response a worker streams on sockfd has been sent. Called
+ * before every send on a server socket, it keeps the response to a pipelined
+ * request behind the one still streaming; the workers themselves pass. */
+void req_pool_wait_session(httpd_handle_t hd, int sockfd);
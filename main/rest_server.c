@@ -6,8 +6,13 @@
    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
    CONDITIONS OF ANY KIND, either express or implied.
 */
+#include <stdint.h>
 #include <string.h>
+#include <ctype.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "esp_http_server.h"
 #include "esp_system.h"
 #include "esp_log.h"
@@ -15,6 +20,29 @@
 #include "cJSON.h"
 #include "esp_wifi.h"
 #include "wifi.h"
+#include "asset_manifest.h"
+#include "file_cache.h"
+#include "req_pool.h"
+#include "asset_index.h"
+#include "json_stream.h"
+#include "ap_scan.h"
+#include "boot_timeline.h"
+#include "metrics.h"
+#include "cbor.h"
+#include "rssi_history.h"
+#include "cred_store.h"
+#include "provision.h"
+#include "req_arena.h"
+#include "admission.h"
+#include "sched_profile.h"
+#include "wifi_ps.h"
+#include "https.h"
+#if CONFIG_EXAMPLE_AP_PUSH
+#include "ap_push.h"
+#endif
+#if CONFIG_EXAMPLE_WEB_DEPLOY_BUNDLE
+#include "asset_bundle.h"
+#endif
 #include "freertos/semphr.h"
 
 static const char *REST_TAG = "esp-rest";
@@ -29,18 +57,58 @@ static const char *REST_TAG = "esp-rest";
     } while (0)
 
 #define FILE_PATH_MAX (ESP_VFS_PATH_MAX + 128)
-#define SCRATCH_credentials_strSIZE (10240)
+/* How long a handler waits for a free request buffer before answering 503 */
+#define REQ_BUF_WAIT_MS (500)
+/* Stack buffer of the JSON API handlers, smaller documents are sent in one piece */
+#define JSON_RESP_BUF_SIZE (512 + JSON_STREAM_HTTPD_HEAD)
 
 typedef struct rest_server_context
 {
     char base_path[ESP_VFS_PATH_MAX + 1];
-    char scratch[SCRATCH_credentials_strSIZE];
+    asset_manifest_t *manifest;
+    const asset_site_t *site; /* compile-time index, NULL if the build didn't see this site */
 } rest_server_context_t;
 
+/* Site being served, NULL until the boot pipeline has picked one. Only read and
+ * replaced in the HTTP server task, see rest_server_set_base_path() */
+static rest_server_context_t *s_rest_context;
+static httpd_handle_t s_server;
+
+/* Headers of a static file response, applied through httpd or formatted for a worker */
+typedef struct
+{
+    const char *content_type;
+    const char *cache_control;
+    const char *coding;
+    const char *etag;
+} file_resp_hdrs_t;
+
 #define CHECK_FILE_EXTENSION(filename, ext) (strcasecmp(&filename[strlen(filename) - strlen(ext)], ext) == 0)
+#define ACCEPT_ENCODING_MAX (128)
+#define IF_NONE_MATCH_MAX (128)
+#define ETAG_MAX (ASSET_ETAG_LEN + 8)
+#define RANGE_HDR_MAX (64)
+#define CONTENT_RANGE_MAX (48)
+
+/* Cache-Control for file names carrying a content hash, everything else is revalidated */
+#define CACHE_CONTROL_IMMUTABLE "public, max-age=31536000, immutable"
+#define CACHE_CONTROL_REVALIDATE "no-cache"
+
+/* Precompressed sidecars produced by the web_precompress build step, in order of preference */
+typedef struct
+{
+    const char *coding;
+    const char *suffix;
+    uint8_t manifest_bit;
+} content_coding_t;
 
-/* Set HTTP response content type according to file extension */
-static esp_err_t set_content_type_from_file(httpd_req_t *req, const char *filepath)
+static const content_coding_t s_content_codings[] = {
+    {"br", ".br", ASSET_CODING_BR},
+    {"gzip", ".gz", ASSET_CODING_GZIP},
+};
+
+/* Get HTTP response content type according to file extension */
+static const char *content_type_from_file(const char *filepath)
 {
     const char *type = "text/plain";
     if (CHECK_FILE_EXTENSION(filepath, ".html"))
@@ -59,6 +127,10 @@ static esp_err_t set_content_type_from_file(httpd_req_t *req, const char *filepa
     {
         type = "image/png";
     }
+    else if (CHECK_FILE_EXTENSION(filepath, ".jpg"))
+    {
+        type = "image/jpeg";
+    }
     else if (CHECK_FILE_EXTENSION(filepath, ".ico"))
     {
         type = "image/x-icon";
@@ -67,66 +139,761 @@ static esp_err_t set_content_type_from_file(httpd_req_t *req, const char *filepa
     {
         type = "text/xml";
     }
-    return httpd_resp_set_type(req, type);
+    return type;
 }
 
-/* Send HTTP response with the contents of the requested file */
-static esp_err_t rest_common_get_handler(httpd_req_t *req)
+/* Check whether the client lists the content coding in Accept-Encoding (a q=0 entry refuses it) */
+static bool accepts_encoding(const char *accept, const char *coding)
+{
+    size_t coding_len = strlen(coding);
+    const char *p = accept;
+    while (*p)
+    {
+        while (*p == ' ' || *p == ',')
+        {
+            p++;
+        }
+        const char *token = p;
+        while (*p && *p != ',' && *p != ';' && *p != ' ')
+        {
+            p++;
+        }
+        bool match = ((size_t)(p - token) == coding_len && strncasecmp(token, coding, coding_len) == 0);
+        bool refused = false;
+        while (*p && *p != ',')
+        {
+            if (*p == ';')
+            {
+                const char *q = p + 1;
+                while (*q == ' ')
+                {
+                    q++;
+                }
+                if ((q[0] == 'q' || q[0] == 'Q') && q[1] == '=')
+                {
+                    refused = (strtod(q + 2, NULL) <= 0.0);
+                }
+            }
+            p++;
+        }
+        if (match)
+        {
+            return !refused;
+        }
+    }
+    return false;
+}
+
+/* Pick the preferred coding the client accepts among the available ASSET_CODING_* bits */
+static const content_coding_t *select_coding(httpd_req_t *req, uint8_t available)
+{
+    char accept[ACCEPT_ENCODING_MAX];
+    if (!available || httpd_req_get_hdr_value_str(req, "Accept-Encoding", accept, sizeof(accept)) != ESP_OK)
+    {
+        return NULL;
+    }
+    for (int i = 0; i < sizeof(s_content_codings) / sizeof(s_content_codings[0]); i++)
+    {
+        const content_coding_t *cc = &s_content_codings[i];
+        if ((available & cc->manifest_bit) && accepts_encoding(accept, cc->coding))
+        {
+            return cc;
+        }
+    }
+    return NULL;
+}
+
+/* Append the suffix of the best precompressed sidecar the client accepts.
+ * With a manifest entry the available sidecars are known up front, otherwise probe the filesystem. */
+static const char *select_precompressed(httpd_req_t *req, const asset_entry_t *asset, char *filepath, size_t size)
+{
+    char accept[ACCEPT_ENCODING_MAX];
+    if (httpd_req_get_hdr_value_str(req, "Accept-Encoding", accept, sizeof(accept)) != ESP_OK)
+    {
+        return NULL;
+    }
+    size_t path_len = strlen(filepath);
+    for (int i = 0; i < sizeof(s_content_codings) / sizeof(s_content_codings[0]); i++)
+    {
+        const content_coding_t *cc = &s_content_codings[i];
+        if ((asset && !(asset->codings & cc->manifest_bit)) || !accepts_encoding(accept, cc->coding))
+        {
+            continue;
+        }
+        struct stat st;
+        if (strlcat(filepath, cc->suffix, size) < size && (asset || stat(filepath, &st) == 0))
+        {
+            return cc->coding;
+        }
+        filepath[path_len] = '\0';
+    }
+    return NULL;
+}
+
+/* Check an If-None-Match list ("a", W/"b" or *) against the current entity tag */
+static bool etag_matches(httpd_req_t *req, const char *etag)
+{
+    char if_none_match[IF_NONE_MATCH_MAX];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) != ESP_OK)
+    {
+        return false;
+    }
+    size_t etag_len = strlen(etag);
+    for (const char *p = if_none_match; *p; p++)
+    {
+        if (*p == '*')
+        {
+            return true;
+        }
+        if (strncmp(p, etag, etag_len) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Byte range of the selected representation (the .gz/.br sidecar when one is sent) */
+typedef struct
+{
+    size_t start;
+    size_t length;
+} byte_range_t;
+
+typedef enum
+{
+    RANGE_NONE,          /* send the whole representation with 200 */
+    RANGE_PARTIAL,       /* send range with 206 */
+    RANGE_UNSATISFIABLE, /* answer 416 */
+} range_result_t;
+
+/* Parse a single "bytes=first-last", "bytes=first-" or "bytes=-suffix" range.
+ * Multiple ranges, other units and malformed values are ignored, the whole
+ * representation is a valid answer to all of them. With If-Range the range only
+ * applies while the client's copy is current: a strong match of the entity tag,
+ * dates never match since no Last-Modified is sent. */
+static range_result_t parse_range(httpd_req_t *req, size_t size, const char *etag, byte_range_t *range)
+{
+    char value[RANGE_HDR_MAX];
+    if (httpd_req_get_hdr_value_str(req, "Range", value, sizeof(value)) != ESP_OK ||
+        strncasecmp(value, "bytes=", 6) != 0 || strchr(value, ','))
+    {
+        return RANGE_NONE;
+    }
+    if (httpd_req_get_hdr_value_len(req, "If-Range"))
+    {
+        char if_range[ETAG_MAX];
+        if (!etag || httpd_req_get_hdr_value_str(req, "If-Range", if_range, sizeof(if_range)) != ESP_OK ||
+            strcmp(if_range, etag) != 0)
+        {
+            return RANGE_NONE;
+        }
+    }
+
+    const char *spec = value + 6;
+    char *end;
+    if (*spec == '-')
+    {
+        if (!isdigit((unsigned char)spec[1]))
+        {
+            return RANGE_NONE;
+        }
+        unsigned long long suffix = strtoull(spec + 1, &end, 10);
+        if (*end)
+        {
+            return RANGE_NONE;
+        }
+        if (suffix == 0 || size == 0)
+        {
+            return RANGE_UNSATISFIABLE;
+        }
+        range->length = suffix < size ? suffix : size;
+        range->start = size - range->length;
+        return RANGE_PARTIAL;
+    }
+    if (!isdigit((unsigned char)*spec))
+    {
+        return RANGE_NONE;
+    }
+    unsigned long long first = strtoull(spec, &end, 10);
+    unsigned long long last = ~0ULL;
+    if (*end++ != '-')
+    {
+        return RANGE_NONE;
+    }
+    if (*end)
+    {
+        const char *last_str = end;
+        last = strtoull(last_str, &end, 10);
+        if (!isdigit((unsigned char)*last_str) || *end || last < first)
+        {
+            return RANGE_NONE;
+        }
+    }
+    if (first >= size)
+    {
+        return RANGE_UNSATISFIABLE;
+    }
+    range->start = first;
+    range->length = (last < size ? last + 1 : size) - first;
+    return RANGE_PARTIAL;
+}
+
+/* length argument of format_resp_head() for a 304: its Content-Length would
+ * describe the selected representation (RFC 9110 8.6), so it's left out */
+#define RESP_NO_LENGTH SIZE_MAX
+
+/* Raw response head for a file: status, then the representation headers with a
+ * Content-Length of length bytes and an optional Content-Range line */
+static int format_resp_head(char *head, size_t size, const char *status, const file_resp_hdrs_t *hdrs, size_t length,
+                            const char *content_range)
+{
+    char content_length[32] = "";
+    if (length != RESP_NO_LENGTH)
+    {
+        snprintf(content_length, sizeof(content_length), "Content-Length: %u\r\n", (unsigned)length);
+    }
+    int len = snprintf(head, size,
+                       "HTTP/1.1 %s\r\n"
+                       "Content-Type: %s\r\n"
+                       "%s"
+                       "%s"
+                       "Accept-Ranges: bytes\r\n"
+                       "Cache-Control: %s\r\n"
+                       "Vary: Accept-Encoding\r\n"
+                       "%s%s%s"
+                       "%s%s%s"
+                       "\r\n",
+                       status, hdrs->content_type, content_length, content_range, hdrs->cache_control,
+                       hdrs->coding ? "Content-Encoding: " : "", hdrs->coding ? hdrs->coding : "", hdrs->coding ? "\r\n" : "",
+                       hdrs->etag ? "ETag: " : "", hdrs->etag ? hdrs->etag : "", hdrs->etag ? "\r\n" : "");
+    return (len > 0 && len < size) ? len : -1;
+}
+
+/* Raw response head with a Content-Length, for responses sent outside of httpd:
+ * 200 for the whole representation of total bytes, 206 when range is given */
+static int format_file_resp_head(char *head, size_t size, const file_resp_hdrs_t *hdrs, size_t total,
+                                 const byte_range_t *range)
+{
+    char content_range[CONTENT_RANGE_MAX] = "";
+    if (range)
+    {
+        snprintf(content_range, sizeof(content_range), "Content-Range: bytes %u-%u/%u\r\n", (unsigned)range->start,
+                 (unsigned)(range->start + range->length - 1), (unsigned)total);
+    }
+    return format_resp_head(head, size, range ? "206 Partial Content" : "200 OK", hdrs,
+                            range ? range->length : total, content_range);
+}
+
+/* httpd_send() may write less than asked for */
+static esp_err_t send_all(httpd_req_t *req, const char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        int sent = httpd_send(req, buf, len);
+        if (sent <= 0)
+        {
+            return ESP_FAIL;
+        }
+        buf += sent;
+        len -= sent;
+    }
+    return ESP_OK;
+}
+
+/* Resolve the request URI below base_path, returns where the site relative part starts */
+static size_t build_file_path(httpd_req_t *req, const char *base_path, char *filepath, size_t size)
+{
+    /* Ignore the query string, it never names a file */
+    size_t uri_len = strcspn(req->uri, "?#");
+    strlcpy(filepath, base_path, size);
+    size_t rel_start = strlen(filepath);
+    if (uri_len == 0 || req->uri[uri_len - 1] == '/')
+    {
+        strlcat(filepath, "/index.html", size);
+    }
+    else if (rel_start + uri_len < size)
+    {
+        memcpy(filepath + rel_start, req->uri, uri_len);
+        filepath[rel_start + uri_len] = '\0';
+    }
+    return rel_start;
+}
+
+/* httpd_resp_send() writes the status line and every header field with a send
+ * of its own, and with Nagle on the last of them waits for the client's delayed
+ * ACK. The short responses below are formatted in full and leave in one send. */
+
+/* Temporary overload or the site isn't up yet, the client should retry shortly */
+static esp_err_t send_unavailable(httpd_req_t *req)
+{
+    static const char resp[] = "HTTP/1.1 503 Service Unavailable\r\n"
+                               "Content-Type: text/html\r\n"
+                               "Content-Length: 0\r\n"
+                               "Retry-After: 1\r\n"
+                               "\r\n";
+    return send_all(req, resp, sizeof(resp) - 1);
+}
+
+/* Short plain text answer with the given status line */
+static esp_err_t send_text(httpd_req_t *req, const char *status, const char *text)
+{
+    char resp[REQ_HEAD_MAX];
+    size_t text_len = strlen(text);
+    int len = snprintf(resp, sizeof(resp), "HTTP/1.1 %s\r\nContent-Type: text/plain\r\nContent-Length: %u\r\n\r\n%s",
+                       status, (unsigned)text_len, text);
+    if (len <= 0 || len >= sizeof(resp))
+    {
+        httpd_resp_set_status(req, status);
+        httpd_resp_set_type(req, HTTPD_TYPE_TEXT);
+        return httpd_resp_send(req, text, text_len);
+    }
+    return send_all(req, resp, len);
+}
+
+/* Head only response for a file: 304 or 416, with the representation headers */
+static esp_err_t send_file_status(httpd_req_t *req, const char *status, const file_resp_hdrs_t *hdrs, size_t length,
+                                  const char *content_range)
+{
+    char head[REQ_HEAD_MAX];
+    int head_len = format_resp_head(head, sizeof(head), status, hdrs, length, content_range);
+    if (head_len < 0)
+    {
+        return send_text(req, "500 Internal Server Error", "Response head too long");
+    }
+    return send_all(req, head, head_len);
+}
+
+/* 304 with the headers the full response would have carried */
+static esp_err_t send_not_modified(httpd_req_t *req, const file_resp_hdrs_t *hdrs)
+{
+    return send_file_status(req, "304 Not Modified", hdrs, RESP_NO_LENGTH, "");
+}
+
+/* 416 with the size of the representation, so the client can ask again */
+static esp_err_t send_range_not_satisfiable(httpd_req_t *req, const file_resp_hdrs_t *hdrs, size_t total)
+{
+    char content_range[CONTENT_RANGE_MAX];
+    snprintf(content_range, sizeof(content_range), "Content-Range: bytes */%u\r\n", (unsigned)total);
+    return send_file_status(req, "416 Range Not Satisfiable", hdrs, 0, content_range);
+}
+
+/* Send a raw head and a body held in memory. The head and the start of the body
+ * are copied into a request buffer and leave in one send, so a small file is a
+ * single write; if no buffer is free right now they go out separately. */
+static esp_err_t send_head_and_data(httpd_req_t *req, const char *head, size_t head_len, const char *data, size_t len)
+{
+    req_buf_t *buf = head_len < CONFIG_EXAMPLE_REQ_BUFFER_SIZE ? req_buf_acquire(0) : NULL;
+    if (!buf)
+    {
+        esp_err_t ret = send_all(req, head, head_len);
+        return ret == ESP_OK ? send_all(req, data, len) : ret;
+    }
+    size_t first = buf->size - head_len < len ? buf->size - head_len : len;
+    memcpy(buf->data, head, head_len);
+    memcpy(buf->data + head_len, data, first);
+    esp_err_t ret = send_all(req, buf->data, head_len + first);
+    req_buf_release(buf);
+    return ret == ESP_OK ? send_all(req, data + first, len - first) : ret;
+}
+
+/* Send a representation held in memory (file cache, mapped bundle), whole or the requested range */
+static esp_err_t send_file_data(httpd_req_t *req, const file_resp_hdrs_t *hdrs, const char *data, size_t size)
+{
+    byte_range_t range = {.start = 0, .length = size};
+    range_result_t ranged = parse_range(req, size, hdrs->etag, &range);
+    if (ranged == RANGE_UNSATISFIABLE)
+    {
+        return send_range_not_satisfiable(req, hdrs, size);
+    }
+    char head[REQ_HEAD_MAX];
+    int head_len = format_file_resp_head(head, sizeof(head), hdrs, size, ranged == RANGE_PARTIAL ? &range : NULL);
+    if (head_len < 0)
+    {
+        send_text(req, "500 Internal Server Error", "Response head too long");
+        return ESP_FAIL;
+    }
+    return send_head_and_data(req, head, head_len, data + range.start, range.length);
+}
+
+/* Send a raw head and then length bytes from the current offset of fd, which is
+ * closed in any case. Bodies spanning several buffers go to a worker so this task
+ * can serve other sockets. Once the head is out a failure can only be reported
+ * by dropping the connection. */
+static esp_err_t send_file_body(httpd_req_t *req, int fd, size_t length, const char *head, size_t head_len)
+{
+    if (length > CONFIG_EXAMPLE_REQ_BUFFER_SIZE && req_pool_send_file(req, fd, length, head, head_len) == ESP_OK)
+    {
+        return ESP_OK;
+    }
+    req_buf_t *buf = req_buf_acquire(pdMS_TO_TICKS(REQ_BUF_WAIT_MS));
+    if (!buf || head_len >= buf->size)
+    {
+        req_buf_release(buf);
+        close(fd);
+        return send_unavailable(req);
+    }
+    /* The head shares the first send with the start of the body, a file that fits
+       next to it goes out in a single write */
+    memcpy(buf->data, head, head_len);
+    size_t used = head_len;
+    size_t remaining = length;
+    esp_err_t ret = ESP_OK;
+    do
+    {
+        size_t room = buf->size - used;
+        if (remaining > 0)
+        {
+            ssize_t read_bytes = metrics_read(fd, buf->data + used, remaining < room ? remaining : room);
+            if (read_bytes <= 0)
+            {
+                ESP_LOGE(REST_TAG, "Failed to read file, %zu bytes left", remaining);
+                ret = ESP_FAIL;
+                break;
+            }
+            used += read_bytes;
+            remaining -= read_bytes;
+        }
+        ret = send_all(req, buf->data, used);
+        used = 0;
+    } while (ret == ESP_OK && remaining > 0);
+    close(fd);
+    req_buf_release(buf);
+    return ret;
+}
+
+#if CONFIG_EXAMPLE_WEB_DEPLOY_BUNDLE
+/* Send a file straight from the memory mapped website bundle */
+static esp_err_t rest_bundle_get_handler(httpd_req_t *req)
 {
     char filepath[FILE_PATH_MAX];
 
-    rest_server_context_t *rest_context = (rest_server_context_t *)req->user_ctx;
-    strlcpy(filepath, rest_context->base_path, sizeof(filepath));
-    if (req->uri[strlen(req->uri) - 1] == '/')
+    rest_server_context_t *rest_context = s_rest_context;
+    if (!rest_context)
+    {
+        return send_unavailable(req);
+    }
+    boot_phase_mark(BOOT_PHASE_FIRST_RESPONSE);
+    const char *rel_path = filepath + build_file_path(req, rest_context->base_path, filepath, sizeof(filepath));
+    size_t rel_len = strlen(rel_path);
+    /* Bundle paths are relative to the mount point: /www/prod/index.html is /prod/index.html */
+    const char *bundle_path = filepath + strlen(CONFIG_EXAMPLE_WEB_MOUNT_POINT);
+    const bundle_entry_t *entry = asset_bundle_find(&www_bundle, bundle_path, strlen(bundle_path));
+    if (!entry)
+    {
+        ESP_LOGW(REST_TAG, "Not in bundle : %s", bundle_path);
+        send_text(req, "404 Not Found", "File does not exist");
+        return ESP_FAIL;
+    }
+
+    uint8_t available = (entry->size[BUNDLE_BLOB_GZIP] ? ASSET_CODING_GZIP : 0) |
+                        (entry->size[BUNDLE_BLOB_BR] ? ASSET_CODING_BR : 0);
+    const content_coding_t *cc = select_coding(req, available);
+    bundle_blob_t blob = !cc ? BUNDLE_BLOB_IDENTITY : (cc->manifest_bit == ASSET_CODING_BR ? BUNDLE_BLOB_BR : BUNDLE_BLOB_GZIP);
+
+    char etag[ETAG_MAX];
+    snprintf(etag, sizeof(etag), "\"%.*s%s%s\"", BUNDLE_ETAG_LEN, entry->etag, cc ? "-" : "", cc ? cc->coding : "");
+    file_resp_hdrs_t hdrs = {
+        .content_type = content_type_from_file(filepath),
+        .cache_control = asset_path_is_hashed(rel_path, rel_len) ? CACHE_CONTROL_IMMUTABLE : CACHE_CONTROL_REVALIDATE,
+        .coding = cc ? cc->coding : NULL,
+        .etag = etag,
+    };
+    if (etag_matches(req, etag))
     {
+        return send_not_modified(req, &hdrs);
+    }
+    /* Zero copy: the response body is the mapped flash itself */
+    return send_file_data(req, &hdrs, (const char *)asset_bundle_blob(&www_bundle, entry, blob), entry->size[blob]);
+}
+#endif
+
+/* Single page app routes have no extension in their last segment */
+static bool uri_is_spa_route(const char *uri, size_t uri_len)
+{
+    for (size_t i = uri_len; i > 0; i--)
+    {
+        if (uri[i - 1] == '/')
+        {
+            return true;
+        }
+        if (uri[i - 1] == '.')
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Send HTTP response with the contents of the requested file, found by probing the filesystem */
+static esp_err_t send_file_from_fs(httpd_req_t *req, rest_server_context_t *rest_context)
+{
+    char filepath[FILE_PATH_MAX];
+
+    size_t rel_start = build_file_path(req, rest_context->base_path, filepath, sizeof(filepath));
+    const char *rel_path = filepath + rel_start;
+    /* A single page app route without a file of its own gets the app's index.html */
+    struct stat st;
+    if (uri_is_spa_route(req->uri, strcspn(req->uri, "?#")) && stat(filepath, &st) != 0)
+    {
+        filepath[rel_start] = '\0';
         strlcat(filepath, "/index.html", sizeof(filepath));
     }
-    else
+    size_t rel_len = strlen(rel_path);
+    const asset_entry_t *asset = asset_manifest_find(rest_context->manifest, rel_path, rel_len);
+
+    /* Content type follows the original name, not the .gz/.br sidecar */
+    file_resp_hdrs_t hdrs = {
+        .content_type = content_type_from_file(filepath),
+        .cache_control = asset_path_is_hashed(rel_path, rel_len) ? CACHE_CONTROL_IMMUTABLE : CACHE_CONTROL_REVALIDATE,
+    };
+    hdrs.coding = select_precompressed(req, asset, filepath, sizeof(filepath));
+
+    char etag[ETAG_MAX];
+    if (asset)
+    {
+        /* Every representation gets its own tag so caches never mix encodings */
+        snprintf(etag, sizeof(etag), "\"%s%s%s\"", asset->etag, hdrs.coding ? "-" : "", hdrs.coding ? hdrs.coding : "");
+        hdrs.etag = etag;
+        if (etag_matches(req, etag))
+        {
+            return send_not_modified(req, &hdrs);
+        }
+    }
+
+    file_cache_entry_t *cached = file_cache_get(filepath);
+    if (cached)
     {
-        strlcat(filepath, req->uri, sizeof(filepath));
+        esp_err_t ret = send_file_data(req, &hdrs, (const char *)cached->data, cached->size);
+        file_cache_release(cached);
+        return ret;
     }
+
     int fd = open(filepath, O_RDONLY, 0);
+    if (fd == -1 && errno == ENOENT)
+    {
+        send_text(req, "404 Not Found", "File does not exist");
+        return ESP_FAIL;
+    }
     if (fd == -1)
     {
         ESP_LOGE(REST_TAG, "Failed to open file : %s", filepath);
         /* Respond with 500 Internal Server Error */
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to read existing file");
+        send_text(req, "500 Internal Server Error", "Failed to read existing file");
         return ESP_FAIL;
     }
 
-    set_content_type_from_file(req, filepath);
+    /* The size is known up front, so the response carries a Content-Length */
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        ESP_LOGE(REST_TAG, "Failed to stat file : %s", filepath);
+        send_text(req, "500 Internal Server Error", "Failed to read existing file");
+        return ESP_FAIL;
+    }
+    byte_range_t range = {.start = 0, .length = st.st_size};
+    range_result_t ranged = parse_range(req, st.st_size, hdrs.etag, &range);
+    if (ranged == RANGE_UNSATISFIABLE)
+    {
+        close(fd);
+        return send_range_not_satisfiable(req, &hdrs, st.st_size);
+    }
+    if (ranged == RANGE_PARTIAL && lseek(fd, range.start, SEEK_SET) != (off_t)range.start)
+    {
+        /* Ignoring the range is always a valid answer */
+        range.start = 0;
+        range.length = st.st_size;
+        ranged = RANGE_NONE;
+        lseek(fd, 0, SEEK_SET);
+    }
+    char head[REQ_HEAD_MAX];
+    int head_len = format_file_resp_head(head, sizeof(head), &hdrs, st.st_size, ranged == RANGE_PARTIAL ? &range : NULL);
+    if (head_len < 0)
+    {
+        close(fd);
+        send_text(req, "500 Internal Server Error", "Response head too long");
+        return ESP_FAIL;
+    }
+    return send_file_body(req, fd, range.length, head, head_len);
+}
 
-    char *chunk = rest_context->scratch;
-    ssize_t read_bytes;
-    do
+/* Serve a file of the compile-time index with its precomputed response head.
+ * Returns without sending anything, and the caller serves the file the slow way,
+ * with ESP_ERR_INVALID_SIZE if the file on the filesystem doesn't match the build
+ * and with ESP_ERR_NOT_FOUND for a URI the index doesn't know on a site that may
+ * hold files the build never saw. */
+static esp_err_t send_indexed_file(httpd_req_t *req, rest_server_context_t *rest_context)
+{
+    const asset_site_t *site = rest_context->site;
+    size_t uri_len = strcspn(req->uri, "?#");
+    const asset_index_entry_t *entry;
+    if (uri_len == 0 || req->uri[uri_len - 1] == '/')
+    {
+        char index_uri[CONFIG_HTTPD_MAX_URI_LEN + sizeof("index.html")];
+        memcpy(index_uri, req->uri, uri_len);
+        strcpy(index_uri + uri_len, "index.html");
+        entry = asset_index_lookup(site, index_uri, uri_len + strlen("index.html"));
+    }
+    else
+    {
+        entry = asset_index_lookup(site, req->uri, uri_len);
+    }
+    if (!entry && site->fallback >= 0 && uri_is_spa_route(req->uri, uri_len))
+    {
+        entry = &site->entries[site->fallback];
+    }
+    if (!entry)
     {
-        /* Read file in chunks into the scratch credentials_strfer */
-        read_bytes = read(fd, chunk, SCRATCH_credentials_strSIZE);
-        if (read_bytes == -1)
+#if CONFIG_EXAMPLE_WEB_DEPLOY_SF
+        send_text(req, "404 Not Found", "File does not exist");
+        return ESP_FAIL;
+#else
+        return ESP_ERR_NOT_FOUND;
+#endif
+    }
+
+    const content_coding_t *cc = select_coding(req, entry->codings);
+    const asset_rep_t *rep = &entry->rep[!cc ? ASSET_REP_IDENTITY : (cc->manifest_bit == ASSET_CODING_BR ? ASSET_REP_BR : ASSET_REP_GZIP)];
+    file_resp_hdrs_t hdrs = {
+        .content_type = entry->content_type,
+        .cache_control = entry->cache_control,
+        .coding = cc ? cc->coding : NULL,
+        .etag = rep->etag,
+    };
+    if (etag_matches(req, rep->etag))
+    {
+        return send_not_modified(req, &hdrs);
+    }
+
+    /* The precomputed head covers the whole file, a range gets its own */
+    byte_range_t range = {.start = 0, .length = rep->size};
+    const char *head = rep->head;
+    int head_len = rep->head_len;
+    char range_head[REQ_HEAD_MAX];
+    switch (parse_range(req, rep->size, rep->etag, &range))
+    {
+    case RANGE_UNSATISFIABLE:
+        return send_range_not_satisfiable(req, &hdrs, rep->size);
+    case RANGE_PARTIAL:
+        head = range_head;
+        head_len = format_file_resp_head(range_head, sizeof(range_head), &hdrs, rep->size, &range);
+        if (head_len < 0)
         {
-            ESP_LOGE(REST_TAG, "Failed to read file : %s", filepath);
+            return ESP_ERR_INVALID_SIZE;
         }
-        else if (read_bytes > 0)
+        break;
+    default:
+        break;
+    }
+
+    char filepath[FILE_PATH_MAX];
+    strlcpy(filepath, rest_context->base_path, sizeof(filepath));
+    strlcat(filepath, rep->path, sizeof(filepath));
+
+    file_cache_entry_t *cached = file_cache_get(filepath);
+    if (cached)
+    {
+        esp_err_t ret = ESP_ERR_INVALID_SIZE;
+        if (cached->size == rep->size)
         {
-            /* Send the credentials_strfer contents as HTTP response chunk */
-            if (httpd_resp_send_chunk(req, chunk, read_bytes) != ESP_OK)
-            {
-                close(fd);
-                ESP_LOGE(REST_TAG, "File sending failed!");
-                /* Abort sending file */
-                httpd_resp_sendstr_chunk(req, NULL);
-                /* Respond with 500 Internal Server Error */
-                httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to send file");
-                return ESP_FAIL;
-            }
+            ret = send_head_and_data(req, head, head_len, (const char *)cached->data + range.start, range.length);
         }
-    } while (read_bytes > 0);
-    /* Close file after sending complete */
-    close(fd);
-    ESP_LOGI(REST_TAG, "File sending complete");
-    /* Respond with an empty chunk to signal HTTP response completion */
-    httpd_resp_send_chunk(req, NULL, 0);
-    return ESP_OK;
+        file_cache_release(cached);
+        return ret;
+    }
+
+    int fd = open(filepath, O_RDONLY, 0);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) != 0 || st.st_size != rep->size ||
+        (range.start && lseek(fd, range.start, SEEK_SET) != (off_t)range.start))
+    {
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return send_file_body(req, fd, range.length, head, head_len);
+}
+
+/* Send HTTP response with the contents of the requested file */
+static esp_err_t rest_common_get_handler(httpd_req_t *req)
+{
+    rest_server_context_t *rest_context = s_rest_context;
+    if (!rest_context)
+    {
+        return send_unavailable(req);
+    }
+    boot_phase_mark(BOOT_PHASE_FIRST_RESPONSE);
+    if (rest_context->site)
+    {
+        esp_err_t ret = send_indexed_file(req, rest_context);
+        if (ret != ESP_ERR_INVALID_SIZE && ret != ESP_ERR_NOT_FOUND)
+        {
+            return ret;
+        }
+        if (ret == ESP_ERR_INVALID_SIZE)
+        {
+            ESP_LOGW(REST_TAG, "%s differs from the build, serving it from the filesystem", req->uri);
+        }
+    }
+    return send_file_from_fs(req, rest_context);
+}
+
+/* Fields of an /updpassword body, JSON or CBOR */
+typedef struct
+{
+    char ssid[AP_SSID_MAX_LEN + 1]; /* empty if the page only sent the list index */
+    int32_t id;                     /* -1 if absent */
+    char password[CRED_PASSWORD_MAX_LEN + 1];
+} pass_update_t;
+
+static bool pass_update_parse_json(char *body, pass_update_t *upd)
+{
+    cJSON *root = cJSON_Parse(body);
+    ESP_LOGI(REST_TAG, "received json, %zu bytes", strlen(body));
+    cJSON *ssid_json = cJSON_GetObjectItemCaseSensitive(root, "ssid");
+    cJSON *id_json = cJSON_GetObjectItemCaseSensitive(root, "id");
+    cJSON *pass_json = cJSON_GetObjectItemCaseSensitive(root, "password");
+    if (cJSON_IsString(ssid_json))
+    {
+        strlcpy(upd->ssid, ssid_json->valuestring, sizeof(upd->ssid));
+    }
+    if (cJSON_IsNumber(id_json))
+    {
+        upd->id = id_json->valueint;
+    }
+    bool ok = cJSON_IsString(pass_json) && strlen(pass_json->valuestring) < sizeof(upd->password);
+    if (ok)
+    {
+        strcpy(upd->password, pass_json->valuestring);
+    }
+    cJSON_Delete(root);
+    return ok;
+}
+
+static bool pass_update_parse_cbor(const char *body, size_t len, pass_update_t *upd)
+{
+    cbor_item_t item;
+    const uint8_t *doc = (const uint8_t *)body;
+    if (cbor_map_get(doc, len, "ssid", &item))
+    {
+        cbor_item_text(&item, upd->ssid, sizeof(upd->ssid));
+    }
+    if (cbor_map_get(doc, len, "id", &item))
+    {
+        cbor_item_int(&item, &upd->id);
+    }
+    ESP_LOGI(REST_TAG, "received cbor, %zu bytes", len);
+    return cbor_map_get(doc, len, "password", &item) && cbor_item_text(&item, upd->password, sizeof(upd->password));
+}
+
+static bool req_is_cbor(httpd_req_t *req)
+{
+    char type[sizeof(JSON_STREAM_TYPE_CBOR)];
+    /* A truncated value still starts with the media type */
+    esp_err_t err = httpd_req_get_hdr_value_str(req, "Content-Type", type, sizeof(type));
+    return (err == ESP_OK || err == ESP_ERR_HTTPD_RESULT_TRUNC) && !strcasecmp(type, JSON_STREAM_TYPE_CBOR);
 }
 
 /* Simple handler for light brightness control */
@@ -134,172 +901,397 @@ static esp_err_t pass_update_post_handler(httpd_req_t *req)
 {
     int total_len = req->content_len;
     int cur_len = 0;
-    char *credentials_string = ((rest_server_context_t *)(req->user_ctx))->scratch;
     int received = 0;
-    if (total_len >= SCRATCH_credentials_strSIZE)
+    req_buf_t *buf = req_buf_acquire(pdMS_TO_TICKS(REQ_BUF_WAIT_MS));
+    if (!buf)
+    {
+        return send_unavailable(req);
+    }
+    char *credentials_string = buf->data;
+    if (total_len >= buf->size)
     {
+        req_buf_release(buf);
         /* Respond with 500 Internal Server Error */
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "content too long");
+        send_text(req, "500 Internal Server Error", "content too long");
         return ESP_FAIL;
     }
     while (cur_len < total_len)
     {
-        received = httpd_req_recv(req, credentials_string + cur_len, total_len);
+        received = httpd_req_recv(req, credentials_string + cur_len, total_len - cur_len);
         if (received <= 0)
         {
+            req_buf_release(buf);
             /* Respond with 500 Internal Server Error */
-            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to post control value");
+            send_text(req, "500 Internal Server Error", "Failed to post control value");
             return ESP_FAIL;
         }
         cur_len += received;
     }
     credentials_string[total_len] = '\0';
 
-    cJSON *root = cJSON_Parse(credentials_string);
-    ESP_LOGI(REST_TAG, "received json  %s", credentials_string);
-    // id = cJSON_GetObjectItem(root, "id")->valueint;
-    // password = cJSON_GetObjectItem(root, "password")->valuestring;
-
-    // ESP_LOGI(REST_TAG, "SSID selected: %s \nPassword %s", ap_info[id].ssid, password);
-    // cJSON_Delete(root);
-    cJSON *id_json = cJSON_GetObjectItemCaseSensitive(root, "id");
-    if (!cJSON_IsNumber(id_json))
+    pass_update_t upd = {.id = -1};
+    bool parsed = req_is_cbor(req) ? pass_update_parse_cbor(credentials_string, total_len, &upd)
+                                   : pass_update_parse_json(credentials_string, &upd);
+    req_buf_release(buf);
+    if (!parsed)
     {
-        ESP_LOGE(REST_TAG, "Received JSON isn't valid. ID field error.");
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to validate input JSON");
+        ESP_LOGE(REST_TAG, "Received body isn't valid. PASSWORD field error.");
+        send_text(req, "500 Internal Server Error", "Failed to validate input");
         return ESP_FAIL;
     }
-    id = id_json->valueint;
+    /* The AP list is rescanned in the background, so an SSID sent by the page wins
+     * over its index into a list that may have changed since */
+    if (!upd.ssid[0])
+    {
+        ap_snapshot_t snap;
+        ap_scan_read(&snap);
+        if (upd.id < 0 || upd.id >= snap.count)
+        {
+            ESP_LOGE(REST_TAG, "Received body isn't valid. ID field error.");
+            send_text(req, "500 Internal Server Error", "Failed to validate input");
+            return ESP_FAIL;
+        }
+        strlcpy(upd.ssid, snap.aps[upd.id].ssid, sizeof(upd.ssid));
+    }
 
-    cJSON *pass_json = cJSON_GetObjectItemCaseSensitive(root, "password");
-    if (!cJSON_IsString(pass_json) && (pass_json->valuestring == NULL)){
-        ESP_LOGE(REST_TAG, "Received JSON isn't valid. PASSWORD field error.");
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to validate input JSON");
-        return ESP_FAIL;
+    /* Provisioning: tried right away, stored once connected, the page polls /provision */
+    if (provision_try(upd.ssid, upd.password) == ESP_OK)
+    {
+        return provision_status_get_handler(req);
+    }
+    provision_status_t status;
+    provision_get_status(&status);
+    if (status.state == PROVISION_CONNECTING)
+    {
+        return send_text(req, "409 Conflict", "Provisioning attempt in progress");
     }
-    password = pass_json->valuestring;
-    
-    //write to file
-    cJSON *credentials = cJSON_CreateObject();
-    cJSON_AddStringToObject(credentials, "ssid", (const char *)ap_info[id].ssid);
-    cJSON_AddStringToObject(credentials, "password", password);
-    const char *credentials_str = cJSON_Print(credentials);
-    FILE *fd = fopen("/www/credentials.txt", "w");
-    if (!fd)
-    {
-        ESP_LOGE(REST_TAG, "Failed to open file credentials.txt");
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to validate input JSON");
+    if (cred_store_save(upd.ssid, upd.password) != ESP_OK)
+    {
+        send_text(req, "500 Internal Server Error", "Failed to store credentials");
         return ESP_FAIL;
     }
-    ESP_LOGI(REST_TAG, "Write json string to SD Card %s, size %d", credentials_str, strlen(credentials_str));
-        fwrite(credentials_str, strlen(credentials_str), 1, fd);
-    fclose(fd);
-    free((void *)credentials_str);
-    cJSON_Delete(credentials);
-    cJSON_Delete(root);
+#if CONFIG_EXAMPLE_CRED_EXPORT_SD
+    cred_store_export(CRED_STORE_FILE);
+#endif
 
-    httpd_resp_sendstr(req, "Post control value successfully");
-    return ESP_OK;
+    return send_text(req, "200 OK", "Post control value successfully");
 }
 
 /* Simple handler for getting system handler */
 static esp_err_t system_info_get_handler(httpd_req_t *req)
 {
-    httpd_resp_set_type(req, "application/json");
-    cJSON *root = cJSON_CreateObject();
+    char buf[JSON_RESP_BUF_SIZE];
+    json_stream_t js;
     esp_chip_info_t chip_info;
     esp_chip_info(&chip_info);
-    cJSON_AddStringToObject(root, "version", IDF_VER);
-    cJSON_AddNumberToObject(root, "cores", chip_info.cores);
-    const char *ap_list_info = cJSON_Print(root);
-    httpd_resp_sendstr(req, ap_list_info);
-    free((void *)ap_list_info);
-    cJSON_Delete(root);
-    return ESP_OK;
+
+    json_stream_init_httpd(&js, req, buf, sizeof(buf));
+    json_stream_obj_begin(&js, NULL);
+    json_stream_str(&js, "version", IDF_VER);
+    json_stream_int(&js, "cores", chip_info.cores);
+    json_stream_obj_end(&js);
+    return json_stream_finish(&js);
 }
 
 /* Simple handler for getting temperature data */
 static esp_err_t temperature_data_get_handler(httpd_req_t *req)
 {
-    httpd_resp_set_type(req, "application/json");
-    cJSON *root = cJSON_CreateObject();
-    cJSON_AddNumberToObject(root, "raw", esp_random() % 20);
-    const char *ap_list_info = cJSON_Print(root);
-    httpd_resp_sendstr(req, ap_list_info);
-    free((void *)ap_list_info);
-    cJSON_Delete(root);
-    return ESP_OK;
+    char buf[JSON_RESP_BUF_SIZE];
+    json_stream_t js;
+
+    json_stream_init_httpd(&js, req, buf, sizeof(buf));
+    json_stream_obj_begin(&js, NULL);
+    json_stream_int(&js, "raw", esp_random() % 20);
+    json_stream_obj_end(&js);
+    return json_stream_finish(&js);
 }
 
 //GET data
 static esp_err_t listWiFi_get_handler(httpd_req_t *req)
 {
-    httpd_resp_set_type(req, "application/json");
-    cJSON *root = cJSON_CreateObject();
+    json_stream_t js;
+    ap_snapshot_t snap;
 
-    cJSON *wifi_list = cJSON_AddArrayToObject(root, "aps"); //access points list
-    //Add items to array
-    //for(...)
-    xSemaphoreTake(s_semph_get_ap_list, portMAX_DELAY);
-    for (uint8_t i = 0; i < ap_count; i++)
+    /* A full list is larger than a stack buffer, a request buffer keeps it one send */
+    req_buf_t *buf = req_buf_acquire(pdMS_TO_TICKS(REQ_BUF_WAIT_MS));
+    if (!buf)
+    {
+        return send_unavailable(req);
+    }
+    ap_scan_read(&snap);
+    json_stream_init_httpd(&js, req, buf->data, buf->size);
+    json_stream_obj_begin(&js, NULL);
+    json_stream_arr_begin(&js, "aps"); //access points list
+    for (uint16_t i = 0; i < snap.count; i++)
     {
-        ESP_LOGI(REST_TAG, "Enter cycle to make JSON array");
-        cJSON *item = cJSON_CreateObject();
-        cJSON_AddNumberToObject(item, "id", i);
-        cJSON_AddStringToObject(item, "ssid", (const char *)ap_info[i].ssid);
-        cJSON_AddNumberToObject(item, "rssi", ap_info[i].rssi);
-        cJSON_AddItemToArray(wifi_list, item);
+        json_stream_obj_begin(&js, NULL);
+        json_stream_int(&js, "id", i);
+        json_stream_str(&js, "ssid", snap.aps[i].ssid);
+        json_stream_int(&js, "rssi", snap.aps[i].rssi);
+        json_stream_obj_end(&js);
     }
-    xSemaphoreGive(s_semph_get_ap_list);
+    json_stream_arr_end(&js);
+    json_stream_obj_end(&js);
+    esp_err_t ret = json_stream_finish(&js);
+    req_buf_release(buf);
+    return ret;
+}
 
-    const char *ap_list_info = cJSON_Print(root);
-    httpd_resp_sendstr(req, ap_list_info);
-    free((void *)ap_list_info);
-    cJSON_Delete(root);
-    return ESP_OK;
+/* Station connection stats, time-to-IP is the availability metric after a power cycle */
+static esp_err_t wifi_status_get_handler(httpd_req_t *req)
+{
+    char buf[JSON_RESP_BUF_SIZE];
+    json_stream_t js;
+    wifi_sta_stats_t stats;
+    char ip[16];
+
+    wifi_get_sta_stats(&stats);
+    json_stream_init_httpd(&js, req, buf, sizeof(buf));
+    json_stream_obj_begin(&js, NULL);
+    json_stream_bool(&js, "connected", stats.connected);
+    if (stats.connected)
+    {
+        json_stream_bool(&js, "fast_connect", stats.fast_connect);
+        json_stream_int(&js, "attempts", stats.attempts);
+        json_stream_int(&js, "connect_ms", stats.connect_us / 1000);
+        json_stream_int(&js, "boot_to_ip_ms", stats.boot_us / 1000);
+        snprintf(ip, sizeof(ip), IPSTR, IP2STR(&stats.ip));
+        json_stream_str(&js, "ip", ip);
+    }
+    json_stream_obj_end(&js);
+    return json_stream_finish(&js);
 }
 
-esp_err_t start_rest_server(const char *base_path)
+/* Per-phase boot timestamps, in ms since boot */
+static esp_err_t boot_timeline_get_handler(httpd_req_t *req)
+{
+    char buf[JSON_RESP_BUF_SIZE];
+    json_stream_t js;
+    const boot_phase_record_t *timeline = boot_timeline_get();
+
+    json_stream_init_httpd(&js, req, buf, sizeof(buf));
+    json_stream_obj_begin(&js, NULL);
+    json_stream_arr_begin(&js, "phases");
+    for (int i = 0; i < BOOT_PHASE_COUNT; i++)
+    {
+        if (!timeline[i].end_us)
+        {
+            continue;
+        }
+        json_stream_obj_begin(&js, NULL);
+        json_stream_str(&js, "name", boot_phase_name(i));
+        json_stream_int(&js, "start_ms", timeline[i].start_us / 1000);
+        json_stream_int(&js, "end_ms", timeline[i].end_us / 1000);
+        json_stream_obj_end(&js);
+    }
+    json_stream_arr_end(&js);
+    json_stream_obj_end(&js);
+    return json_stream_finish(&js);
+}
+
+static rest_server_context_t *rest_context_create(const char *base_path)
 {
-    REST_CHECK(base_path, "wrong base path", err);
     rest_server_context_t *rest_context = calloc(1, sizeof(rest_server_context_t));
     REST_CHECK(rest_context, "No memory for rest context", err);
     strlcpy(rest_context->base_path, base_path, sizeof(rest_context->base_path));
+    rest_context->site = asset_index_site(base_path);
+#if CONFIG_EXAMPLE_WEB_DEPLOY_SF
+    /* The SPIFFS image is flashed with the firmware, its index can't be stale */
+    if (!rest_context->site)
+    {
+        rest_context->manifest = asset_manifest_load(base_path);
+    }
+#else
+    /* A card can get a rebuilt site without a reflash: new hashed names, and an
+     * index.html of the same size but another content. The index is only used
+     * while the site's manifest lists exactly the files it was built from. */
+    rest_context->manifest = asset_manifest_load(base_path);
+    if (rest_context->site && !asset_index_matches(rest_context->site, rest_context->manifest))
+    {
+        ESP_LOGW(REST_TAG, "%s differs from the build, the build-time index is not used", base_path);
+        rest_context->site = NULL;
+    }
+#endif
+    return rest_context;
+err:
+    return NULL;
+}
+
+static void rest_context_free(rest_server_context_t *rest_context)
+{
+    if (rest_context)
+    {
+        asset_manifest_free(rest_context->manifest);
+        free(rest_context);
+    }
+}
+
+/* Runs in the HTTP server task between requests, so no handler still uses the old site */
+static void rest_context_swap(void *arg)
+{
+    rest_server_context_t *old = s_rest_context;
+    s_rest_context = arg;
+    ESP_LOGI(REST_TAG, "Serving %s", s_rest_context->base_path);
+    rest_context_free(old);
+    boot_phase_mark(BOOT_PHASE_SITE_READY);
+}
+
+esp_err_t rest_server_set_base_path(const char *base_path)
+{
+    REST_CHECK(base_path, "wrong base path", err);
+    rest_server_context_t *rest_context = rest_context_create(base_path);
+    REST_CHECK(rest_context, "No rest context", err);
+    if (!s_server)
+    {
+        rest_context_swap(rest_context);
+        return ESP_OK;
+    }
+    REST_CHECK(httpd_queue_work(s_server, rest_context_swap, rest_context) == ESP_OK, "Failed to queue site swap", err_queue);
+    return ESP_OK;
+err_queue:
+    rest_context_free(rest_context);
+err:
+    return ESP_FAIL;
+}
+
+/* base_path may be NULL: the server then answers static requests with 503 until
+ * rest_server_set_base_path() picks the site */
+esp_err_t start_rest_server(const char *base_path)
+{
+    REST_CHECK(!s_server, "server already started", err);
+    REST_CHECK(file_cache_init() == ESP_OK, "No memory for file cache", err);
+    REST_CHECK(req_pool_init() == ESP_OK, "No memory for request pool", err);
+    REST_CHECK(rssi_history_init() == ESP_OK, "Failed to start RSSI history", err);
+    REST_CHECK(req_arena_init() == ESP_OK, "Failed to set up the request arena", err);
+    REST_CHECK(wifi_ps_init() == ESP_OK, "Failed to set up power save switching", err);
+    if (base_path)
+    {
+        REST_CHECK(rest_server_set_base_path(base_path) == ESP_OK, "wrong base path", err);
+    }
 
     httpd_handle_t server = NULL;
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.uri_match_fn = httpd_uri_match_wildcard;
+    /* Room for the AP list snapshot and JSON buffer of listWiFi_get_handler */
+    config.stack_size = 6144;
+    /* One slot for every handler registered below, the WebSocket included */
+    config.max_uri_handlers = 13;
+    config.core_id = SCHED_HTTPD_CORE;
+    config.task_priority = SCHED_HTTPD_PRIORITY;
+    /* Per-client rate and connection limits, answered with 503 before any handler work */
+    admission_configure(&config);
+    /* TLS around it when CONFIG_EXAMPLE_HTTPS, admission still runs first */
+    REST_CHECK(https_configure(&config) == ESP_OK, "Failed to set up HTTPS", err);
 
     ESP_LOGI(REST_TAG, "Starting HTTP Server");
+    sched_profile_log();
     REST_CHECK(httpd_start(&server, &config) == ESP_OK, "Start server failed", err_start);
+    s_server = server;
+    if (https_start_redirect() != ESP_OK)
+    {
+        ESP_LOGW(REST_TAG, "No plain HTTP redirect to HTTPS");
+    }
 
     /* URI handler for fetching temperature data */
     httpd_uri_t wifi_list_get_uri = {
         .uri = "/aps",
         .method = HTTP_GET,
         .handler = listWiFi_get_handler,
-        .user_ctx = rest_context};
-    httpd_register_uri_handler(server, &wifi_list_get_uri);
+        .user_ctx = NULL};
+    metrics_register_uri_handler(server, &wifi_list_get_uri);
+
+    httpd_uri_t rssi_history_get_uri = {
+        .uri = "/aps/history",
+        .method = HTTP_GET,
+        .handler = rssi_history_get_handler,
+        .user_ctx = NULL};
+    metrics_register_uri_handler(server, &rssi_history_get_uri);
+
+#if CONFIG_EXAMPLE_AP_PUSH
+    /* AP list changes pushed over a WebSocket */
+    ap_push_register(server);
+#endif
+
+    httpd_uri_t wifi_status_get_uri = {
+        .uri = "/wifistatus",
+        .method = HTTP_GET,
+        .handler = wifi_status_get_handler,
+        .user_ctx = NULL};
+    metrics_register_uri_handler(server, &wifi_status_get_uri);
+
+    httpd_uri_t provision_get_uri = {
+        .uri = "/provision",
+        .method = HTTP_GET,
+        .handler = provision_status_get_handler,
+        .user_ctx = NULL};
+    metrics_register_uri_handler(server, &provision_get_uri);
+
+    httpd_uri_t powersave_get_uri = {
+        .uri = "/powersave",
+        .method = HTTP_GET,
+        .handler = wifi_ps_get_handler,
+        .user_ctx = NULL};
+    metrics_register_uri_handler(server, &powersave_get_uri);
+
+    httpd_uri_t powersave_post_uri = {
+        .uri = "/powersave",
+        .method = HTTP_POST,
+        .handler = wifi_ps_post_handler,
+        .user_ctx = NULL};
+    metrics_register_uri_handler(server, &powersave_post_uri);
+
+    httpd_uri_t boot_timeline_get_uri = {
+        .uri = "/boottimeline",
+        .method = HTTP_GET,
+        .handler = boot_timeline_get_handler,
+        .user_ctx = NULL};
+    metrics_register_uri_handler(server, &boot_timeline_get_uri);
+
+    httpd_uri_t system_info_get_uri = {
+        .uri = "/api/v1/system/info",
+        .method = HTTP_GET,
+        .handler = system_info_get_handler,
+        .user_ctx = NULL};
+    metrics_register_uri_handler(server, &system_info_get_uri);
+
+    httpd_uri_t temperature_data_get_uri = {
+        .uri = "/api/v1/temp/raw",
+        .method = HTTP_GET,
+        .handler = temperature_data_get_handler,
+        .user_ctx = NULL};
+    metrics_register_uri_handler(server, &temperature_data_get_uri);
+
+    httpd_uri_t metrics_get_uri = {
+        .uri = "/metrics",
+        .method = HTTP_GET,
+        .handler = metrics_get_handler,
+        .user_ctx = NULL};
+    metrics_register_uri_handler(server, &metrics_get_uri);
 
     /* URI handler for light brightness control */
     httpd_uri_t pass_update_post_uri = {
         .uri = "/updpassword",
         .method = HTTP_POST,
         .handler = pass_update_post_handler,
-        .user_ctx = rest_context};
-    httpd_register_uri_handler(server, &pass_update_post_uri);
+        .user_ctx = NULL};
+    metrics_register_uri_handler(server, &pass_update_post_uri);
 
     /* URI handler for getting web server files */
     httpd_uri_t common_get_uri = {
         .uri = "/*",
         .method = HTTP_GET,
+#if CONFIG_EXAMPLE_WEB_DEPLOY_BUNDLE
+        .handler = rest_bundle_get_handler,
+#else
         .handler = rest_common_get_handler,
-        .user_ctx = rest_context};
-    httpd_register_uri_handler(server, &common_get_uri);
+#endif
+        .user_ctx = NULL};
+    metrics_register_uri_handler(server, &common_get_uri);
 
     return ESP_OK;
 err_start:
-    free(rest_context);
+    rest_context_free(s_rest_context);
+    s_rest_context = NULL;
 err:
     return ESP_FAIL;
 }
@@ -0,0 +1,294 @@
+/* RSSI history of the scanned networks
+
+   Every published scan becomes one column of a ring shared by all tracked BSSIDs
+   (struct of arrays: the column time stamps, and per BSSID one int8 per column).
+   A cell holds the RSSI minus the row's previous sample, or RSSI_MISSING when the
+   network wasn't seen in that scan; only the newest sample of a row is kept as an
+   absolute value. Queries walk a row backwards from that sample and stop at the
+   window start, so they cost the number of scans inside the window. All memory is
+   static: CONFIG_EXAMPLE_RSSI_HISTORY_APS rows of CONFIG_EXAMPLE_RSSI_HISTORY_SAMPLES.
+
+   A BSSID not tracked yet takes a free row or evicts the one seen least recently.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "ap_scan.h"
+#include "req_pool.h"
+#include "req_arena.h"
+#include "json_stream.h"
+#include "rssi_history.h"
+
+#define RSSI_HISTORY_APS CONFIG_EXAMPLE_RSSI_HISTORY_APS
+#define RSSI_HISTORY_SAMPLES CONFIG_EXAMPLE_RSSI_HISTORY_SAMPLES
+#define RSSI_HISTORY_DEFAULT_POINTS (30)
+/* Cell of a scan the network wasn't in; RSSI is clamped so deltas never reach it */
+#define RSSI_MISSING INT8_MIN
+#define RSSI_MIN (-127)
+#define RSSI_QUERY_MAX (96)
+#define RSSI_PARAM_MAX (24)
+/* How long the handler waits for a free request buffer before answering 503 */
+#define RSSI_BUF_WAIT_MS (500)
+
+static const char *TAG = "rssi_history";
+
+static struct
+{
+    uint32_t col_time_s[RSSI_HISTORY_SAMPLES]; /* seconds since boot of each scan */
+    uint32_t scans;                            /* columns written so far */
+    uint32_t last_seen[RSSI_HISTORY_APS];      /* scan number + 1 of the newest sample, 0: free row */
+    int8_t last_rssi[RSSI_HISTORY_APS];        /* that newest sample */
+    uint8_t bssid[RSSI_HISTORY_APS][6];
+    char ssid[RSSI_HISTORY_APS][AP_SSID_MAX_LEN + 1];
+    int8_t delta[RSSI_HISTORY_APS][RSSI_HISTORY_SAMPLES];
+} s_hist;
+static SemaphoreHandle_t s_lock;
+
+/* Downsampled view of one row */
+typedef struct
+{
+    uint8_t bssid[6];
+    char ssid[AP_SSID_MAX_LEN + 1];
+    int8_t min[RSSI_HISTORY_MAX_POINTS];
+    int8_t max[RSSI_HISTORY_MAX_POINTS];
+    int32_t sum[RSSI_HISTORY_MAX_POINTS];
+    uint16_t count[RSSI_HISTORY_MAX_POINTS];
+} rssi_series_t;
+
+static uint32_t now_s(void)
+{
+    return esp_timer_get_time() / 1000000;
+}
+
+/* Row of bssid, a new one if it isn't tracked yet. -1 if every row already holds
+ * a network of the current scan. */
+static int row_for(const ap_record_t *ap)
+{
+    uint32_t current = s_hist.scans + 1;
+    int victim = -1;
+    for (int row = 0; row < RSSI_HISTORY_APS; row++)
+    {
+        if (s_hist.last_seen[row] && !memcmp(s_hist.bssid[row], ap->bssid, sizeof(ap->bssid)))
+        {
+            return row;
+        }
+        if (s_hist.last_seen[row] != current &&
+            (victim < 0 || s_hist.last_seen[row] < s_hist.last_seen[victim]))
+        {
+            victim = row;
+        }
+    }
+    if (victim >= 0)
+    {
+        memcpy(s_hist.bssid[victim], ap->bssid, sizeof(ap->bssid));
+        s_hist.last_seen[victim] = 0;
+        memset(s_hist.delta[victim], RSSI_MISSING, RSSI_HISTORY_SAMPLES);
+    }
+    return victim;
+}
+
+/* Scanner task */
+static void rssi_history_on_scan(const ap_snapshot_t *snap)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t col = s_hist.scans % RSSI_HISTORY_SAMPLES;
+    uint32_t current = s_hist.scans + 1;
+    s_hist.col_time_s[col] = now_s();
+    for (int row = 0; row < RSSI_HISTORY_APS; row++)
+    {
+        s_hist.delta[row][col] = RSSI_MISSING;
+    }
+    for (uint16_t i = 0; i < snap->count; i++)
+    {
+        const ap_record_t *ap = &snap->aps[i];
+        int row = row_for(ap);
+        if (row < 0 || s_hist.last_seen[row] == current)
+        {
+            continue;
+        }
+        int8_t rssi = ap->rssi < RSSI_MIN ? RSSI_MIN : ap->rssi > 0 ? 0 : ap->rssi;
+        s_hist.delta[row][col] = s_hist.last_seen[row] ? rssi - s_hist.last_rssi[row] : 0;
+        s_hist.last_rssi[row] = rssi;
+        s_hist.last_seen[row] = current;
+        strlcpy(s_hist.ssid[row], ap->ssid, sizeof(s_hist.ssid[row]));
+    }
+    s_hist.scans = current;
+    xSemaphoreGive(s_lock);
+}
+
+/* Bucket the samples of row younger than window_s, false if there are none */
+static bool rssi_history_series(int row, uint32_t now, uint32_t window_s, int points, rssi_series_t *series)
+{
+    bool any = false;
+
+    for (int p = 0; p < points; p++)
+    {
+        series->min[p] = INT8_MAX;
+        series->max[p] = INT8_MIN;
+        series->sum[p] = 0;
+        series->count[p] = 0;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t last_seen = s_hist.last_seen[row];
+    uint32_t oldest = s_hist.scans > RSSI_HISTORY_SAMPLES ? s_hist.scans - RSSI_HISTORY_SAMPLES : 0;
+    memcpy(series->bssid, s_hist.bssid[row], sizeof(series->bssid));
+    strlcpy(series->ssid, s_hist.ssid[row], sizeof(series->ssid));
+    int rssi = s_hist.last_rssi[row];
+    /* Columns newer than the row's newest sample have nothing for it */
+    for (uint32_t scan = last_seen; scan > oldest; scan--)
+    {
+        uint32_t col = (scan - 1) % RSSI_HISTORY_SAMPLES;
+        uint32_t time_s = s_hist.col_time_s[col];
+        uint32_t age = time_s < now ? now - time_s : 0;
+        if (age >= window_s)
+        {
+            break;
+        }
+        int8_t delta = s_hist.delta[row][col];
+        if (delta == RSSI_MISSING)
+        {
+            continue;
+        }
+        int p = points - 1 - (int)((uint64_t)age * points / window_s);
+        if (rssi < series->min[p])
+        {
+            series->min[p] = rssi;
+        }
+        if (rssi > series->max[p])
+        {
+            series->max[p] = rssi;
+        }
+        series->sum[p] += rssi;
+        series->count[p]++;
+        any = true;
+        rssi -= delta;
+    }
+    xSemaphoreGive(s_lock);
+    return any;
+}
+
+static void put_series(json_stream_t *js, const rssi_series_t *series, int points)
+{
+    char bssid[18];
+    const uint8_t *b = series->bssid;
+    snprintf(bssid, sizeof(bssid), "%02x:%02x:%02x:%02x:%02x:%02x", b[0], b[1], b[2], b[3], b[4], b[5]);
+
+    json_stream_obj_begin(js, NULL);
+    json_stream_str(js, "bssid", bssid);
+    json_stream_str(js, "ssid", series->ssid);
+    static const char *keys[] = {"min", "max", "avg"};
+    for (int k = 0; k < 3; k++)
+    {
+        json_stream_arr_begin(js, keys[k]);
+        for (int p = 0; p < points; p++)
+        {
+            int n = series->count[p];
+            if (!n)
+            {
+                json_stream_str(js, NULL, NULL);
+                continue;
+            }
+            /* The sum is negative, round half away from zero */
+            int value = k == 0 ? series->min[p] : k == 1 ? series->max[p] : (series->sum[p] - n / 2) / n;
+            json_stream_int(js, NULL, value);
+        }
+        json_stream_arr_end(js);
+    }
+    json_stream_obj_end(js);
+}
+
+esp_err_t rssi_history_get_handler(httpd_req_t *req)
+{
+    char query[RSSI_QUERY_MAX];
+    char param[RSSI_PARAM_MAX];
+    uint8_t bssid[6];
+    bool filter = false;
+    int points = RSSI_HISTORY_DEFAULT_POINTS;
+    uint32_t now = now_s();
+
+    /* Default window: everything still in the ring */
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t stored = s_hist.scans < RSSI_HISTORY_SAMPLES ? s_hist.scans : RSSI_HISTORY_SAMPLES;
+    uint32_t first_s = stored ? s_hist.col_time_s[(s_hist.scans - stored) % RSSI_HISTORY_SAMPLES] : now;
+    uint32_t window_s = (first_s < now ? now - first_s : 0) + 1;
+    xSemaphoreGive(s_lock);
+
+    size_t query_len = httpd_req_get_url_query_len(req);
+    if (query_len >= sizeof(query))
+    {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Query too long");
+    }
+    if (query_len && httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK)
+    {
+        if (httpd_query_key_value(query, "window", param, sizeof(param)) == ESP_OK)
+        {
+            window_s = strtoul(param, NULL, 10);
+        }
+        if (httpd_query_key_value(query, "points", param, sizeof(param)) == ESP_OK)
+        {
+            points = atoi(param);
+        }
+        if (httpd_query_key_value(query, "bssid", param, sizeof(param)) == ESP_OK)
+        {
+            filter = true;
+            if (sscanf(param, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx", &bssid[0], &bssid[1], &bssid[2],
+                       &bssid[3], &bssid[4], &bssid[5]) != 6)
+            {
+                return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Bad bssid");
+            }
+        }
+    }
+    if (!window_s || points < 1 || points > RSSI_HISTORY_MAX_POINTS)
+    {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Bad window or points");
+    }
+
+    /* Off the HTTP server task stack */
+    rssi_series_t *series = req_arena_alloc(sizeof(*series));
+    req_buf_t *buf = series ? req_buf_acquire(pdMS_TO_TICKS(RSSI_BUF_WAIT_MS)) : NULL;
+    if (!buf)
+    {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        return httpd_resp_send(req, NULL, 0);
+    }
+    json_stream_t js;
+    json_stream_init_httpd(&js, req, buf->data, buf->size);
+    json_stream_obj_begin(&js, NULL);
+    json_stream_int(&js, "window_s", window_s);
+    json_stream_int(&js, "bucket_s", (window_s + points - 1) / points);
+    json_stream_arr_begin(&js, "aps");
+    for (int row = 0; row < RSSI_HISTORY_APS; row++)
+    {
+        if (rssi_history_series(row, now, window_s, points, series) &&
+            (!filter || !memcmp(series->bssid, bssid, sizeof(bssid))))
+        {
+            put_series(&js, series, points);
+        }
+    }
+    json_stream_arr_end(&js);
+    json_stream_obj_end(&js);
+    esp_err_t ret = json_stream_finish(&js);
+    req_buf_release(buf);
+    return ret;
+}
+
+esp_err_t rssi_history_init(void)
+{
+    if (s_lock)
+    {
+        return ESP_OK;
+    }
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "%d BSSIDs x %d scans, %zu bytes", RSSI_HISTORY_APS, RSSI_HISTORY_SAMPLES, sizeof(s_hist));
+    return ap_scan_add_listener(rssi_history_on_scan);
+}
@@ -0,0 +1,21 @@
+// rssi_history.h
+#pragma once
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+/* Most buckets one /aps/history query can ask for */
+#define RSSI_HISTORY_MAX_POINTS (60)
+
+/* Start recording every published scan. All storage is static, sized by
+ * CONFIG_EXAMPLE_RSSI_HISTORY_APS and CONFIG_EXAMPLE_RSSI_HISTORY_SAMPLES. */
+esp_err_t rssi_history_init(void);
+
+/* GET handler for /aps/history?window=<s>&points=<n>[&bssid=<aa:bb:cc:dd:ee:ff>]
+ *
+ * Splits the last window seconds (default: everything recorded) into points
+ * buckets (default 30) and returns per BSSID the min, max and average RSSI of
+ * every bucket, oldest first, null where the network wasn't seen:
+ *   {"window_s":600,"bucket_s":20,"aps":[{"bssid":"..","ssid":"..",
+ *    "min":[-70,null,..],"max":[..],"avg":[..]}]} */
+esp_err_t rssi_history_get_handler(httpd_req_t *req);
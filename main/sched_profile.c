@@ -0,0 +1,72 @@
+/* Task scheduling profile
+
+   The server tasks are placed by the macros of sched_profile.h; the Wi-Fi driver
+   and lwIP tasks are created by IDF from its own options, which the app-core
+   profile gets from sdkconfig.defaults.app_core. The placement is checked here
+   for configurations put together by hand: a pinned server task sharing a core
+   with them competes with packet processing for that core while the other one
+   idles.
+*/
+#include <stdio.h>
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "sched_profile.h"
+
+#if CONFIG_ESP32_WIFI_TASK_PINNED_TO_CORE_1
+#define SCHED_WIFI_CORE (1)
+#else
+#define SCHED_WIFI_CORE (0)
+#endif
+#ifdef CONFIG_LWIP_TCPIP_TASK_AFFINITY
+#define SCHED_LWIP_CORE CONFIG_LWIP_TCPIP_TASK_AFFINITY
+#else
+#define SCHED_LWIP_CORE tskNO_AFFINITY
+#endif
+
+static const char *TAG = "sched";
+
+static const char *core_name(BaseType_t core, char *buf, size_t size)
+{
+    if (core == tskNO_AFFINITY)
+    {
+        return "any";
+    }
+    snprintf(buf, size, "%d", (int)core);
+    return buf;
+}
+
+static void check_core(const char *task, BaseType_t core)
+{
+    if (core == tskNO_AFFINITY)
+    {
+        return;
+    }
+    if (core == SCHED_WIFI_CORE)
+    {
+        ESP_LOGW(TAG, "%s shares core %d with the Wi-Fi task", task, (int)core);
+    }
+    if (core == SCHED_LWIP_CORE)
+    {
+        ESP_LOGW(TAG, "%s shares core %d with the lwIP task", task, (int)core);
+    }
+}
+
+void sched_profile_log(void)
+{
+    char httpd[4], worker[4], reader[4], lwip[4];
+
+    ESP_LOGI(TAG, "Profile %s: httpd core %s prio %d, workers core %s prio %d, readers core %s prio %d, "
+                  "Wi-Fi core %d, lwIP core %s",
+             SCHED_PROFILE_NAME, core_name(SCHED_HTTPD_CORE, httpd, sizeof(httpd)), SCHED_HTTPD_PRIORITY,
+             core_name(SCHED_WORKER_CORE, worker, sizeof(worker)), SCHED_WORKER_PRIORITY,
+             core_name(SCHED_READER_CORE, reader, sizeof(reader)), SCHED_READER_PRIORITY, SCHED_WIFI_CORE,
+             core_name(SCHED_LWIP_CORE, lwip, sizeof(lwip)));
+    check_core("httpd", SCHED_HTTPD_CORE);
+    check_core("File workers", SCHED_WORKER_CORE);
+    check_core("SD readers", SCHED_READER_CORE);
+    if (SCHED_LWIP_CORE == tskNO_AFFINITY &&
+        (SCHED_HTTPD_CORE != tskNO_AFFINITY || SCHED_WORKER_CORE != tskNO_AFFINITY))
+    {
+        ESP_LOGW(TAG, "Server tasks are pinned but lwIP isn't, see sdkconfig.defaults.app_core");
+    }
+}
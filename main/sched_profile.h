@@ -0,0 +1,41 @@
+// sched_profile.h
+#pragma once
+
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* Kconfig core number, -1 for unpinned */
+#if CONFIG_FREERTOS_UNICORE
+#define SCHED_CORE(core) tskNO_AFFINITY
+#else
+#define SCHED_CORE(core) ((core) < 0 ? tskNO_AFFINITY : (core))
+#endif
+
+#if CONFIG_EXAMPLE_SCHED_PROFILE_APP_CORE
+#define SCHED_PROFILE_NAME "app-core"
+#define SCHED_HTTPD_CORE SCHED_CORE(1)
+#define SCHED_HTTPD_PRIORITY (tskIDLE_PRIORITY + 5)
+#define SCHED_WORKER_CORE SCHED_CORE(1)
+#define SCHED_READER_CORE SCHED_CORE(1)
+#define SCHED_READER_PRIORITY CONFIG_EXAMPLE_REQ_WORKER_PRIORITY
+#elif CONFIG_EXAMPLE_SCHED_PROFILE_CUSTOM
+#define SCHED_PROFILE_NAME "custom"
+#define SCHED_HTTPD_CORE SCHED_CORE(CONFIG_EXAMPLE_SCHED_HTTPD_CORE)
+#define SCHED_HTTPD_PRIORITY CONFIG_EXAMPLE_SCHED_HTTPD_PRIORITY
+#define SCHED_WORKER_CORE SCHED_CORE(CONFIG_EXAMPLE_SCHED_WORKER_CORE)
+#define SCHED_READER_CORE SCHED_CORE(CONFIG_EXAMPLE_SCHED_READER_CORE)
+#define SCHED_READER_PRIORITY CONFIG_EXAMPLE_SCHED_READER_PRIORITY
+#else
+#define SCHED_PROFILE_NAME "default"
+#define SCHED_HTTPD_CORE tskNO_AFFINITY
+#define SCHED_HTTPD_PRIORITY (tskIDLE_PRIORITY + 5)
+#define SCHED_WORKER_CORE tskNO_AFFINITY
+#define SCHED_READER_CORE tskNO_AFFINITY
+#define SCHED_READER_PRIORITY CONFIG_EXAMPLE_REQ_WORKER_PRIORITY
+#endif
+
+#define SCHED_WORKER_PRIORITY CONFIG_EXAMPLE_REQ_WORKER_PRIORITY
+
+/* Log where the server tasks and the network stack run, warn when they share a core */
+void sched_profile_log(void);
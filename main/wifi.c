@@ -6,6 +6,7 @@
    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
    CONDITIONS OF ANY KIND, either express or implied.
 */
+#include <inttypes.h>
 #include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -16,10 +17,15 @@
 #include "esp_event.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
+#include "nvs.h"
+#include "esp_timer.h"
 
 #include "lwip/err.h"
 #include "lwip/sys.h"
 #include "esp_wifi_netif.h"
+#include "ap_scan.h"
+#include "wifi.h"
+#include "wifi_ps.h"
 
 /* The examples use WiFi configuration that you can set via project configuration menu
 
@@ -28,7 +34,6 @@
 */
 
 #define EXAMPLE_ESP_MAXIMUM_RETRY 4
-#define DEFAULT_SCAN_LIST_SIZE 10
 
 //definiton for SoftAP mode
 #define EXAMPLE_ESP_WIFI_SSID "ESP32_SoftAP"
@@ -47,16 +52,29 @@ static EventGroupHandle_t s_wifi_event_group;
 
 static const char *TAG = "wifi_c";
 
+/* Last access point we got an IP from, lets the next boot skip the all-channel scan */
+#define FAST_CONNECT_NVS_NAMESPACE "wifi"
+#define FAST_CONNECT_NVS_KEY "fast_ap"
+
+typedef struct
+{
+    char ssid[33];
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t authmode;
+} fast_connect_t;
+
 static int s_retry_num = 0;
-uint16_t id;
+static wifi_config_t s_sta_config; /* full scan config, restored when the directed connect fails */
+static bool s_fast_connect;        /* the current attempt targets the stored BSSID and channel */
+static int64_t s_sta_start_us;
+static wifi_sta_stats_t s_sta_stats;
+static bool s_sta_prepared;
 const char* password;
 const char* ssid;
 esp_netif_t* netif_wifi;
-xSemaphoreHandle s_semph_get_ap_list;
-
-uint16_t number = DEFAULT_SCAN_LIST_SIZE;
-wifi_ap_record_t ap_info[DEFAULT_SCAN_LIST_SIZE];
-uint16_t ap_count = 0;
+/* Station side of the provisioning APSTA mode, only used for scanning */
+static esp_netif_t *s_netif_scan;
 
 //SoftAP event handler
 static void wifi_event_handler(void *arg, esp_event_base_t event_base,
@@ -83,13 +101,24 @@ static void event_handler(void *arg, esp_event_base_t event_base,
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START)
     {
         esp_wifi_connect();
+        s_sta_stats.attempts++;
     }
     else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED)
     {
-        if (s_retry_num < EXAMPLE_ESP_MAXIMUM_RETRY)
+        if (s_fast_connect)
+        {
+            /* The stored AP moved or is gone, this doesn't count as a retry */
+            ESP_LOGW(TAG, "fast connect failed, falling back to a full scan");
+            s_fast_connect = false;
+            esp_wifi_set_config(WIFI_IF_STA, &s_sta_config);
+            esp_wifi_connect();
+            s_sta_stats.attempts++;
+        }
+        else if (s_retry_num < EXAMPLE_ESP_MAXIMUM_RETRY)
         {
             esp_wifi_connect();
             s_retry_num++;
+            s_sta_stats.attempts++;
             ESP_LOGI(TAG, "retry to connect to the AP");
         }
         else
@@ -101,7 +130,15 @@ static void event_handler(void *arg, esp_event_base_t event_base,
     else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP)
     {
         ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
-        ESP_LOGI(TAG, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
+        int64_t now = esp_timer_get_time();
+        s_sta_stats.connect_us = now - s_sta_start_us;
+        s_sta_stats.boot_us = now;
+        s_sta_stats.fast_connect = s_fast_connect;
+        s_sta_stats.connected = true;
+        s_sta_stats.ip = event->ip_info.ip;
+        ESP_LOGI(TAG, "got ip:" IPSTR ", time to IP %" PRId64 " ms (%" PRId64 " ms since boot, %s, %u attempts)",
+                 IP2STR(&event->ip_info.ip), s_sta_stats.connect_us / 1000, now / 1000,
+                 s_fast_connect ? "fast connect" : "full scan", s_sta_stats.attempts);
         s_retry_num = 0;
         xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
     }
@@ -110,6 +147,7 @@ static void event_handler(void *arg, esp_event_base_t event_base,
 void wifi_init_softap(void)
 {
     netif_wifi = esp_netif_create_default_wifi_ap();
+    s_netif_scan = esp_netif_create_default_wifi_sta();
 
     esp_netif_ip_info_t ipInfo;
     IP4_ADDR(&ipInfo.ip, 192, 168, 2, 1);
@@ -142,24 +180,92 @@ void wifi_init_softap(void)
         wifi_config.ap.authmode = WIFI_AUTH_OPEN;
     }
 
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_AP));
+    /* APSTA so the background scanner can refresh the AP list while clients are connected */
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_APSTA));
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_AP, &wifi_config));
     ESP_ERROR_CHECK(esp_wifi_start());
+    ESP_ERROR_CHECK(ap_scan_start());
 
     ESP_LOGI(TAG, "wifi_init_softap finished. SSID:%s password:%s channel:%d",
              EXAMPLE_ESP_WIFI_SSID, EXAMPLE_ESP_WIFI_PASS, EXAMPLE_ESP_WIFI_CHANNEL);
 }
 
-esp_err_t wifi_init_sta(const char *ap_name, const char *ap_password)
+static bool fast_connect_load(const char *ap_name, fast_connect_t *fc)
 {
-    esp_err_t ret_code;
+    nvs_handle_t nvs;
+    size_t len = sizeof(*fc);
 
-    s_wifi_event_group = xEventGroupCreate();
+    if (nvs_open(FAST_CONNECT_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK)
+    {
+        return false;
+    }
+    esp_err_t err = nvs_get_blob(nvs, FAST_CONNECT_NVS_KEY, fc, &len);
+    nvs_close(nvs);
+    return err == ESP_OK && len == sizeof(*fc) && fc->channel &&
+           strncmp(fc->ssid, ap_name, sizeof(fc->ssid)) == 0;
+}
 
+/* Remember the AP we are associated with, NVS is only written when it changed */
+static void fast_connect_save(const char *ap_name)
+{
+    wifi_ap_record_t ap;
+    fast_connect_t fc = {0}, stored;
+    nvs_handle_t nvs;
+
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK)
+    {
+        return;
+    }
+    strlcpy(fc.ssid, ap_name, sizeof(fc.ssid));
+    memcpy(fc.bssid, ap.bssid, sizeof(fc.bssid));
+    fc.channel = ap.primary;
+    fc.authmode = ap.authmode;
+    if (fast_connect_load(ap_name, &stored) && memcmp(&fc, &stored, sizeof(fc)) == 0)
+    {
+        return;
+    }
+    if (nvs_open(FAST_CONNECT_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Failed to open NVS, fast connect data not saved");
+        return;
+    }
+    if (nvs_set_blob(nvs, FAST_CONNECT_NVS_KEY, &fc, sizeof(fc)) == ESP_OK)
+    {
+        nvs_commit(nvs);
+        ESP_LOGI(TAG, "Saved fast connect data: BSSID " MACSTR ", channel %u", MAC2STR(fc.bssid), fc.channel);
+    }
+    nvs_close(nvs);
+}
+
+void wifi_get_sta_stats(wifi_sta_stats_t *stats)
+{
+    *stats = s_sta_stats;
+}
+
+void wifi_prepare_sta(void)
+{
+    if (s_sta_prepared)
+    {
+        return;
+    }
     netif_wifi = esp_netif_create_default_wifi_sta();
 
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+    s_sta_prepared = true;
+}
+
+/* apsta: the provisioning SoftAP keeps running and the station is already started */
+static esp_err_t wifi_sta_connect(const char *ap_name, const char *ap_password, bool apsta)
+{
+    esp_err_t ret_code;
+
+    s_wifi_event_group = xEventGroupCreate();
+
+    if (!apsta)
+    {
+        wifi_prepare_sta();
+    }
 
     esp_event_handler_instance_t instance_any_id;
     esp_event_handler_instance_t instance_got_ip;
@@ -182,6 +288,8 @@ esp_err_t wifi_init_sta(const char *ap_name, const char *ap_password)
              * However these modes are deprecated and not advisable to be used. Incase your Access point
              * doesn't support WPA2, these mode can be enabled by commenting below line */
             .threshold.authmode = WIFI_AUTH_WPA2_PSK,
+            /* Beacons slept through in max modem power save */
+            .listen_interval = CONFIG_EXAMPLE_WIFI_PS_LISTEN_INTERVAL,
 
             .pmf_cfg = {
                 .capable = true,
@@ -190,32 +298,86 @@ esp_err_t wifi_init_sta(const char *ap_name, const char *ap_password)
     };
     memcpy(wifi_config.sta.ssid, ap_name, strlen(ap_name));
     memcpy(wifi_config.sta.password, ap_password, strlen(ap_password));
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
-    ESP_ERROR_CHECK(esp_wifi_start());
+    s_sta_config = wifi_config;
+    memset(&s_sta_stats, 0, sizeof(s_sta_stats));
+    s_fast_connect = false;
+#if CONFIG_EXAMPLE_WIFI_FAST_CONNECT
+    fast_connect_t fc;
+    if (fast_connect_load(ap_name, &fc))
+    {
+        /* Directed connect: only the stored channel is probed for the stored BSSID */
+        wifi_config.sta.bssid_set = true;
+        memcpy(wifi_config.sta.bssid, fc.bssid, sizeof(fc.bssid));
+        wifi_config.sta.channel = fc.channel;
+        if (fc.authmode > wifi_config.sta.threshold.authmode)
+        {
+            wifi_config.sta.threshold.authmode = fc.authmode;
+        }
+        s_fast_connect = true;
+        ESP_LOGI(TAG, "fast connect to BSSID " MACSTR " on channel %u", MAC2STR(fc.bssid), fc.channel);
+    }
+#endif
+    s_retry_num = 0;
+    esp_err_t err = ESP_OK;
+    if (apsta)
+    {
+        /* No STA_START event this time, connect here. The driver may refuse while
+         * a scan winds down: report a failed attempt, provisioning keeps the SoftAP */
+        err = esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+        if (err == ESP_OK)
+        {
+            s_sta_start_us = esp_timer_get_time();
+            s_sta_stats.attempts++;
+            err = esp_wifi_connect();
+        }
+    }
+    else
+    {
+        ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+        ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+        s_sta_start_us = esp_timer_get_time();
+        ESP_ERROR_CHECK(esp_wifi_start());
+    }
 
     ESP_LOGI(TAG, "wifi_init_sta finished.");
 
     /* Waiting until either the connection is established (WIFI_CONNECTED_BIT) or connection failed for the maximum
      * number of re-tries (WIFI_FAIL_BIT). The bits are set by event_handler() (see above) */
-    EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
-                                           WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
-                                           pdFALSE,
-                                           pdFALSE,
-                                           portMAX_DELAY);
+    EventBits_t bits = 0;
+    if (err == ESP_OK)
+    {
+        bits = xEventGroupWaitBits(s_wifi_event_group,
+                                   WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
+                                   pdFALSE,
+                                   pdFALSE,
+                                   portMAX_DELAY);
+    }
 
     /* xEventGroupWaitBits() returns the bits before the call returned, hence we can test which event actually
      * happened. */
-    if (bits & WIFI_CONNECTED_BIT)
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Station didn't start connecting to %s (%s)", ap_name, esp_err_to_name(err));
+        ret_code = err;
+    }
+    else if (bits & WIFI_CONNECTED_BIT)
     {
         ESP_LOGI(TAG, "connected to ap SSID:%s password:%s",
                  ap_name, ap_password);
+#if CONFIG_EXAMPLE_WIFI_FAST_CONNECT
+        fast_connect_save(ap_name);
+#endif
+        wifi_ps_station_up();
         ret_code = ESP_OK;
     }
     else if (bits & WIFI_FAIL_BIT)
     {
         ESP_LOGI(TAG, "Failed to connect to SSID:%s, password:%s",
                  ap_name, ap_password);
+        if (apsta)
+        {
+            esp_wifi_disconnect();
+        }
         ret_code = ESP_FAIL;
     }
     else
@@ -232,133 +394,46 @@ esp_err_t wifi_init_sta(const char *ap_name, const char *ap_password)
     return ret_code;
 }
 
-static void print_auth_mode(int authmode)
+esp_err_t wifi_init_sta(const char *ap_name, const char *ap_password)
 {
-    switch (authmode)
-    {
-    case WIFI_AUTH_OPEN:
-        ESP_LOGI(TAG, "Authmode \tWIFI_AUTH_OPEN");
-        break;
-    case WIFI_AUTH_WEP:
-        ESP_LOGI(TAG, "Authmode \tWIFI_AUTH_WEP");
-        break;
-    case WIFI_AUTH_WPA_PSK:
-        ESP_LOGI(TAG, "Authmode \tWIFI_AUTH_WPA_PSK");
-        break;
-    case WIFI_AUTH_WPA2_PSK:
-        ESP_LOGI(TAG, "Authmode \tWIFI_AUTH_WPA2_PSK");
-        break;
-    case WIFI_AUTH_WPA_WPA2_PSK:
-        ESP_LOGI(TAG, "Authmode \tWIFI_AUTH_WPA_WPA2_PSK");
-        break;
-    case WIFI_AUTH_WPA2_ENTERPRISE:
-        ESP_LOGI(TAG, "Authmode \tWIFI_AUTH_WPA2_ENTERPRISE");
-        break;
-    case WIFI_AUTH_WPA3_PSK:
-        ESP_LOGI(TAG, "Authmode \tWIFI_AUTH_WPA3_PSK");
-        break;
-    case WIFI_AUTH_WPA2_WPA3_PSK:
-        ESP_LOGI(TAG, "Authmode \tWIFI_AUTH_WPA2_WPA3_PSK");
-        break;
-    default:
-        ESP_LOGI(TAG, "Authmode \tWIFI_AUTH_UNKNOWN");
-        break;
-    }
+    return wifi_sta_connect(ap_name, ap_password, false);
 }
 
-static void print_cipher_type(int pairwise_cipher, int group_cipher)
+esp_err_t wifi_connect_apsta(const char *ap_name, const char *ap_password)
 {
-    switch (pairwise_cipher)
+    if (!s_netif_scan)
     {
-    case WIFI_CIPHER_TYPE_NONE:
-        ESP_LOGI(TAG, "Pairwise Cipher \tWIFI_CIPHER_TYPE_NONE");
-        break;
-    case WIFI_CIPHER_TYPE_WEP40:
-        ESP_LOGI(TAG, "Pairwise Cipher \tWIFI_CIPHER_TYPE_WEP40");
-        break;
-    case WIFI_CIPHER_TYPE_WEP104:
-        ESP_LOGI(TAG, "Pairwise Cipher \tWIFI_CIPHER_TYPE_WEP104");
-        break;
-    case WIFI_CIPHER_TYPE_TKIP:
-        ESP_LOGI(TAG, "Pairwise Cipher \tWIFI_CIPHER_TYPE_TKIP");
-        break;
-    case WIFI_CIPHER_TYPE_CCMP:
-        ESP_LOGI(TAG, "Pairwise Cipher \tWIFI_CIPHER_TYPE_CCMP");
-        break;
-    case WIFI_CIPHER_TYPE_TKIP_CCMP:
-        ESP_LOGI(TAG, "Pairwise Cipher \tWIFI_CIPHER_TYPE_TKIP_CCMP");
-        break;
-    default:
-        ESP_LOGI(TAG, "Pairwise Cipher \tWIFI_CIPHER_TYPE_UNKNOWN");
-        break;
-    }
-
-    switch (group_cipher)
-    {
-    case WIFI_CIPHER_TYPE_NONE:
-        ESP_LOGI(TAG, "Group Cipher \tWIFI_CIPHER_TYPE_NONE");
-        break;
-    case WIFI_CIPHER_TYPE_WEP40:
-        ESP_LOGI(TAG, "Group Cipher \tWIFI_CIPHER_TYPE_WEP40");
-        break;
-    case WIFI_CIPHER_TYPE_WEP104:
-        ESP_LOGI(TAG, "Group Cipher \tWIFI_CIPHER_TYPE_WEP104");
-        break;
-    case WIFI_CIPHER_TYPE_TKIP:
-        ESP_LOGI(TAG, "Group Cipher \tWIFI_CIPHER_TYPE_TKIP");
-        break;
-    case WIFI_CIPHER_TYPE_CCMP:
-        ESP_LOGI(TAG, "Group Cipher \tWIFI_CIPHER_TYPE_CCMP");
-        break;
-    case WIFI_CIPHER_TYPE_TKIP_CCMP:
-        ESP_LOGI(TAG, "Group Cipher \tWIFI_CIPHER_TYPE_TKIP_CCMP");
-        break;
-    default:
-        ESP_LOGI(TAG, "Group Cipher \tWIFI_CIPHER_TYPE_UNKNOWN");
-        break;
+        return ESP_ERR_INVALID_STATE;
     }
+    return wifi_sta_connect(ap_name, ap_password, true);
 }
 
-/* Initialize Wi-Fi as sta and set scan method */
-void wifi_scan(void)
+void wifi_stop_softap(void)
 {
-    netif_wifi = esp_netif_create_default_wifi_sta();
-    assert(netif_wifi);
-
-    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
-
-  
-    memset(ap_info, 0, sizeof(ap_info));
-
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_start());
-    esp_wifi_scan_start(NULL, true);
-
-    // через глобальную переменную, блокируя семафором
-    s_semph_get_ap_list = xSemaphoreCreateMutex();
-    xSemaphoreTake(s_semph_get_ap_list, portMAX_DELAY);
-    ESP_ERROR_CHECK(esp_wifi_scan_get_ap_records(&number, ap_info));
-    ESP_ERROR_CHECK(esp_wifi_scan_get_ap_num(&ap_count));
-    xSemaphoreGive(s_semph_get_ap_list);
-
-    ESP_LOGI(TAG, "Total APs scanned = %u", ap_count);
-    for (int i = 0; (i < DEFAULT_SCAN_LIST_SIZE) && (i < ap_count); i++)
+    if (!s_netif_scan)
     {
-        ESP_LOGI(TAG, "SSID \t\t%s", ap_info[i].ssid);
-        ESP_LOGI(TAG, "RSSI \t\t%d", ap_info[i].rssi);
-        print_auth_mode(ap_info[i].authmode);
-        if (ap_info[i].authmode != WIFI_AUTH_WEP)
-        {
-            print_cipher_type(ap_info[i].pairwise_cipher, ap_info[i].group_cipher);
-        }
-        ESP_LOGI(TAG, "Channel \t\t%d\n", ap_info[i].primary);
+        return;
     }
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    esp_netif_destroy(netif_wifi);
+    /* The scanning station is the station now */
+    netif_wifi = s_netif_scan;
+    s_netif_scan = NULL;
+    s_sta_prepared = true;
+    ESP_LOGI(TAG, "SoftAP stopped");
 }
 
 void wifi_station_deinit(void)
 {
+    wifi_ps_station_down();
     esp_wifi_stop();
     esp_wifi_deinit();
     esp_netif_destroy(netif_wifi);
+    netif_wifi = NULL;
+    s_sta_prepared = false;
+    if (s_netif_scan)
+    {
+        esp_netif_destroy(s_netif_scan);
+        s_netif_scan = NULL;
+    }
 }
\ No newline at end of file
@@ -1,14 +1,35 @@
 // wifi.h
-#define DEFAULT_SCAN_LIST_SIZE 10
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_netif.h"
+
+typedef struct
+{
+    bool connected;
+    bool fast_connect;  /* associated through the BSSID and channel stored in NVS */
+    uint8_t attempts;   /* esp_wifi_connect calls until the IP arrived */
+    int64_t connect_us; /* esp_wifi_start to IP */
+    int64_t boot_us;    /* boot to IP */
+    esp_ip4_addr_t ip;
+} wifi_sta_stats_t;
 
-extern xSemaphoreHandle s_semph_get_ap_list;
-extern wifi_ap_record_t ap_info[DEFAULT_SCAN_LIST_SIZE];
-extern uint16_t ap_count;
-extern uint16_t id;
 extern const char* password;
 extern const char* ssid;
 
+/* Station netif and driver init, wifi_init_sta() does it itself when not done yet */
+void wifi_prepare_sta(void);
 esp_err_t wifi_init_sta(const char* ap_name, const char* ap_password);
 void wifi_init_softap(void);
-void wifi_scan(void);
-void wifi_station_deinit(void);
\ No newline at end of file
+/* Associate the station side of the running SoftAP (APSTA mode) with ap_name,
+ * blocks until the IP arrives or the retries are used up. ESP_ERR_INVALID_STATE
+ * when no SoftAP runs. */
+esp_err_t wifi_connect_apsta(const char* ap_name, const char* ap_password);
+/* Drop the SoftAP side, the connected station stays */
+void wifi_stop_softap(void);
+void wifi_station_deinit(void);
+
+/* Time-to-IP of the last station connect */
+void wifi_get_sta_stats(wifi_sta_stats_t *stats);
@@ -0,0 +1,263 @@
+/* Wi-Fi power save
+
+   The station idles in the configured modem sleep mode and, with auto wake, runs
+   in WIFI_PS_NONE while requests are handled or file responses stream: the first
+   request after a quiet spell still pays the wake latency (the AP holds frames
+   for a sleeping station until its next beacon), the ones following it don't.
+   CONFIG_EXAMPLE_WIFI_PS_IDLE_MS after the last traffic an esp_timer puts the
+   radio back to sleep.
+
+   Requests are accounted to the mode the radio was in when they arrived, so
+   /metrics and /powersave show what each mode costs. The times are server side,
+   from the request being parsed to the last byte handed to lwIP; the wake
+   latency in front of the request only shows in the client's round trip.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "json_stream.h"
+#include "wifi_ps.h"
+
+#define WIFI_PS_QUERY_MAX (48)
+#define WIFI_PS_PARAM_MAX (16)
+#define WIFI_PS_RESP_BUF_SIZE (256 + JSON_STREAM_HTTPD_HEAD)
+
+#if CONFIG_EXAMPLE_WIFI_PS_MAX_MODEM
+#define WIFI_PS_DEFAULT WIFI_PS_MAX_MODEM
+#elif CONFIG_EXAMPLE_WIFI_PS_NONE
+#define WIFI_PS_DEFAULT WIFI_PS_NONE
+#else
+#define WIFI_PS_DEFAULT WIFI_PS_MIN_MODEM
+#endif
+#ifndef CONFIG_EXAMPLE_WIFI_PS_AUTO
+#define CONFIG_EXAMPLE_WIFI_PS_AUTO 0
+#endif
+
+static const char *TAG = "wifi_ps";
+
+static const char *const s_mode_names[WIFI_PS_MODES] = {
+    [WIFI_PS_NONE] = "none",
+    [WIFI_PS_MIN_MODEM] = "min_modem",
+    [WIFI_PS_MAX_MODEM] = "max_modem",
+};
+
+static SemaphoreHandle_t s_lock;
+static esp_timer_handle_t s_idle_timer;
+static wifi_ps_type_t s_mode = WIFI_PS_DEFAULT; /* between requests */
+static bool s_auto = CONFIG_EXAMPLE_WIFI_PS_AUTO;
+static bool s_station;
+static wifi_ps_type_t s_radio = WIFI_PS_NONE; /* what the driver runs now */
+static unsigned s_busy;
+static wifi_ps_stats_t s_stats;
+
+/* Called with s_lock held */
+static void radio_set(wifi_ps_type_t mode)
+{
+    if (mode == s_radio)
+    {
+        return;
+    }
+    esp_err_t err = esp_wifi_set_ps(mode);
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Failed to set %s: %s", s_mode_names[mode], esp_err_to_name(err));
+        return;
+    }
+    s_radio = mode;
+}
+
+/* Called with s_lock held: the mode the radio should be in right now */
+static wifi_ps_type_t radio_wanted(void)
+{
+    if (!s_station || (s_auto && __atomic_load_n(&s_busy, __ATOMIC_ACQUIRE)))
+    {
+        return WIFI_PS_NONE;
+    }
+    return s_mode;
+}
+
+static void idle_timer_cb(void *arg)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    radio_set(radio_wanted());
+    xSemaphoreGive(s_lock);
+}
+
+esp_err_t wifi_ps_init(void)
+{
+    if (s_lock)
+    {
+        return ESP_OK;
+    }
+    const esp_timer_create_args_t timer_args = {
+        .callback = idle_timer_cb,
+        .name = "wifi_ps_idle",
+    };
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    return esp_timer_create(&timer_args, &s_idle_timer);
+}
+
+void wifi_ps_station_up(void)
+{
+    if (!s_lock)
+    {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_station = true;
+    /* The driver starts in modem sleep whatever was set before */
+    s_radio = WIFI_PS_MIN_MODEM;
+    radio_set(radio_wanted());
+    xSemaphoreGive(s_lock);
+    ESP_LOGI(TAG, "Station idles in %s%s", s_mode_names[s_mode], s_auto ? ", awake while serving" : "");
+}
+
+void wifi_ps_station_down(void)
+{
+    if (!s_lock)
+    {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_station = false;
+    s_radio = WIFI_PS_NONE;
+    xSemaphoreGive(s_lock);
+}
+
+esp_err_t wifi_ps_set(wifi_ps_type_t mode, bool auto_wake)
+{
+    if (mode >= WIFI_PS_MODES)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_lock)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_mode = mode;
+    s_auto = auto_wake;
+    radio_set(radio_wanted());
+    xSemaphoreGive(s_lock);
+    ESP_LOGI(TAG, "Power save %s, auto wake %s", s_mode_names[mode], auto_wake ? "on" : "off");
+    return ESP_OK;
+}
+
+wifi_ps_type_t wifi_ps_busy_begin(void)
+{
+    /* Read before waking: the mode the request found the radio in */
+    wifi_ps_type_t arrived = __atomic_load_n(&s_radio, __ATOMIC_RELAXED);
+    /* Under the lock even when the radio looked awake, the idle timer may be
+       putting it to sleep right now */
+    if (__atomic_fetch_add(&s_busy, 1, __ATOMIC_ACQ_REL) == 0 && s_auto && s_station)
+    {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        esp_timer_stop(s_idle_timer);
+        if (s_radio != WIFI_PS_NONE && radio_wanted() == WIFI_PS_NONE)
+        {
+            radio_set(WIFI_PS_NONE);
+            __atomic_add_fetch(&s_stats.wakeups, 1, __ATOMIC_RELAXED);
+        }
+        xSemaphoreGive(s_lock);
+    }
+    return arrived;
+}
+
+void wifi_ps_busy_end(void)
+{
+    if (__atomic_sub_fetch(&s_busy, 1, __ATOMIC_ACQ_REL) == 0 && s_auto && s_station && s_mode != WIFI_PS_NONE)
+    {
+        /* Restarted by every burst that ends, fires once traffic stopped for the delay */
+        esp_timer_stop(s_idle_timer);
+        esp_timer_start_once(s_idle_timer, CONFIG_EXAMPLE_WIFI_PS_IDLE_MS * 1000ULL);
+    }
+}
+
+void wifi_ps_record(wifi_ps_type_t mode, int64_t elapsed_us)
+{
+    __atomic_add_fetch(&s_stats.requests[mode], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&s_stats.request_us[mode], elapsed_us, __ATOMIC_RELAXED);
+}
+
+void wifi_ps_get_stats(wifi_ps_stats_t *stats)
+{
+    for (int i = 0; i < WIFI_PS_MODES; i++)
+    {
+        stats->requests[i] = __atomic_load_n(&s_stats.requests[i], __ATOMIC_RELAXED);
+        stats->request_us[i] = __atomic_load_n(&s_stats.request_us[i], __ATOMIC_RELAXED);
+    }
+    stats->wakeups = __atomic_load_n(&s_stats.wakeups, __ATOMIC_RELAXED);
+}
+
+const char *wifi_ps_mode_name(wifi_ps_type_t mode)
+{
+    return mode < WIFI_PS_MODES ? s_mode_names[mode] : "unknown";
+}
+
+esp_err_t wifi_ps_get_handler(httpd_req_t *req)
+{
+    char buf[WIFI_PS_RESP_BUF_SIZE];
+    json_stream_t js;
+    wifi_ps_stats_t stats;
+
+    wifi_ps_get_stats(&stats);
+    json_stream_init_httpd(&js, req, buf, sizeof(buf));
+    json_stream_obj_begin(&js, NULL);
+    json_stream_str(&js, "mode", s_mode_names[s_mode]);
+    json_stream_bool(&js, "auto", s_auto);
+    json_stream_int(&js, "idle_ms", CONFIG_EXAMPLE_WIFI_PS_IDLE_MS);
+    json_stream_int(&js, "wakeups", stats.wakeups);
+    json_stream_arr_begin(&js, "requests");
+    for (int i = 0; i < WIFI_PS_MODES; i++)
+    {
+        json_stream_obj_begin(&js, NULL);
+        json_stream_str(&js, "mode", s_mode_names[i]);
+        json_stream_int(&js, "count", stats.requests[i]);
+        json_stream_int(&js, "avg_us", stats.requests[i] ? stats.request_us[i] / stats.requests[i] : 0);
+        json_stream_obj_end(&js);
+    }
+    json_stream_arr_end(&js);
+    json_stream_obj_end(&js);
+    return json_stream_finish(&js);
+}
+
+esp_err_t wifi_ps_post_handler(httpd_req_t *req)
+{
+    char query[WIFI_PS_QUERY_MAX];
+    char param[WIFI_PS_PARAM_MAX];
+    wifi_ps_type_t mode = s_mode;
+    bool auto_wake = s_auto;
+
+    if (httpd_req_get_url_query_len(req) >= sizeof(query))
+    {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Query too long");
+    }
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK)
+    {
+        if (httpd_query_key_value(query, "mode", param, sizeof(param)) == ESP_OK)
+        {
+            for (mode = 0; mode < WIFI_PS_MODES && strcmp(param, s_mode_names[mode]); mode++)
+            {
+            }
+            if (mode == WIFI_PS_MODES)
+            {
+                return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Bad mode");
+            }
+        }
+        if (httpd_query_key_value(query, "auto", param, sizeof(param)) == ESP_OK)
+        {
+            auto_wake = atoi(param) != 0;
+        }
+    }
+    wifi_ps_set(mode, auto_wake);
+    return wifi_ps_get_handler(req);
+}
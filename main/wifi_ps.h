@@ -0,0 +1,47 @@
+// wifi_ps.h
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_wifi.h"
+#include "esp_http_server.h"
+
+#define WIFI_PS_MODES (WIFI_PS_MAX_MODEM + 1)
+
+typedef struct
+{
+    uint32_t requests[WIFI_PS_MODES]; /* by the radio mode the request arrived in */
+    uint64_t request_us[WIFI_PS_MODES];
+    uint32_t wakeups;                 /* switches to WIFI_PS_NONE for traffic */
+} wifi_ps_stats_t;
+
+/* Mode timer and lock, call before the first request */
+esp_err_t wifi_ps_init(void);
+
+/* The station is associated: the power-save mode is applied from now on. Until
+ * then (and in SoftAP mode) the radio doesn't sleep. */
+void wifi_ps_station_up(void);
+void wifi_ps_station_down(void);
+
+/* Mode between requests; with auto_wake the radio runs in WIFI_PS_NONE while any
+ * traffic is in flight and returns to mode CONFIG_EXAMPLE_WIFI_PS_IDLE_MS after */
+esp_err_t wifi_ps_set(wifi_ps_type_t mode, bool auto_wake);
+
+/* Bracket a request or a streamed response. begin returns the mode the radio was
+ * in when the traffic arrived. */
+wifi_ps_type_t wifi_ps_busy_begin(void);
+void wifi_ps_busy_end(void);
+
+/* Account a request to the mode it arrived in */
+void wifi_ps_record(wifi_ps_type_t mode, int64_t elapsed_us);
+
+void wifi_ps_get_stats(wifi_ps_stats_t *stats);
+const char *wifi_ps_mode_name(wifi_ps_type_t mode);
+
+/* GET /powersave:
+ *   {"mode":"min_modem","auto":true,"idle_ms":1000,"wakeups":3,
+ *    "requests":[{"mode":"none","count":12,"avg_us":830},..]}
+ * POST /powersave?mode=max_modem&auto=0 sets the mode and answers the same */
+esp_err_t wifi_ps_get_handler(httpd_req_t *req);
+esp_err_t wifi_ps_post_handler(httpd_req_t *req);
@@ -0,0 +1,38 @@
+# Write asset-manifest.txt for a Vue dist folder.
+#
+#   cmake -DDIST_DIR=<path to dist> -P asset_manifest.cmake
+#
+# One line per served file: <etag> <codings> <path>
+#   etag    - first 16 hex digits of the SHA-256 of the uncompressed file
+#   codings - "-" or a comma separated list of precompressed sidecars (gz, br)
+#   path    - URI path relative to the site root
+
+if(NOT DIST_DIR OR NOT IS_DIRECTORY ${DIST_DIR})
+    message(FATAL_ERROR "DIST_DIR must point to a dist folder")
+endif()
+
+file(GLOB_RECURSE dist_files RELATIVE ${DIST_DIR} ${DIST_DIR}/*)
+list(SORT dist_files)
+set(manifest "")
+foreach(dist_file ${dist_files})
+    if(dist_file MATCHES "\\.(gz|br|map)$" OR dist_file STREQUAL "asset-manifest.txt")
+        continue()
+    endif()
+    file(SHA256 ${DIST_DIR}/${dist_file} hash)
+    string(SUBSTRING ${hash} 0 16 etag)
+    set(codings "")
+    if(EXISTS ${DIST_DIR}/${dist_file}.gz)
+        list(APPEND codings "gz")
+    endif()
+    if(EXISTS ${DIST_DIR}/${dist_file}.br)
+        list(APPEND codings "br")
+    endif()
+    if(codings)
+        string(REPLACE ";" "," codings "${codings}")
+    else()
+        set(codings "-")
+    endif()
+    string(APPEND manifest "${etag} ${codings} /${dist_file}\n")
+endforeach()
+
+file(WRITE ${DIST_DIR}/asset-manifest.txt "${manifest}")
@@ -0,0 +1,98 @@
+#!/usr/bin/env python
+#
+# Pack Vue dist folders into the read-only website bundle served by main/asset_bundle.c
+#
+#   bundle_pack.py -o www_bundle.bin --site prod=front_/greetings/dist --site softap=front_/start_axios/dist
+#
+# Every file of a site is stored under /<site>/<path>. Precompressed .gz/.br sidecars
+# next to a file are stored in the same entry so the server can pick one without a lookup.
+# The layout must match bundle_header_t and bundle_entry_t in main/asset_bundle.h.
+
+import argparse
+import hashlib
+import os
+import struct
+import sys
+
+BUNDLE_MAGIC = 0x444E4257
+BUNDLE_VERSION = 1
+HEADER = struct.Struct('<IHHIIII')
+ENTRY = struct.Struct('<IHH16s3I3I')
+SIDECARS = ('.gz', '.br')
+SKIPPED = ('.gz', '.br', '.map', 'asset-manifest.txt')
+
+
+def align(value, alignment=4):
+    return (value + alignment - 1) & ~(alignment - 1)
+
+
+def collect(sites):
+    files = []
+    for site, root in sites:
+        if not os.path.isdir(root):
+            sys.exit('{} doesn\'t exist. Please run \'npm run build\' first'.format(root))
+        for dirpath, _, names in os.walk(root):
+            for name in names:
+                if name.endswith(SKIPPED):
+                    continue
+                full = os.path.join(dirpath, name)
+                rel = os.path.relpath(full, root).replace(os.sep, '/')
+                blobs = [open(full, 'rb').read()]
+                for suffix in SIDECARS:
+                    sidecar = full + suffix
+                    blobs.append(open(sidecar, 'rb').read() if os.path.isfile(sidecar) else b'')
+                files.append(('/{}/{}'.format(site, rel).encode(), blobs))
+    files.sort(key=lambda f: f[0])
+    return files
+
+
+def pack(files):
+    index_offset = align(HEADER.size)
+    strings_offset = index_offset + ENTRY.size * len(files)
+    strings = b''
+    path_offsets = []
+    for path, _ in files:
+        path_offsets.append(strings_offset + len(strings))
+        strings += path + b'\0'
+
+    data = bytearray()
+    offset = align(strings_offset + len(strings))
+    entries = b''
+    for (path, blobs), path_offset in zip(files, path_offsets):
+        offsets, sizes = [], []
+        for blob in blobs:
+            offsets.append(offset + len(data) if blob else 0)
+            sizes.append(len(blob))
+            data += blob
+            data += b'\0' * (align(len(data)) - len(data))
+        etag = hashlib.sha256(blobs[0]).hexdigest()[:16].encode()
+        entries += ENTRY.pack(path_offset, len(path), 0, etag, *(offsets + sizes))
+
+    image = bytearray(HEADER.pack(BUNDLE_MAGIC, BUNDLE_VERSION, ENTRY.size, len(files), index_offset, 0, 0))
+    image += b'\0' * (index_offset - len(image))
+    image += entries + strings
+    image += b'\0' * (align(len(image)) - len(image))
+    image += data
+    struct.pack_into('<I', image, 16, len(image))
+    return image
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Pack dist folders into a website bundle image')
+    parser.add_argument('-o', '--output', required=True, help='bundle image to write')
+    parser.add_argument('--site', action='append', required=True, metavar='NAME=DIR',
+                        help='serve DIR under /NAME, may be repeated')
+    parser.add_argument('--max-size', type=lambda x: int(x, 0), help='fail if the image exceeds this size')
+    args = parser.parse_args()
+
+    sites = [s.split('=', 1) for s in args.site]
+    image = pack(collect(sites))
+    if args.max_size is not None and len(image) > args.max_size:
+        sys.exit('Bundle is {} bytes, partition only holds {}'.format(len(image), args.max_size))
+    with open(args.output, 'wb') as f:
+        f.write(image)
+    print('Website bundle: {} bytes'.format(len(image)))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,187 @@
+#!/usr/bin/env python
+#
+# Generate the compile-time asset index used by main/asset_index.c
+#
+#   gen_asset_index.py -o asset_index_data.c --site prod=front_/greetings/dist --site softap=front_/start_axios/dist
+#
+# For every site the index maps URIs to the file, its size, MIME type, ETag and a
+# ready-to-send response head for each representation (identity, .gz, .br).
+# URIs are looked up through a minimal perfect hash: bucket = fnv(uri, 0) % buckets,
+# slot = fnv(uri, seeds[bucket]) % count. A site whose dist folder is missing gets
+# an empty table and the server falls back to probing the filesystem.
+
+import argparse
+import hashlib
+import os
+import re
+import sys
+
+SKIPPED = ('.gz', '.br', '.map', 'asset-manifest.txt')
+# Representations in the order of asset_rep_t slots, see main/asset_index.h
+CODINGS = ((None, ''), ('gzip', '.gz'), ('br', '.br'))
+MIME_TYPES = {
+    '.html': 'text/html',
+    '.js': 'application/javascript',
+    '.css': 'text/css',
+    '.png': 'image/png',
+    '.jpg': 'image/jpeg',
+    '.ico': 'image/x-icon',
+    '.svg': 'text/xml',
+    '.json': 'application/json',
+}
+HASHED_NAME = re.compile(r'\.[0-9a-fA-F]{8}\.[^./]+$')
+CACHE_IMMUTABLE = 'public, max-age=31536000, immutable'
+CACHE_REVALIDATE = 'no-cache'
+
+
+def fnv(data, seed):
+    """FNV-1a seeded like asset_index_hash() in main/asset_index.c"""
+    h = (2166136261 ^ seed) & 0xffffffff
+    for b in data:
+        h = ((h ^ b) * 16777619) & 0xffffffff
+    return h ^ (h >> 16)
+
+
+def perfect_hash(keys):
+    """Hash and displace: find a seed per bucket so every key lands in its own slot"""
+    count = len(keys)
+    buckets = max(1, (count + 1) // 2)
+    groups = [[] for _ in range(buckets)]
+    for i, key in enumerate(keys):
+        groups[fnv(key, 0) % buckets].append(i)
+    seeds = [0] * buckets
+    slots = [None] * count
+    for bucket in sorted(range(buckets), key=lambda b: -len(groups[b])):
+        members = groups[bucket]
+        if not members:
+            continue
+        for seed in range(1, 65536):
+            wanted = [fnv(keys[i], seed) % count for i in members]
+            if len(set(wanted)) == len(wanted) and all(slots[s] is None for s in wanted):
+                for i, s in zip(members, wanted):
+                    slots[s] = i
+                seeds[bucket] = seed
+                break
+        else:
+            sys.exit('No perfect hash seed found')
+    return seeds, slots
+
+
+def c_str(text):
+    return '"' + text.replace('\\', '\\\\').replace('"', '\\"').replace('\r', '\\r').replace('\n', '\\n') + '"'
+
+
+def collect(root):
+    files = []
+    if not os.path.isdir(root):
+        print('{} doesn\'t exist, the site is not indexed'.format(root))
+        return files
+    for dirpath, _, names in os.walk(root):
+        for name in names:
+            if name.endswith(SKIPPED):
+                continue
+            full = os.path.join(dirpath, name)
+            uri = '/' + os.path.relpath(full, root).replace(os.sep, '/')
+            etag = hashlib.sha256(open(full, 'rb').read()).hexdigest()[:16]
+            ext = os.path.splitext(name)[1].lower()
+            reps = []
+            for coding, suffix in CODINGS:
+                path = full + suffix
+                if not os.path.isfile(path):
+                    reps.append(None)
+                    continue
+                reps.append({
+                    'path': uri + suffix,
+                    'size': os.path.getsize(path),
+                    'etag': '"{}{}"'.format(etag, '-' + coding if coding else ''),
+                    'coding': coding,
+                })
+            files.append({
+                'uri': uri,
+                'type': MIME_TYPES.get(ext, 'text/plain'),
+                'cache': CACHE_IMMUTABLE if HASHED_NAME.search(uri) else CACHE_REVALIDATE,
+                'reps': reps,
+            })
+    files.sort(key=lambda f: f['uri'])
+    return files
+
+
+def response_head(f, rep):
+    head = 'HTTP/1.1 200 OK\r\n'
+    head += 'Content-Type: {}\r\n'.format(f['type'])
+    head += 'Content-Length: {}\r\n'.format(rep['size'])
+    head += 'Accept-Ranges: bytes\r\n'
+    head += 'Cache-Control: {}\r\n'.format(f['cache'])
+    head += 'Vary: Accept-Encoding\r\n'
+    if rep['coding']:
+        head += 'Content-Encoding: {}\r\n'.format(rep['coding'])
+    head += 'ETag: {}\r\n'.format(rep['etag'])
+    return head + '\r\n'
+
+
+def emit_site(out, name, files):
+    ident = re.sub(r'\W', '_', name)
+    if not files:
+        out.append('static const asset_index_entry_t s_{}_entries[1];'.format(ident))
+        out.append('static const uint16_t s_{}_seeds[1];\n'.format(ident))
+        return '{{ {}, s_{}_entries, 0, s_{}_seeds, 1, -1 }}'.format(c_str(name), ident, ident)
+
+    keys = [f['uri'].encode() for f in files]
+    seeds, slots = perfect_hash(keys)
+    ordered = [files[i] for i in slots]
+    out.append('static const asset_index_entry_t s_{}_entries[] = {{'.format(ident))
+    for f in ordered:
+        codings = []
+        if f['reps'][1]:
+            codings.append('ASSET_CODING_GZIP')
+        if f['reps'][2]:
+            codings.append('ASSET_CODING_BR')
+        out.append('    {')
+        out.append('        .uri = {}, .uri_len = {},'.format(c_str(f['uri']), len(f['uri'].encode())))
+        out.append('        .content_type = {}, .cache_control = {},'.format(c_str(f['type']), c_str(f['cache'])))
+        out.append('        .codings = {},'.format(' | '.join(codings) or '0'))
+        out.append('        .rep = {')
+        for rep in f['reps']:
+            if not rep:
+                out.append('            { 0 },')
+                continue
+            head = response_head(f, rep)
+            out.append('            {{ .path = {}, .size = {}, .etag = {},'.format(
+                c_str(rep['path']), rep['size'], c_str(rep['etag'])))
+            out.append('              .head = {}, .head_len = {} }},'.format(c_str(head), len(head)))
+        out.append('        },')
+        out.append('    },')
+    out.append('};')
+    out.append('static const uint16_t s_{}_seeds[] = {{ {} }};\n'.format(ident, ', '.join(str(s) for s in seeds)))
+    fallback = next((i for i, f in enumerate(ordered) if f['uri'] == '/index.html'), -1)
+    return '{{ {}, s_{}_entries, {}, s_{}_seeds, {}, {} }}'.format(
+        c_str(name), ident, len(ordered), ident, len(seeds), fallback)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Generate the compile-time asset index')
+    parser.add_argument('-o', '--output', required=True, help='C source to write')
+    parser.add_argument('--site', action='append', default=[], metavar='NAME=DIR',
+                        help='index DIR as the site served from <mount point>/NAME, may be repeated')
+    args = parser.parse_args()
+
+    out = ['/* Generated by tools/gen_asset_index.py, do not edit */',
+           '#include "asset_index.h"', '']
+    sites = []
+    for site in args.site:
+        name, root = site.split('=', 1)
+        sites.append(emit_site(out, name, collect(root)))
+    out.append('const asset_site_t asset_sites[] = {')
+    out.extend('    {},'.format(s) for s in sites)
+    out.append('};')
+    out.append('const size_t asset_site_count = {};'.format(len(sites)))
+
+    text = '\n'.join(out) + '\n'
+    if os.path.isfile(args.output) and open(args.output).read() == text:
+        return
+    with open(args.output, 'w') as f:
+        f.write(text)
+
+
+if __name__ == '__main__':
+    main()